@@ -21,6 +21,10 @@ workspace "Concordia"
     filter "system:windows"
         systemversion "latest"
 
+    -- Its kernels only run once the CPU said it has AVX2, see dsp.cpp
+    filter "files:**/dsp_avx2.cpp"
+        vectorextensions "AVX2"
+
 project "Glad"
     location(_ACTION)
     language "C"
@@ -122,11 +126,27 @@ project "ConcordiaTest"
 
     includedirs {
         "src/common", 
+        "src/server", 
+        "src/client", 
     }
     
     files { 
         "src/test/**.cpp", 
         "src/test/**.h", 
+        "src/common/dsp.cpp", 
+        "src/common/dsp_sse2.cpp", 
+        "src/common/dsp_avx2.cpp", 
+        "src/common/fec.cpp", 
+        "src/common/log.cpp", 
+        "src/common/resampler.cpp", 
+        "src/common/realtime.cpp", 
+        "src/common/local_transport.cpp", 
+        "src/server/dynamics.cpp", 
+        "src/server/recorder.cpp", 
+        "src/server/mixer.cpp", 
+        "src/server/capture.cpp", 
+        "src/client/playout_buffer.cpp", 
+        "src/client/plc.cpp", 
     }
 
 project "ConcordiaClient"
@@ -188,4 +208,65 @@ project "ConcordiaServer"
 
     filter "system:windows"
         defines { "_WIN32_WINDOWS" }
-        links { "ws2_32" }
\ No newline at end of file
+        links { "ws2_32" }
+
+project "ConcordiaLoadGen"
+    location(_ACTION)
+    language "C++"
+    cppdialect "C++20"
+    kind "ConsoleApp"
+
+    objdir "bin-int/%{cfg.buildcfg}/%{prj.name}"
+    targetdir "bin/%{cfg.buildcfg}/%{prj.name}"
+    debugdir "bin/%{cfg.buildcfg}/%{prj.name}"
+
+    includedirs {
+        "vendor/asio/include",
+        "src/common", 
+    }
+
+    files { 
+        "src/common/**.cpp", 
+        "src/common/**.h", 
+        "src/loadgen/**.cpp", 
+        "src/loadgen/**.h",  
+    }
+
+    filter "system:windows"
+        defines { "_WIN32_WINDOWS" }
+        links { "ws2_32" }
+
+project "ConcordiaBench"
+    location(_ACTION)
+    language "C++"
+    cppdialect "C++20"
+    kind "ConsoleApp"
+
+    objdir "bin-int/%{cfg.buildcfg}/%{prj.name}"
+    targetdir "bin/%{cfg.buildcfg}/%{prj.name}"
+    debugdir "."
+
+    includedirs {
+        "vendor/glad/include",
+        "src/common", 
+        "src/server", 
+        "src/ml",
+    }
+    
+    files { 
+        "src/bench/**.cpp", 
+        "src/bench/**.h", 
+        "src/common/dsp.cpp", 
+        "src/common/dsp_sse2.cpp", 
+        "src/common/dsp_avx2.cpp", 
+        "src/common/log.cpp", 
+        "src/common/metrics.cpp", 
+        "src/common/resampler.cpp", 
+        "src/server/dynamics.cpp", 
+        "src/server/mixer.cpp", 
+    }
+
+    links { "MediaLib", "Glad", "GLFW" }
+
+    filter "system:windows"
+        links { "opengl32", "gdi32" }
\ No newline at end of file
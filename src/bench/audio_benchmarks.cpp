@@ -0,0 +1,183 @@
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <format>
+#include <algorithm>
+
+#include "common.h"
+#include "metrics.h"
+#include "mixer.h"
+#include "bench.h"
+
+namespace cnc::bench
+{
+	static constexpr audio_format s_client_format{ 16000, 1 };
+
+	// A tick of a room: a few people talking over everybody else's background noise, then
+	// every listener's output fetched, which is what the server does before writing
+	static void run_mixer_benchmark(suite& s, const std::size_t stream_count, const std::size_t talkers)
+	{
+		const auto name = std::format("mixer/mix_minus/{}_streams", stream_count);
+		if (!s.is_selected(name))
+			return;
+
+		const auto frame_size = s_client_format.samples_per_frame();
+		std::vector<std::vector<sample_t>> frames(stream_count, std::vector<sample_t>(frame_size));
+
+		for (std::size_t id = 0; id < stream_count; ++id)
+		{
+			const float amplitude = id < talkers ? 8000.0f : 20.0f;
+			const float frequency = 110.0f + 40.0f * id;
+			for (std::size_t i = 0; i < frame_size; ++i)
+				frames[id][i] = static_cast<sample_t>(amplitude * std::sin(2.0f * 3.14159265f * frequency * i / s_client_format.sample_rate));
+		}
+
+		std::vector<mixer_stream> streams;
+		for (std::size_t id = 0; id < stream_count; ++id)
+			streams.push_back({ static_cast<u32>(id + 1), s_client_format, frames[id], s_client_format });
+
+		mixer room_mixer;
+
+		s.run(name, [&](const std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+			{
+				room_mixer.mix(streams);
+				for (const auto& stream : streams)
+					do_not_optimize(room_mixer.get_output(stream.id).data());
+			}
+		});
+	}
+
+	// One contended lock, the way the UI and the network thread share state
+	static void run_exclusive_resource_benchmark(suite& s, const std::size_t other_threads)
+	{
+		const auto name = std::format("exclusive_resource/use/{}_contenders", other_threads);
+		if (!s.is_selected(name))
+			return;
+
+		exclusive_resource<std::uint64_t> counter;
+		std::atomic_bool running{ true };
+		std::vector<std::thread> threads;
+
+		for (std::size_t i = 0; i < other_threads; ++i)
+			threads.emplace_back([&] {
+				while (running.load(std::memory_order_relaxed))
+					counter.use([](auto& c) { c++; });
+			});
+
+		s.run(name, [&](const std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				counter.use([](auto& c) { c++; });
+		});
+
+		running = false;
+		for (auto& t : threads)
+			t.join();
+	}
+
+	// Other threads hammering the same counter, each from its own shard
+	static void run_counter_benchmark(suite& s, const std::size_t other_threads)
+	{
+		const auto name = std::format("metrics/counter_add/{}_contenders", other_threads);
+		if (!s.is_selected(name))
+			return;
+
+		metrics::counter counter;
+		std::atomic_bool running{ true };
+		std::vector<std::thread> threads;
+
+		for (std::size_t i = 0; i < other_threads; ++i)
+			threads.emplace_back([&] {
+				while (running.load(std::memory_order_relaxed))
+					counter.add();
+			});
+
+		s.run(name, [&](const std::uint64_t n) {
+			for (std::uint64_t i = 0; i < n; ++i)
+				counter.add();
+		});
+
+		running = false;
+		for (auto& t : threads)
+			t.join();
+	}
+
+	void run_audio_benchmarks(suite& s)
+	{
+		run_mixer_benchmark(s, 8, 3);
+		run_mixer_benchmark(s, 64, 3);
+		run_mixer_benchmark(s, 256, 3);
+
+		// What the audio callback does with every chunk it captures
+		{
+			std::vector<sample_t> chunk(512);
+			for (std::size_t i = 0; i < chunk.size(); ++i)
+				chunk[i] = static_cast<sample_t>(i * 31);
+
+			history_buffer history;
+			s.run("history_buffer/push_512", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					history.push(chunk);
+				do_not_optimize(history);
+			});
+
+			// The UI takes the whole history once per frame
+			std::vector<sample_t> out(history_buffer::size());
+			s.run("history_buffer/copy_out", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+				{
+					history.copy_out(out);
+					do_not_optimize(out);
+				}
+			});
+
+			// The UI reads one of these per pixel of the waveform
+			s.run("history_buffer/sample", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					do_not_optimize(history.sample((i & 1023) / 1024.0f));
+			});
+
+			// Both ends of the session's histories
+			shared_history shared;
+			s.run("shared_history/push_512", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					shared.push(chunk);
+				do_not_optimize(shared);
+			});
+
+			s.run("shared_history/push_512_snapshot", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+				{
+					shared.push(chunk);
+					do_not_optimize(shared.snapshot());
+				}
+			});
+
+		}
+
+		run_exclusive_resource_benchmark(s, 0);
+		run_exclusive_resource_benchmark(s, 1);
+		run_exclusive_resource_benchmark(s, 3);
+
+		run_counter_benchmark(s, 0);
+		run_counter_benchmark(s, 3);
+
+		// What the audio callback and the mixer tick pay for their timings
+		{
+			metrics::histogram histogram(metrics::latency_bounds_us);
+			s.run("metrics/histogram_record", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					histogram.record((i * 977) & 0xffff);
+			});
+			do_not_optimize(histogram.snapshot().count);
+
+			metrics::gauge gauge;
+			s.run("metrics/gauge_set", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					gauge.set(static_cast<metrics::i64>(i));
+			});
+			do_not_optimize(gauge.value());
+		}
+	}
+}
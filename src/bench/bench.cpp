@@ -0,0 +1,54 @@
+#include "bench.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+namespace cnc::bench
+{
+	using bench_clock = std::chrono::steady_clock;
+
+	static constexpr auto s_min_calibration_time = std::chrono::milliseconds(10);
+	static constexpr auto s_sample_time = std::chrono::milliseconds(50);
+	static constexpr std::size_t s_sample_count = 7;
+
+	static double time_ns(const std::function<void(std::uint64_t)>& op, const std::uint64_t n)
+	{
+		const auto start = bench_clock::now();
+		op(n);
+		return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+	}
+
+	bool suite::is_selected(std::string_view name) const
+	{
+		return _filter.empty() || name.find(_filter) != std::string_view::npos;
+	}
+
+	void suite::run(std::string_view name, const std::function<void(std::uint64_t)>& op)
+	{
+		if (!is_selected(name))
+			return;
+
+		std::uint64_t n = 1;
+		double elapsed = time_ns(op, n);
+
+		while (elapsed < std::chrono::duration<double, std::nano>(s_min_calibration_time).count())
+		{
+			n *= 2;
+			elapsed = time_ns(op, n);
+		}
+
+		const double target = std::chrono::duration<double, std::nano>(s_sample_time).count();
+		n = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(n * target / elapsed));
+
+		std::vector<double> samples;
+		for (std::size_t i = 0; i < s_sample_count; ++i)
+			samples.push_back(time_ns(op, n) / n);
+
+		std::ranges::sort(samples);
+		const double median = samples[samples.size() / 2];
+
+		std::printf("%-40s %14.1f ns/op  (%llu ops x %zu)\n", std::string(name).c_str(), median, static_cast<unsigned long long>(n), s_sample_count);
+		_results.push_back({ std::string(name), median, n });
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace cnc::bench
+{
+	// Keeps the compiler from throwing away a result nobody reads
+	template<typename T>
+	inline void do_not_optimize(const T& value)
+	{
+#if defined(_MSC_VER)
+		static const volatile void* s_sink;
+		s_sink = &value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	struct result
+	{
+		std::string name;
+		double ns_per_op;
+		std::uint64_t ops;	// Per sample
+	};
+
+	/*
+		Times one operation at a time. The count is doubled until a batch takes long enough to
+		trust the clock, then a few batches of about 50 ms are run and the median kept, which
+		shrugs off the odd preemption better than a mean.
+	*/
+	class suite
+	{
+	private:
+		std::string _filter;
+		std::vector<result> _results;
+
+	public:
+		explicit suite(std::string_view filter) : _filter(filter) {}
+
+		// Only what the filter, a substring of the name, lets through
+		bool is_selected(std::string_view name) const;
+
+		// op(n) runs the operation n times
+		void run(std::string_view name, const std::function<void(std::uint64_t)>& op);
+
+		const std::vector<result>& get_results() const { return _results; }
+	};
+
+	void run_audio_benchmarks(suite& s);
+	void run_dsp_benchmarks(suite& s);
+	void run_vecmath_benchmarks(suite& s);
+
+	// Needs a window, false if none could be opened
+	bool run_graphics_benchmarks(suite& s);
+}
@@ -0,0 +1,217 @@
+#include <vector>
+#include <format>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include <common.h>
+#include <dsp.h>
+
+#include "bench.h"
+
+namespace cnc::bench
+{
+	// The loops the client and the server had before the kernels, to compare them with
+	namespace loops
+	{
+		static constexpr float s_i16_scale = static_cast<float>(std::numeric_limits<i16>::max());
+
+		static void downmix_to_float(std::span<const sample_t> input, const u32 channels, std::span<float> output)
+		{
+			const float scale = 1.0f / (s_i16_scale * channels);
+			for (std::size_t i = 0; i < output.size(); ++i)
+			{
+				float acc = 0.0f;
+				for (u32 c = 0; c < channels; ++c)
+					acc += input[i * channels + c];
+				output[i] = acc * scale;
+			}
+		}
+
+		static void upmix_from_float(std::span<const float> input, const u32 channels, std::span<sample_t> output)
+		{
+			for (std::size_t i = 0; i < input.size(); ++i)
+			{
+				const auto s = static_cast<sample_t>(std::clamp(input[i] * s_i16_scale, -s_i16_scale - 1.0f, s_i16_scale));
+				for (u32 c = 0; c < channels; ++c)
+					output[i * channels + c] = s;
+			}
+		}
+
+		static void multiply(std::span<float> buffer, const float from, const float to)
+		{
+			const std::size_t n = buffer.size();
+			const float step = (to - from) / n;
+			for (std::size_t i = 0; i < n; ++i)
+				buffer[i] *= from + step * i;
+		}
+
+		static void multiply_add(std::span<const float> in, const float from, const float to, std::span<float> acc)
+		{
+			const std::size_t n = in.size();
+			const float step = (to - from) / n;
+			for (std::size_t i = 0; i < n; ++i)
+				acc[i] += in[i] * (from + step * i);
+		}
+	}
+
+	void run_dsp_benchmarks(suite& s)
+	{
+		// A frame in the mix format, what the mixer works on per stream and tick
+		const std::size_t n = mix_format.frame_length();
+
+		std::vector<sample_t> samples(n * 2), out(n * 2);
+		std::vector<float> floats(n), acc(n);
+		for (std::size_t i = 0; i < samples.size(); ++i)
+			samples[i] = static_cast<sample_t>(std::sin(i * 0.01f) * 30000.0f);
+		for (std::size_t i = 0; i < n; ++i)
+			floats[i] = std::sin(i * 0.013f) * 1.2f;
+
+		const auto mono = std::span(samples).first(n);
+		const float volume = 0.8f;
+
+		s.run("dsp/to_float/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::downmix_to_float(mono, 1, acc);
+				do_not_optimize(acc);
+			}
+		});
+
+		s.run("dsp/to_int16/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::upmix_from_float(floats, 1, out);
+				do_not_optimize(out);
+			}
+		});
+
+		s.run("dsp/gain_i16/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				std::ranges::transform(mono, out.begin(), [vol = volume](const sample_t v) { return v * vol; });
+				do_not_optimize(out);
+			}
+		});
+
+		s.run("dsp/gain_ramp/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::multiply(acc, 1.0f, 1.0f);
+				do_not_optimize(acc);
+			}
+		});
+
+		s.run("dsp/accumulate/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::multiply_add(floats, 0.5f, 0.5f, acc);
+				do_not_optimize(acc);
+			}
+		});
+
+		s.run("dsp/measure/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				float energy = 0.0f, peak = 0.0f;
+				for (const float v : floats)
+				{
+					energy += v * v;
+					peak = std::max(peak, std::abs(v));
+				}
+				do_not_optimize(energy);
+				do_not_optimize(peak);
+			}
+		});
+
+		s.run("dsp/deinterleave/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::downmix_to_float(samples, 2, acc);
+				do_not_optimize(acc);
+			}
+		});
+
+		s.run("dsp/interleave/loop", [&](const std::uint64_t ops) {
+			for (std::uint64_t i = 0; i < ops; ++i)
+			{
+				loops::upmix_from_float(floats, 2, out);
+				do_not_optimize(out);
+			}
+		});
+
+		// Every instruction set the CPU has, then back to what it picked
+		const auto detected = dsp::get_isa();
+
+		for (const auto isa : { dsp::isa::scalar, dsp::isa::sse2, dsp::isa::avx2 })
+		{
+			if (!dsp::set_isa(isa))
+				continue;
+
+			const auto name = [&](std::string_view kernel) { return std::format("dsp/{}/{}", kernel, dsp::to_string(isa)); };
+
+			s.run(name("to_float"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::to_float(mono, acc);
+					do_not_optimize(acc);
+				}
+			});
+
+			s.run(name("to_int16"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::to_int16(floats, out);
+					do_not_optimize(out);
+				}
+			});
+
+			s.run(name("gain_i16"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::apply_gain(mono, volume, out);
+					do_not_optimize(out);
+				}
+			});
+
+			s.run(name("gain_ramp"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::apply_gain(acc, 1.0f, 1.0f);
+					do_not_optimize(acc);
+				}
+			});
+
+			s.run(name("accumulate"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::accumulate(floats, 0.5f, 0.5f, acc);
+					do_not_optimize(acc);
+				}
+			});
+
+			s.run(name("measure"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+					do_not_optimize(dsp::measure(floats));
+			});
+
+			s.run(name("deinterleave"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::deinterleave_to_mono(samples, acc);
+					do_not_optimize(acc);
+				}
+			});
+
+			s.run(name("interleave"), [&](const std::uint64_t ops) {
+				for (std::uint64_t i = 0; i < ops; ++i)
+				{
+					dsp::interleave_from_mono(floats, out);
+					do_not_optimize(out);
+				}
+			});
+		}
+
+		dsp::set_isa(detected);
+	}
+}
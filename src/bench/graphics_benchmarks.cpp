@@ -0,0 +1,71 @@
+#include <memory>
+#include <string>
+
+#include <core/application.h>
+
+#include "bench.h"
+
+namespace cnc::bench
+{
+	/*
+		The renderer only works inside ml::app::run, so these run from the first frame of a
+		scene and quit. Timings include flushing the batch when the vertex buffer fills up,
+		which is part of what a frame pays for.
+	*/
+	class graphics_bench_scene : public ml::scene
+	{
+	private:
+		suite& _suite;
+
+	public:
+		explicit graphics_bench_scene(suite& s) : _suite(s) {}
+
+		void on_update() override
+		{
+			using namespace ml;
+
+			_suite.run("font/default_atlas", [](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+				{
+					auto f = font::get_default_font();
+					do_not_optimize(f);
+				}
+			});
+
+			_suite.run("ml/batch/quad", [](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					app::quad(vec2f{ static_cast<float>(i & 1023), static_cast<float>((i >> 10) & 511) }, { 8.0f, 8.0f });
+				app::flush();
+			});
+
+			// The client's waveforms, one vertex per pixel
+			_suite.run("ml/batch/line_strip_1280", [](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+				{
+					app::begin(app::primitive_type::line_strip);
+					for (std::uint32_t x = 0; x < 1280; ++x)
+						app::vertex(vec2f{ static_cast<float>(x), static_cast<float>(x & 63) });
+					app::end();
+				}
+				app::flush();
+			});
+
+			const auto fnt = font::get_default_font();
+			const std::string line(64, 'a');
+
+			_suite.run("ml/batch/draw_text_64", [&](const std::uint64_t n) {
+				for (std::uint64_t i = 0; i < n; ++i)
+					app::draw_text(fnt, line, 16.0f);
+				app::flush();
+			});
+
+			app::quit();
+		}
+	};
+
+	bool run_graphics_benchmarks(suite& s)
+	{
+		ml::app::goto_scene(std::make_shared<graphics_bench_scene>(s));
+		return ml::app::run({ .resizable = false }) == 0;
+	}
+}
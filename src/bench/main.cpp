@@ -0,0 +1,179 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <unordered_map>
+#include <format>
+
+#include "common.h"
+#include "bench.h"
+
+namespace cnc::bench
+{
+	struct bench_config
+	{
+		std::string out{ "bench_results.json" };
+		std::string baseline{ "src/bench/baseline.json" };
+		std::string filter{};
+		double tolerance{ 0.15 };	// Slower than the baseline by more than this is a regression
+		bool graphics{ true };
+		bool update{ false };		// Write the results over the baseline
+	};
+
+	static bench_config parse_arguments(std::span<char*> args)
+	{
+		bench_config config;
+
+		for (const std::string_view arg : args)
+		{
+			const auto pos = arg.find('=');
+			if (pos == std::string_view::npos)
+				continue;
+
+			const auto name = arg.substr(0, pos);
+			const std::string value{ arg.substr(pos + 1) };
+
+			if (name == "out")
+				config.out = value;
+			else if (name == "baseline")
+				config.baseline = value;
+			else if (name == "filter")
+				config.filter = value;
+			else if (name == "tolerance")
+				config.tolerance = std::atof(value.c_str());
+			else if (name == "graphics")
+				config.graphics = value != "0";
+			else if (name == "update")
+				config.update = value != "0";
+			else
+				std::printf("Unknown option \"%s\"\n", std::string(name).c_str());
+		}
+
+		return config;
+	}
+
+	// One result per line, so a baseline update reads as a diff of the benchmarks that moved
+	static std::string to_json(std::span<const result> results)
+	{
+		std::string json = "{\n\t\"unit\": \"ns/op\",\n\t\"results\": [\n";
+
+		for (std::size_t i = 0; i < results.size(); ++i)
+			json += std::format("\t\t{{ \"name\": \"{}\", \"ns_per_op\": {:.2f}, \"ops\": {} }}{}\n", results[i].name, results[i].ns_per_op, results[i].ops,
+				i + 1 < results.size() ? "," : "");
+
+		json += "\t]\n}\n";
+		return json;
+	}
+
+	// Reads back what to_json writes, nothing more general
+	static std::unordered_map<std::string, double> read_baseline(const std::string& path)
+	{
+		std::unordered_map<std::string, double> baseline;
+
+		std::ifstream is(path);
+		if (!is)
+			return baseline;
+
+		std::stringstream ss;
+		ss << is.rdbuf();
+		const std::string json = ss.str();
+
+		static const std::regex s_entry(R"re("name"\s*:\s*"([^"]+)"\s*,\s*"ns_per_op"\s*:\s*([-+0-9.eE]+))re");
+		for (auto it = std::sregex_iterator(json.begin(), json.end(), s_entry); it != std::sregex_iterator(); ++it)
+			baseline[(*it)[1].str()] = std::atof((*it)[2].str().c_str());
+
+		return baseline;
+	}
+
+	static bool write_file(const std::string& path, const std::string& contents)
+	{
+		std::ofstream os(path, std::ios::trunc);
+		os << contents;
+		return os.good();
+	}
+}
+
+/*
+	ConcordiaBench [out=bench_results.json] [baseline=src/bench/baseline.json] [tolerance=0.15]
+		[filter=] [graphics=1] [update=0]
+
+	Runs the hot paths of the server, the client and MediaLib, writes the results as JSON and
+	compares them with the checked-in baseline. Exits with 1 if anything got slower than the
+	tolerance allows, so a regression shows up before it's merged. Run it from the repository
+	root on the machine the baseline was taken on, and use update=1 to record a new baseline
+	when a change is meant to move the numbers. graphics=0 skips what needs a window.
+*/
+int main(int argc, char** argv)
+{
+	using namespace cnc;
+	using namespace cnc::bench;
+
+	const auto config = parse_arguments(std::span(argv + 1, argc - 1));
+
+	suite s(config.filter);
+
+	run_audio_benchmarks(s);
+	run_dsp_benchmarks(s);
+	run_vecmath_benchmarks(s);
+
+	if (config.graphics && !run_graphics_benchmarks(s))
+		std::printf("No window, graphics benchmarks skipped\n");
+
+	const auto& results = s.get_results();
+	const auto json = to_json(results);
+
+	if (!write_file(config.out, json))
+		std::printf("Can't write %s\n", config.out.c_str());
+
+	if (config.update)
+	{
+		if (!write_file(config.baseline, json))
+		{
+			std::printf("Can't write %s\n", config.baseline.c_str());
+			return 1;
+		}
+
+		std::printf("\nBaseline %s updated, %zu results\n", config.baseline.c_str(), results.size());
+		return 0;
+	}
+
+	const auto baseline = read_baseline(config.baseline);
+	if (baseline.empty())
+	{
+		std::printf("\nNo baseline at %s, nothing to compare with\n", config.baseline.c_str());
+		return 0;
+	}
+
+	std::size_t regressions = 0;
+
+	std::printf("\n%-40s %14s %14s %9s\n", "", "baseline", "now", "change");
+	for (const auto& r : results)
+	{
+		const auto it = baseline.find(r.name);
+		if (it == baseline.end())
+		{
+			std::printf("%-40s %14s %14.1f %9s\n", r.name.c_str(), "-", r.ns_per_op, "new");
+			continue;
+		}
+
+		const double change = r.ns_per_op / it->second - 1.0;
+		const bool regressed = change > config.tolerance;
+		regressions += regressed;
+
+		std::printf("%-40s %14.1f %14.1f %+8.1f%%%s\n", r.name.c_str(), it->second, r.ns_per_op, change * 100.0,
+			regressed ? "  REGRESSION" : change < -config.tolerance ? "  faster, update the baseline" : "");
+	}
+
+	if (regressions)
+	{
+		std::printf("\n%zu benchmarks more than %.0f%% slower than the baseline\n", regressions, config.tolerance * 100.0);
+		return 1;
+	}
+
+	return 0;
+}
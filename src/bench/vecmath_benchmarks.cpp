@@ -0,0 +1,35 @@
+#include <core/vecmath.h>
+
+#include "bench.h"
+
+namespace cnc::bench
+{
+	void run_vecmath_benchmarks(suite& s)
+	{
+		using namespace ml;
+
+		// Every translate, rotate and scale of the renderer's matrix stack. Rotations, so chaining
+		// them doesn't run off to infinity.
+		const mat4f a = get_rotation(vec3f{ 0.0f, 0.0f, 1.0f }, 0.3f);
+		const mat4f b = get_rotation(vec3f{ 0.6f, 0.0f, 0.8f }, 0.7f);
+
+		s.run("vecmath/mat4_mul", [&](const std::uint64_t n) {
+			mat4f m = a;
+			for (std::uint64_t i = 0; i < n; ++i)
+			{
+				m = m * b;
+				do_not_optimize(m);
+			}
+		});
+
+		// And every vertex goes through one of these
+		s.run("vecmath/mat4_vec4_mul", [&](const std::uint64_t n) {
+			vec4f v{ 1.0f, 2.0f, 3.0f, 1.0f };
+			for (std::uint64_t i = 0; i < n; ++i)
+			{
+				v = a * v;
+				do_not_optimize(v);
+			}
+		});
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <span>
 #include <utility>
+#include <cstring>
 
 #include <glad/glad.h>
 
@@ -9,9 +10,6 @@
 #include <core/application.h>
 #include <common.h>
 
-#include <miniaudio.h>
-#include <asio.hpp>
-
 #include "log.h"
 #include "assets.generated.h"
 
@@ -20,7 +18,6 @@
 namespace cnc
 {
 	using namespace ml;
-	using asio::ip::tcp;
 
 	namespace colors
 	{
@@ -34,151 +31,10 @@ namespace cnc
 	static constexpr auto s_projection = ortho<float>(0, s_window_size[0], 0, s_window_size[0]);
 
 
-	struct voice_chat_scene_impl 
-	{
-
-		
-		float input_volume{ 1.f }, output_volume{ 1.f };
-		float saved_input_volume{1.f}, saved_output_volume{1.f};
-
-		ma_device device{};
-		asio::io_context ctx{};
-		tcp::socket socket;
-
-		float bandwidth_in{ 0 };
-		float bandwidth_out{ 0 };
-
-		std::thread read_thread, stats_thread;
-
-		std::atomic_bool running{ true };
-
-		exclusive_resource<std::vector<sample_t>> incoming_audio;
-
-		history_buffer input_history;
-		history_buffer output_history;
-		
-		voice_chat_scene_impl() : socket(ctx) {};
-
-
-	};
-
-	static void data_callback(ma_device* device, void* raw_output, const void* raw_input, ma_uint32 frame_count)
-	{
-		static std::vector<sample_t> processed_input;
-
-		auto& impl = *(static_cast<voice_chat_scene_impl*>(device->pUserData));
-
-		std::span<const sample_t> input(static_cast<const sample_t*>(raw_input), frame_count * audio_channels);
-		std::span<sample_t> output(static_cast<sample_t*>(raw_output), frame_count * audio_channels);
-
-
-		impl.incoming_audio.use([&](auto& ia) {
-			if (ia.size() >= frame_count * audio_channels)
-			{
-				std::copy(ia.begin(), ia.begin() + frame_count * audio_channels, output.begin());
-				ia.erase(ia.begin(), ia.begin() + frame_count * audio_channels);
-			}
-		});
-
-		if (impl.socket.is_open())
-		{
-			processed_input.resize(input.size());
-			
-			std::ranges::transform(input, processed_input.begin(), [vol = impl.input_volume](const sample_t s) { return s * vol; });
-			std::ranges::copy(processed_input, std::back_inserter(impl.input_history));
-			
-			try { asio::write(impl.socket, asio::buffer(processed_input)); }
-			catch (std::exception& ex) { CNC_ERROR(ex.what()); impl.socket.close(); }
-		}
-
-	}
-
 	void voice_chat_scene::init()
 	{
-		// Audio device
-		ma_device_config config;
-
-		config = ma_device_config_init(ma_device_type_duplex);
-		config.sampleRate = audio_sample_rate;
-		config.capture.pDeviceID = NULL;
-		config.capture.format = ma_format_s16;
-		config.capture.channels = audio_channels;
-		config.capture.shareMode = ma_share_mode_shared;
-		config.playback.pDeviceID = NULL;
-		config.playback.format = ma_format_s16;
-		config.playback.channels = audio_channels;
-		config.pUserData = _impl;
-		config.dataCallback = data_callback;
-
-		if (ma_device_init(NULL, &config, &_impl->device) != MA_SUCCESS) 
-		{
-			throw std::runtime_error("Can't initialize audio device!");
-		}
-
-		ma_device_start(&_impl->device);     // The device is sleeping by default so you'll need to start it manually.
-
-
-		// Connection
-
-		_impl->read_thread = std::thread([this] {
-
-			buffer_t buffer;
-
-			auto& socket = _impl->socket;
-			auto& incoming_audio = _impl->incoming_audio;
-
-			while (_impl->running)
-			{
-				try {
-					
-					if (socket.is_open())
-					{
-						_state = connection_state::connected;
-						const auto bytes_read = asio::read(socket, asio::buffer(buffer));
-
-						std::ranges::for_each(buffer, [vol = _impl->output_volume](sample_t& s) { s *= vol; });
-						std::ranges::copy(buffer, std::back_inserter(_impl->output_history));
-
-						if (bytes_read > 0)
-						{
-							auto [lock, res] = incoming_audio.get();
-							std::ranges::copy(buffer, std::back_inserter(res));
-						}
-					}
-					else
-					{
-						_state = connection_state::disconnected;
-						asio::error_code error;
-						_impl->socket.connect(tcp::endpoint(asio::ip::address_v4::from_string(_config.host), _config.port), error);
-						if (error)
-						{
-							std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-						}
-					}
-
-				}
-				catch (std::exception& ex)
-				{
-					CNC_ERROR(ex.what());
-					socket.close();
-				}
-
-				std::this_thread::yield();
-			}
-
-			CNC_INFO("Network thread exiting");
-
-		});
-		
-		_impl->stats_thread = std::thread([&] {
-			while (_impl->running)
-			{
-				_impl->bandwidth_in = _impl->input_history.collect_inserted_bytes() / 1024.0f;
-				_impl->bandwidth_out = _impl->output_history.collect_inserted_bytes() / 1024.0f;
-				std::this_thread::sleep_for(std::chrono::seconds(1));
-			}
-			CNC_INFO("Stats thread exiting");
-		});
+		_session = std::make_unique<voice_session>(_config);
+		_session->start();
 
 		// Gfx
 		app::set_framebuffer_srgb(true);
@@ -209,7 +65,7 @@ namespace cnc
 
 		app::clear(vec4f{ 0.0f, 0.0f, 0.0f, 0.0f });
 
-		if (_state == connection_state::connected)
+		if (_session->state == connection_state::connected)
 		{
 
 			// Output Wave
@@ -222,16 +78,18 @@ namespace cnc
 				app::with([&] {
 					app::pivot({ 0, 0 });
 					app::translate({ 100, y_base + 16.0f, 0 });
-					app::draw_text(_font, std::format("{:.2f} Kb/s", _impl->bandwidth_out), 16.0f);
+					app::draw_text(_font, std::format("{:.2f} Kb/s", _session->bandwidth_out), 16.0f);
 					});
 
 
+				_session->output_history.snapshot().copy_out(_waveform);
+
 				app::begin(app::primitive_type::line_strip);
 				for (auto x : std::views::iota(0u, vs[0]))
 				{
 					static constexpr auto normalizer = static_cast<float>(std::numeric_limits<i16>::max());
-					const float age = x / float(vs[0]);
-					const float y = y_base + _impl->output_history.sample(age) / normalizer * s_window_size[1] * .25f;
+					const auto i = static_cast<std::size_t>(x / vs[0] * _waveform.size());
+					const float y = y_base + _waveform[i] / normalizer * s_window_size[1] * .25f;
 					app::vertex(vec2f{ x, y });
 				}
 				app::end();
@@ -249,15 +107,17 @@ namespace cnc
 				app::with([&] {
 					app::pivot({ 0, 0 });
 					app::translate({ 100, y_base + 16.0f, 0 });
-					app::draw_text(_font, std::format("{:.2f} Kb/s", _impl->bandwidth_in), 16.0f);
+					app::draw_text(_font, std::format("{:.2f} Kb/s", _session->bandwidth_in), 16.0f);
 					});
 
+				_session->input_history.snapshot().copy_out(_waveform);
+
 				app::begin(app::primitive_type::line_strip);
 				for (auto x : std::views::iota(0u, vs[0]))
 				{
 					static constexpr auto normalizer = static_cast<float>(std::numeric_limits<i16>::max());
-					const float age = x / float(vs[0]);
-					const float y = s_window_size[1] * .7f + _impl->input_history.sample(age) / normalizer * s_window_size[1] * .25f;
+					const auto i = static_cast<std::size_t>(x / vs[0] * _waveform.size());
+					const float y = s_window_size[1] * .7f + _waveform[i] / normalizer * s_window_size[1] * .25f;
 					app::vertex(vec2f{ x, y });
 				}
 				app::end();
@@ -271,16 +131,16 @@ namespace cnc
 
 
 				app::pivot({ 0, 0 });
-				app::color(_impl->input_volume == 0.0f ? vec3f{ .5f } : colors::red);
+				app::color(_session->input_volume == 0.0f ? vec3f{ .5f } : colors::red);
 
 				if (_ui.button(__LINE__, pos, _tx_microphone)) {
-					if (_impl->input_volume == 0.0f)
-						_impl->input_volume = _impl->saved_input_volume;
+					if (_session->input_volume == 0.0f)
+						_session->input_volume = _session->saved_input_volume;
 					else
-						_impl->saved_input_volume = std::exchange(_impl->input_volume, 0.0f);
+						_session->saved_input_volume = std::exchange(_session->input_volume, 0.0f);
 				}
 
-				_ui.slider(__LINE__, slider_pos, s_slider_size, { 0, 1 }, _impl->input_volume);
+				_ui.slider(__LINE__, slider_pos, s_slider_size, { 0, 1 }, _session->input_volume);
 
 				});
 
@@ -291,16 +151,16 @@ namespace cnc
 
 				app::pivot({ 0, 0 });
 
-				app::color(_impl->output_volume == 0.0f ? vec3f{ .5f } : colors::blue);
+				app::color(_session->output_volume == 0.0f ? vec3f{ .5f } : colors::blue);
 
 				if (_ui.button(__LINE__, button_pos, _tx_volume)) {
-					if (_impl->output_volume == 0.0f)
-						_impl->output_volume = _impl->saved_output_volume;
+					if (_session->output_volume == 0.0f)
+						_session->output_volume = _session->saved_output_volume;
 					else
-						_impl->saved_output_volume = std::exchange(_impl->output_volume, 0);
+						_session->saved_output_volume = std::exchange(_session->output_volume, 0);
 				}
 
-				_ui.slider(__LINE__, slider_pos, s_slider_size, { 0, 1 }, _impl->output_volume);
+				_ui.slider(__LINE__, slider_pos, s_slider_size, { 0, 1 }, _session->output_volume);
 
 				});
 
@@ -330,9 +190,6 @@ namespace cnc
 
 	void voice_chat_scene::on_attach()
 	{
-		_impl = new voice_chat_scene_impl();
-		_impl->input_volume = _config.input_volume;
-		_impl->output_volume = _config.output_volume;
 		app::set_window_size(s_window_size);
 		init();
 	}
@@ -408,12 +265,8 @@ namespace cnc
 
 	void voice_chat_scene::on_detach()
 	{
-		ma_device_uninit(&_impl->device);
-		_impl->running = false;
-		_impl->socket.close();
-		_impl->read_thread.join();
-		_impl->stats_thread.join();
-		delete _impl;
+		_session->stop();
+		_session = nullptr;
 	}
 
 }
\ No newline at end of file
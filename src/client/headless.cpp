@@ -0,0 +1,108 @@
+#include "headless.h"
+
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <thread>
+
+#include "log.h"
+
+namespace cnc
+{
+	// After the input file ends, for what's still on its way back from the server
+	static constexpr auto s_tail = std::chrono::seconds(2);
+
+	// Without a server the input file is held back forever, nothing else would end the run
+	static constexpr auto s_connect_timeout = std::chrono::seconds(10);
+
+	int run_headless(const voice_chat_config& config, const float seconds)
+	{
+		if (seconds <= 0.0f && config.input_file.empty())
+		{
+			std::printf("Headless mode needs an input file or a duration\n");
+			return 1;
+		}
+
+		voice_session session(config);
+
+		try
+		{
+			session.start();
+		}
+		catch (std::exception& ex)
+		{
+			std::printf("%s\n", ex.what());
+			return 1;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		const auto cpu_start = std::clock();
+		const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(seconds));
+		std::chrono::steady_clock::time_point input_end{};
+		auto last_connected = start;
+		bool unreachable = false;
+
+		while (true)
+		{
+			const auto now = std::chrono::steady_clock::now();
+
+			if (seconds > 0.0f && now >= deadline)
+				break;
+
+			if (session.state == connection_state::connected)
+			{
+				last_connected = now;
+			}
+			else if (now - last_connected >= s_connect_timeout)
+			{
+				unreachable = true;
+				break;
+			}
+
+			if (!config.input_file.empty() && session.input_finished)
+			{
+				if (input_end == std::chrono::steady_clock::time_point{})
+					input_end = now;
+				else if (now - input_end >= s_tail && seconds <= 0.0f)
+					break;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(audio_frame_duration_ms));
+		}
+
+		session.stop();
+
+		// The stats thread keeps the record, it's been joined by now
+		const auto playout = session.playout->get_stats();
+		const auto callback_worst_us = std::max(session.callback_time_record_us, session.callback_time_worst_us.load());
+		const auto callback_times = session.callback_time_us.snapshot();
+
+		// What the session logged goes out before the summary
+		log::flush();
+
+		const float wall_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		const float cpu_s = static_cast<float>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+		std::printf("%.1f s, %s\n", wall_s, unreachable ? "server unreachable" : session.state == connection_state::connected ? "connected" : "not connected");
+		std::printf("Frames: %llu sent, %llu received\n", static_cast<unsigned long long>(session.sent_frames.value()),
+			static_cast<unsigned long long>(session.received_frames.value()));
+		std::printf("Playout: %.0f ms queued (target %.0f ms, jitter %.1f ms), %u underruns, %zu frames concealed, %zu late, %zu samples dropped\n",
+			playout.depth_ms, playout.target_ms, playout.jitter_ms, playout.underruns, playout.concealed_frames, playout.late_frames, playout.overflow);
+		std::printf("Audio callback worst case: %u us, 99%% within %llu us\n", callback_worst_us, static_cast<unsigned long long>(callback_times.upper_bound_of(0.99)));
+		std::printf("CPU: %.2f s, %.1f%% of one core\n", cpu_s, wall_s > 0.0f ? cpu_s / wall_s * 100.0f : 0.0f);
+
+		// To line the files up with another client's: the latency is where this client's input
+		// shows up in the other's output, plus the difference between these
+		auto print_start = [](const char* name, const std::chrono::system_clock::rep t) {
+			const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::duration(t)).count();
+			std::printf("%s started at %lld ms since the epoch\n", name, static_cast<long long>(ms));
+		};
+
+		if (!config.input_file.empty())
+			print_start("Input", session.input_start_time);
+		if (!config.output_file.empty())
+			print_start("Output", session.output_start_time);
+
+		return unreachable ? 1 : 0;
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "session.h"
+
+namespace cnc
+{
+	/*
+		Runs a session without a window, for scripts and CI. Ends after the given time, or
+		when there is an input file, once it's been played and the playout tail had time to
+		come back. Gives up with an error after 10 s without a connection. Prints a summary
+		on the way out.
+	*/
+	int run_headless(const voice_chat_config& config, const float seconds);
+}
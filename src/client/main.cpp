@@ -2,14 +2,30 @@
 #include <fstream>
 #include <algorithm>
 #include <ranges>
+#include <optional>
+#include <span>
 
 #include <core/application.h>
 
 #include "common.h"
+#include "link_emulator.h"
+#include "fec.h"
+#include "realtime.h"
 #include "client.h"
+#include "headless.h"
 #include "log.h"
 
-int main() 
+/*
+	ConcordiaClient [name=value ...]
+
+	Reads its options from the "config" file, then from the command line, which wins.
+	With headless=1 there is no window: audio comes from input_file and goes to output_file
+	(WAVs, either one optional), and a steady clock stands in for the sound card unless
+	software_clock=0. Runs for duration_s seconds, or until the input file has been played.
+	With link options (see link_emulator.h) the connection goes through an emulated link.
+	trace_file records where every frame spent its time, see trace.h.
+*/
+int main(int argc, char** argv) 
 {
 	using namespace cnc;
 	namespace fs = std::filesystem;
@@ -19,6 +35,62 @@ int main()
 
 	std::string host = "127.0.0.1";
 	u32 port = 3000;
+	audio_format format = default_audio_format;
+	u32 fec_group_size = 0;
+	realtime::thread_config audio_thread, network_thread;
+	bool lock_memory = false;
+
+	bool headless = false;
+	std::optional<bool> software_clock;
+	std::string input_file, output_file, trace_file;
+	float duration_s = 0.0f;
+	link_profile link_up, link_down;
+
+	auto set_option = [&](std::string name, const std::string& value) {
+		std::ranges::transform(name, name.begin(), [](auto c) -> char { return std::tolower(c); });
+
+		if (name == "host")
+			host = value;
+		else if (name == "port")
+			port = std::atoi(value.c_str());
+		else if (name == "sample_rate")
+			format.sample_rate = std::atoi(value.c_str());
+		else if (name == "channels")
+			format.channels = std::atoi(value.c_str());
+		else if (name == "fec_group_size")
+			fec_group_size = std::min<u32>(std::atoi(value.c_str()), max_fec_group_size);
+		else if (name == "audio_cpu")
+			audio_thread.cpu = std::atoi(value.c_str());
+		else if (name == "audio_priority")
+			audio_thread.priority = std::atoi(value.c_str());
+		else if (name == "network_cpu")
+			network_thread.cpu = std::atoi(value.c_str());
+		else if (name == "network_priority")
+			network_thread.priority = std::atoi(value.c_str());
+		else if (name == "scheduling")
+		{
+			if (const auto policy = realtime::parse_scheduling(value))
+				audio_thread.policy = network_thread.policy = *policy;
+			else
+				CNC_ERROR("Unknown scheduling policy \"{}\"", value);
+		}
+		else if (name == "lock_memory")
+			lock_memory = value == "1" || value == "true";
+		else if (name == "headless")
+			headless = value == "1" || value == "true";
+		else if (name == "software_clock")
+			software_clock = value == "1" || value == "true";
+		else if (name == "input_file")
+			input_file = value;
+		else if (name == "output_file")
+			output_file = value;
+		else if (name == "trace_file")
+			trace_file = value;
+		else if (name == "duration_s")
+			duration_s = static_cast<float>(std::atof(value.c_str()));
+		else
+			parse_link_option(name, value, link_up, link_down);
+	};
 
 	if (fs::is_regular_file(s_config_file))
 	{
@@ -38,27 +110,52 @@ int main()
 			std::string value{ line.begin() + pos + 1, line.end() };
 
 			if (!name.empty())
-			{
-				//std::ranges::transform(name, name.begin(), [](auto c) -> char { return std::tolower(c); });
-				std::ranges::transform(name, name.begin(), [](auto c) -> char { return std::tolower(c); });
-
-				if (name == "host")
-					host = value;
-				else if (name == "port")
-					port = std::atoi(value.c_str());
+				set_option(std::move(name), value);
+		}
+	}
 
+	for (const std::string_view arg : std::span(argv + 1, argc - 1))
+	{
+		const auto pos = arg.find('=');
+		if (pos != std::string_view::npos && pos > 0)
+			set_option(std::string(arg.substr(0, pos)), std::string(arg.substr(pos + 1)));
+	}
 
-			}
-		}
+	CNC_INFO("Host: {}\nPort: {}", host, port);
 
-		CNC_INFO(std::format("Host: {}\nPort: {}", host, port));
+	// Lives as long as the session, which connects to it instead of the server
+	std::unique_ptr<link_emulator> link;
+	if (!link_up.is_transparent() || !link_down.is_transparent())
+	{
+		link = std::make_unique<link_emulator>(host, std::to_string(port), link_up, link_down);
+		host = "127.0.0.1";
+		port = link->get_port();
+	}
 
+	if (!format.is_supported())
+	{
+		CNC_ERROR("Unsupported audio format ({} Hz, {} channels), using default", format.sample_rate, format.channels);
+		format = default_audio_format;
 	}
 
-	ml::app::goto_scene(std::make_shared<cnc::voice_chat_scene>(voice_chat_config{
+	voice_chat_config config{
 		.host = std::move(host),
-		.port = port
-	}));
+		.port = port,
+		.format = format,
+		.fec_group_size = fec_group_size,
+		.audio_thread = audio_thread,
+		.network_thread = network_thread,
+		.lock_memory = lock_memory,
+		.software_clock = software_clock.value_or(headless),
+		.input_file = std::move(input_file),
+		.output_file = std::move(output_file),
+		.trace_file = std::move(trace_file)
+	};
+
+	if (headless)
+		return run_headless(config, duration_s);
+
+	ml::app::goto_scene(std::make_shared<cnc::voice_chat_scene>(std::move(config)));
 	return ml::app::run({ 
 		.transparent = true,
 		.decorated = false,
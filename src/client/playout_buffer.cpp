@@ -0,0 +1,319 @@
+#include "playout_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace cnc
+{
+	static sample_t to_sample(const float v)
+	{
+		return static_cast<sample_t>(std::clamp(v, static_cast<float>(std::numeric_limits<sample_t>::min()), static_cast<float>(std::numeric_limits<sample_t>::max())));
+	}
+
+	playout_buffer::playout_buffer(const audio_format& fmt) :
+		_format(fmt),
+		_ring(fmt.samples_per_frame() * 32),
+		_receive_concealer(fmt),
+		_push_buffer(fmt.samples_per_frame()),
+		_target_ms(static_cast<float>(audio_frame_duration_ms * 2)),
+		_stat_target_ms(static_cast<float>(audio_frame_duration_ms * 2)),
+		_playout_concealer(fmt)
+	{
+		const std::size_t channels = _format.channels;
+
+		_window_length = static_cast<std::size_t>(_format.sample_rate * s_window_ms / 1000.0f) & ~std::size_t{ 1 };
+		_hop = _window_length / 2;
+		_tolerance = _hop / 2;
+		_search_step = std::max<std::size_t>(1, _format.sample_rate / 16000);
+
+		// Frames arrive whole, and the stretching reads a window plus the search range ahead of
+		// what it has played. The device period is added once the reads show it.
+		_min_target = _format.frame_length() + _window_length + _tolerance;
+
+		// Periodic Hann, adds up to one at 50% overlap
+		_window.resize(_window_length);
+		for (std::size_t i = 0; i < _window_length; ++i)
+			_window[i] = 0.5f - 0.5f * std::cos(2.0f * 3.14159265f * i / _window_length);
+
+		_input.resize(_window_length * 4 * channels);
+		_pop_buffer.resize(_input.size());
+		_overlap.resize(_window_length * channels);
+		_output.resize(_hop * channels);
+	}
+
+	void playout_buffer::push(std::span<const sample_t> frame, const u32 sequence)
+	{
+		push(frame, sequence, clock_t::now());
+	}
+
+	void playout_buffer::push(std::span<const sample_t> frame, const u32 sequence, const clock_t::time_point arrival)
+	{
+		static constexpr float frame_ms = static_cast<float>(audio_frame_duration_ms);
+
+		// RFC 3550 style interarrival jitter
+		if (_has_arrival)
+		{
+			const float interval = std::chrono::duration<float, std::milli>(arrival - _last_arrival).count();
+			const float deviation = std::min(std::abs(interval - frame_ms), s_max_target_ms);
+			_jitter_ms += (deviation - _jitter_ms) / 16.0f;
+		}
+
+		_last_arrival = arrival;
+
+		_target_ms = std::clamp(frame_ms + s_jitter_multiplier * _jitter_ms, frame_ms, s_max_target_ms);
+		_stat_jitter_ms = _jitter_ms;
+
+		auto queue = [&](std::span<const sample_t> samples) {
+			// Whole frames only, to stay aligned on channels
+			if (_ring.free_space() >= samples.size())
+				_ring.push(samples);
+			else
+				_stat_overflow += samples.size();
+		};
+
+		const auto samples = std::span(_push_buffer).first(std::min(frame.size(), _push_buffer.size()));
+
+		// Signed, so frames that arrive after the ones behind them show up as negative
+		const i32 gap = static_cast<i32>(sequence - _expected_sequence);
+
+		// Its place has been played or concealed already, queueing it now would put it out of order
+		if (_has_arrival && gap < 0 && gap >= -static_cast<i32>(s_max_concealed_gap))
+		{
+			_stat_late++;
+			return;
+		}
+
+		if (_has_arrival && gap > 0 && gap <= static_cast<i32>(s_max_concealed_gap))
+		{
+			for (i32 i = 0; i < gap; ++i)
+			{
+				_receive_concealer.conceal(samples);
+				queue(samples);
+			}
+			_stat_concealed += gap * samples.size() / _format.channels;
+		}
+
+		_expected_sequence = sequence + 1;
+		_has_arrival = true;
+
+		std::ranges::copy(frame.first(samples.size()), samples.begin());
+		_receive_concealer.observe(samples);
+		queue(samples);
+	}
+
+	std::size_t playout_buffer::get_depth() const
+	{
+		// Concealed audio is made up on the spot and doesn't hold anything back from running dry,
+		// whatever arrived in between two concealments is left out with it
+		const std::size_t consumed = std::min<std::size_t>(_prev < 0 ? 0 : _prev + _hop, _input_length);
+		const std::size_t queued = _input_length - std::max(consumed, std::min(_concealed_end, _input_length));
+		return _ring.size() / _format.channels + queued + (_output_length - _output_pos) / _format.channels;
+	}
+
+	std::size_t playout_buffer::fill_input(const std::size_t required)
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t capacity = _input.size() / channels;
+
+		if (_input_length >= required)
+			return _input_length;
+
+		const std::size_t count = std::min({ required - _input_length, _ring.size() / channels, capacity - _input_length });
+		const auto popped = std::span(_pop_buffer).first(count * channels);
+		_ring.pop(popped);
+		_playout_concealer.observe(popped);
+
+		std::ranges::transform(popped, _input.begin() + _input_length * channels, [](const sample_t s) { return static_cast<float>(s); });
+		_input_length += count;
+
+		return _input_length;
+	}
+
+	std::size_t playout_buffer::find_best_segment(const std::size_t natural, const std::size_t nominal) const
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t lo = nominal > _tolerance ? nominal - _tolerance : 0;
+		const std::size_t hi = nominal + _tolerance;
+
+		std::size_t best = nominal;
+		float best_score = -std::numeric_limits<float>::infinity();
+
+		// Pick the candidate that best continues the natural continuation of the last segment
+		for (std::size_t c = lo; c <= hi; c += _search_step)
+		{
+			float correlation = 0.0f, energy = 0.0f;
+			for (std::size_t i = 0; i < _hop * channels; i += _search_step * channels)
+			{
+				for (std::size_t ch = 0; ch < channels; ++ch)
+				{
+					const float x = _input[c * channels + i + ch];
+					correlation += x * _input[natural * channels + i + ch];
+					energy += x * x;
+				}
+			}
+
+			const float score = correlation / std::sqrt(energy + 1.0f);
+			if (score > best_score)
+			{
+				best_score = score;
+				best = c;
+			}
+		}
+
+		return best;
+	}
+
+	bool playout_buffer::step()
+	{
+		const std::size_t channels = _format.channels;
+
+		// Drop what's not needed anymore
+		if (_prev > 0)
+		{
+			std::memmove(_input.data(), _input.data() + _prev * channels, (_input_length - _prev) * channels * sizeof(float));
+			_input_length -= _prev;
+			_nominal -= _prev;
+			_concealed_end -= std::min<std::size_t>(_concealed_end, _prev);
+			_prev = 0;
+		}
+
+		std::size_t natural = 0, nominal = 0, required = _window_length;
+		const double next_nominal = _prev < 0 ? 0.0 : _nominal + _hop * _ratio;
+
+		if (_prev >= 0)
+		{
+			natural = _prev + _hop;
+			nominal = static_cast<std::size_t>(std::max<long>(0, std::lround(next_nominal)));
+			required = std::max(natural + _window_length, nominal + _tolerance + _window_length);
+		}
+
+		if (fill_input(required) < required && _prev >= 0 && !_playout_concealer.is_exhausted())
+		{
+			// Ran dry: make up the missing audio, the depth control catches up once it arrives
+			if (!_playout_concealer.is_concealing())
+				_stat_underruns++;
+
+			const std::size_t missing = required - _input_length;
+			const auto concealed = std::span(_pop_buffer).first(missing * channels);
+			_playout_concealer.conceal(concealed);
+
+			std::ranges::transform(concealed, _input.begin() + _input_length * channels, [](const sample_t s) { return static_cast<float>(s); });
+			_input_length += missing;
+			_concealed_end = _input_length;
+			_stat_concealed += missing;
+		}
+
+		if (_input_length < required)
+		{
+			if (_prev < 0)
+				return false;
+
+			// Concealment faded out by now, let the last segment go too and start over
+
+			const std::size_t consumed = std::min(natural, _input_length);
+			std::memmove(_input.data(), _input.data() + consumed * channels, (_input_length - consumed) * channels * sizeof(float));
+			_input_length -= consumed;
+			_concealed_end -= std::min(_concealed_end, consumed);
+			_prev = -1;
+
+			std::ranges::transform(std::span(_overlap).first(_hop * channels), _output.begin(), to_sample);
+			std::ranges::fill(_overlap, 0.0f);
+			_output_pos = 0;
+			_output_length = _output.size();
+			return true;
+		}
+
+		// The nominal position moves at the stretch ratio and is never corrected, the search only
+		// picks the segment around it that lines up best. At normal speed the natural continuation
+		// is taken as is, which reconstructs the input exactly.
+		std::size_t chosen = nominal;
+		if (_prev >= 0)
+		{
+			const std::size_t distance = natural > nominal ? natural - nominal : nominal - natural;
+			chosen = _ratio == 1.0f && distance <= _tolerance ? natural : find_best_segment(natural, nominal);
+		}
+
+		_nominal = next_nominal;
+
+		for (std::size_t i = 0; i < _window_length; ++i)
+			for (std::size_t ch = 0; ch < channels; ++ch)
+				_overlap[i * channels + ch] += _window[i] * _input[(chosen + i) * channels + ch];
+
+		std::ranges::transform(std::span(_overlap).first(_hop * channels), _output.begin(), to_sample);
+		_output_pos = 0;
+		_output_length = _output.size();
+
+		std::memmove(_overlap.data(), _overlap.data() + _hop * channels, (_window_length - _hop) * channels * sizeof(float));
+		std::fill(_overlap.begin() + (_window_length - _hop) * channels, _overlap.end(), 0.0f);
+
+		_prev = static_cast<std::ptrdiff_t>(chosen);
+		return true;
+	}
+
+	void playout_buffer::reset()
+	{
+		_playing = false;
+		_ratio = 1.0f;
+		_output_pos = _output_length = 0;
+	}
+
+	void playout_buffer::read(std::span<sample_t> output)
+	{
+		_period = std::max(_period, output.size() / _format.channels);
+
+		const float depth = static_cast<float>(get_depth());
+		const float target = std::max(_target_ms * _format.sample_rate / 1000.0f, static_cast<float>(_min_target + _period));
+
+		if (!_playing && depth >= target)
+		{
+			_playing = true;
+			_depth_average = depth;
+		}
+
+		std::size_t written = 0;
+
+		if (_playing)
+		{
+			// Speed up when there's too much queued, slow down when there's too little
+			_depth_average += (depth - _depth_average) * 0.1f;
+			const float error = _depth_average - target;
+			_ratio = std::abs(error) < _hop ? 1.0f : 1.0f + std::clamp(0.5f * error / target, -s_max_expand, s_max_compress);
+
+			while (written < output.size())
+			{
+				if (_output_pos == _output_length && !step())
+				{
+					reset();
+					break;
+				}
+
+				const std::size_t n = std::min(output.size() - written, _output_length - _output_pos);
+				std::copy_n(_output.begin() + _output_pos, n, output.begin() + written);
+				_output_pos += n;
+				written += n;
+			}
+		}
+
+		std::fill(output.begin() + written, output.end(), sample_t{ 0 });
+
+		_stat_depth_ms = get_depth() * 1000.0f / _format.sample_rate;
+		_stat_ratio = _ratio;
+		_stat_target_ms = target * 1000.0f / _format.sample_rate;
+	}
+
+	playout_stats playout_buffer::get_stats() const
+	{
+		return {
+			.depth_ms = _stat_depth_ms,
+			.target_ms = _stat_target_ms,
+			.jitter_ms = _stat_jitter_ms,
+			.stretch_ratio = _stat_ratio,
+			.underruns = _stat_underruns,
+			.concealed_frames = _stat_concealed,
+			.late_frames = _stat_late,
+			.overflow = _stat_overflow
+		};
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <span>
+
+#include <common.h>
+#include <ring_buffer.h>
+
+#include "plc.h"
+
+namespace cnc
+{
+	struct playout_stats
+	{
+		float depth_ms;
+		float target_ms;
+		float jitter_ms;
+		float stretch_ratio;
+		u32 underruns;
+		std::size_t concealed_frames;
+		std::size_t late_frames;	// Arrived after their place was played, dropped
+		std::size_t overflow;
+	};
+
+	/*
+		Playout queue between the network thread (push) and the audio callback (read).
+		The target latency follows the measured arrival jitter, and the queue is brought
+		towards it by time-stretching the audio with WSOLA: the playback speed changes
+		slightly, the pitch doesn't. Audio that is missing, either because frames were lost
+		or because the queue ran dry, is concealed.
+	*/
+	class playout_buffer
+	{
+	public:
+		using clock_t = std::chrono::steady_clock;
+
+	private:
+		static constexpr float s_window_ms = 20.0f;
+		static constexpr float s_max_target_ms = 500.0f;
+		static constexpr float s_jitter_multiplier = 4.0f;
+		static constexpr float s_max_compress = 0.25f;
+		static constexpr float s_max_expand = 0.15f;
+		static constexpr u32 s_max_concealed_gap = 8; // In frames, longer gaps either way are treated as a new stream
+
+		audio_format _format;
+		spsc_ring_buffer<sample_t> _ring;
+
+		// Producer side
+		clock_t::time_point _last_arrival{};
+		bool _has_arrival{ false };
+		float _jitter_ms{ 0.0f };
+		u32 _expected_sequence{ 0 };
+		packet_loss_concealer _receive_concealer;
+		std::vector<sample_t> _push_buffer;
+
+		// Shared
+		std::atomic<float> _target_ms;
+		std::atomic<float> _stat_target_ms;
+		std::atomic<float> _stat_depth_ms{ 0.0f };
+		std::atomic<float> _stat_jitter_ms{ 0.0f };
+		std::atomic<float> _stat_ratio{ 1.0f };
+		std::atomic<u32> _stat_underruns{ 0 };
+		std::atomic<std::size_t> _stat_concealed{ 0 };
+		std::atomic<std::size_t> _stat_late{ 0 };
+		std::atomic<std::size_t> _stat_overflow{ 0 };
+
+		// Consumer side, all in frames (one sample per channel)
+		std::size_t _window_length, _hop, _tolerance, _search_step;
+		std::size_t _min_target; // Below this the queue runs dry between two arrivals, see read()
+		std::size_t _period{ 0 }; // Longest read so far
+		std::vector<float> _window;
+
+		packet_loss_concealer _playout_concealer;
+		std::vector<sample_t> _pop_buffer;
+		std::vector<float> _input;
+		std::size_t _input_length{ 0 };
+		std::ptrdiff_t _prev{ -1 }; // Start of the last segment in _input, -1 if there is none
+		std::size_t _concealed_end{ 0 }; // End of the concealed audio in _input, it's not counted as depth
+		double _nominal{ 0.0 }; // Where the last segment would have started without the alignment search
+
+		std::vector<float> _overlap;
+		std::vector<sample_t> _output;
+		std::size_t _output_pos{ 0 }, _output_length{ 0 };
+
+		bool _playing{ false };
+		float _depth_average{ 0.0f };
+		float _ratio{ 1.0f };
+
+		std::size_t get_depth() const;
+		std::size_t fill_input(const std::size_t required);
+		std::size_t find_best_segment(const std::size_t natural, const std::size_t nominal) const;
+		bool step();
+		void reset();
+
+	public:
+		explicit playout_buffer(const audio_format& fmt);
+
+		playout_buffer(const playout_buffer&) = delete;
+		playout_buffer& operator=(const playout_buffer&) = delete;
+
+		// Network thread. Queues a received frame and updates the jitter estimate.
+		// Gaps in the sequence numbers are filled with concealed audio. The arrival time is
+		// taken as now unless it's given, replays give it.
+		void push(std::span<const sample_t> frame, const u32 sequence);
+		void push(std::span<const sample_t> frame, const u32 sequence, const clock_t::time_point arrival);
+
+		// Audio thread. Always fills the whole output, with silence if there's nothing to play.
+		void read(std::span<sample_t> output);
+
+		// Any thread
+		playout_stats get_stats() const;
+	};
+}
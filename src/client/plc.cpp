@@ -0,0 +1,144 @@
+#include "plc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace cnc
+{
+	static std::size_t ms_to_frames(const audio_format& fmt, const float ms)
+	{
+		return std::max<std::size_t>(1, static_cast<std::size_t>(fmt.sample_rate * ms / 1000.0f));
+	}
+
+	packet_loss_concealer::packet_loss_concealer(const audio_format& fmt) :
+		_format(fmt),
+		_history_length(ms_to_frames(fmt, s_history_ms)),
+		_min_pitch(ms_to_frames(fmt, s_min_pitch_ms)),
+		_max_pitch(ms_to_frames(fmt, s_max_pitch_ms)),
+		_hold(ms_to_frames(fmt, s_hold_ms)),
+		_fade(ms_to_frames(fmt, s_fade_ms)),
+		_crossfade(ms_to_frames(fmt, s_crossfade_ms))
+	{
+		_history.resize(_history_length * fmt.channels);
+		_period.resize(_max_pitch * fmt.channels);
+		_crossfade_buffer.resize(_crossfade * fmt.channels);
+	}
+
+	std::size_t packet_loss_concealer::estimate_pitch() const
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t window = _max_pitch;
+		const std::size_t step = std::max<std::size_t>(1, _format.sample_rate / 8000);
+		const std::size_t end = _history_length;
+
+		auto mono = [&](const std::size_t frame) {
+			float acc = 0.0f;
+			for (std::size_t c = 0; c < channels; ++c)
+				acc += _history[frame * channels + c];
+			return acc;
+		};
+
+		// Normalized autocorrelation of the most recent window against older audio
+		std::size_t best = _max_pitch;
+		float best_score = 0.0f;
+
+		for (std::size_t lag = _min_pitch; lag <= _max_pitch; lag += step)
+		{
+			float correlation = 0.0f, energy0 = 0.0f, energy1 = 0.0f;
+			for (std::size_t i = end - window; i < end; i += step)
+			{
+				const float a = mono(i), b = mono(i - lag);
+				correlation += a * b;
+				energy0 += a * a;
+				energy1 += b * b;
+			}
+
+			const float score = correlation / std::sqrt(energy0 * energy1 + 1.0f);
+			if (score > best_score)
+			{
+				best_score = score;
+				best = lag;
+			}
+		}
+
+		return best;
+	}
+
+	void packet_loss_concealer::start()
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t end = _history_length;
+
+		_pitch = estimate_pitch();
+		_position = 0;
+
+		// The last period, with its tail blended into what preceded it so the loop has no seam
+		const std::size_t overlap = _pitch / 4;
+		std::copy_n(_history.begin() + (end - _pitch) * channels, _pitch * channels, _period.begin());
+
+		for (std::size_t i = 0; i < overlap; ++i)
+		{
+			const float t = static_cast<float>(i + 1) / (overlap + 1);
+			const std::size_t dst = _pitch - overlap + i;
+			const std::size_t src = end - _pitch - overlap + i;
+			for (std::size_t c = 0; c < channels; ++c)
+				_period[dst * channels + c] = _period[dst * channels + c] * (1.0f - t) + _history[src * channels + c] * t;
+		}
+	}
+
+	void packet_loss_concealer::conceal(std::span<sample_t> output)
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t frames = output.size() / channels;
+
+		if (_concealed == 0)
+			start();
+
+		for (std::size_t i = 0; i < frames; ++i, ++_concealed)
+		{
+			const float gain = _concealed < _hold ? 1.0f : std::max(0.0f, 1.0f - static_cast<float>(_concealed - _hold) / _fade);
+
+			for (std::size_t c = 0; c < channels; ++c)
+				output[i * channels + c] = static_cast<sample_t>(_period[_position * channels + c] * gain);
+
+			_position = (_position + 1) % _pitch;
+		}
+	}
+
+	void packet_loss_concealer::observe(std::span<sample_t> samples)
+	{
+		const std::size_t channels = _format.channels;
+		const std::size_t frames = samples.size() / channels;
+
+		if (_concealed > 0)
+		{
+			const std::size_t n = std::min(_crossfade, frames);
+			const auto synthetic = std::span(_crossfade_buffer).first(n * channels);
+			conceal(synthetic);
+
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				const float t = static_cast<float>(i + 1) / (n + 1);
+				for (std::size_t c = 0; c < channels; ++c)
+				{
+					auto& s = samples[i * channels + c];
+					s = static_cast<sample_t>(synthetic[i * channels + c] * (1.0f - t) + s * t);
+				}
+			}
+
+			_concealed = 0;
+		}
+
+		// Keep the most recent audio only
+		if (frames >= _history_length)
+		{
+			std::ranges::transform(samples.last(_history_length * channels), _history.begin(), [](const sample_t s) { return static_cast<float>(s); });
+		}
+		else
+		{
+			std::shift_left(_history.begin(), _history.end(), frames * channels);
+			std::ranges::transform(samples, _history.end() - frames * channels, [](const sample_t s) { return static_cast<float>(s); });
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <span>
+
+#include <common.h>
+
+namespace cnc
+{
+	/*
+		Packet loss concealment by pitch period repetition, in the spirit of G.711 Appendix I.
+		Missing audio is replaced by the last pitch period of what was heard, looped and faded
+		out over a few tens of milliseconds. When real audio comes back it is crossfaded in.
+		Not thread safe, every stream needs its own instance.
+	*/
+	class packet_loss_concealer
+	{
+	private:
+		static constexpr float s_history_ms = 48.0f;
+		static constexpr float s_min_pitch_ms = 2.5f;
+		static constexpr float s_max_pitch_ms = 16.0f;
+		static constexpr float s_hold_ms = 10.0f;
+		static constexpr float s_fade_ms = 50.0f;
+		static constexpr float s_crossfade_ms = 4.0f;
+
+		audio_format _format;
+
+		// All in frames (one sample per channel)
+		std::size_t _history_length, _min_pitch, _max_pitch, _hold, _fade, _crossfade;
+
+		std::vector<float> _history; // Interleaved, oldest first
+		std::vector<float> _period;  // Interleaved, the loop being played
+		std::vector<sample_t> _crossfade_buffer;
+
+		std::size_t _pitch{ 0 };
+		std::size_t _position{ 0 };
+		std::size_t _concealed{ 0 };
+
+		std::size_t estimate_pitch() const;
+		void start();
+
+	public:
+		explicit packet_loss_concealer(const audio_format& fmt);
+
+		// Real audio, in order. The beginning is smoothed if it follows concealed audio.
+		void observe(std::span<sample_t> samples);
+
+		// Synthesizes a continuation of the audio observed so far, fading to silence
+		void conceal(std::span<sample_t> output);
+
+		bool is_concealing() const { return _concealed > 0; }
+
+		// Past this point conceal() only produces silence
+		bool is_exhausted() const { return _concealed >= _hold + _fade; }
+	};
+}
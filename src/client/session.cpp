@@ -0,0 +1,488 @@
+#include "session.h"
+
+#include <span>
+#include <utility>
+#include <cstring>
+#include <format>
+
+#include <protocol.h>
+#include <fec.h>
+#include <resampler.h>
+#include <dsp.h>
+
+#include "log.h"
+#include "trace.h"
+
+#undef max
+
+namespace cnc
+{
+	using asio::ip::tcp;
+
+	// Seconds of output the file thread may fall behind
+	static constexpr std::size_t s_recorded_seconds = 4;
+
+	static void process_audio(voice_session& session, std::span<const sample_t> input, std::span<sample_t> output)
+	{
+		const trace::scope trace_scope("audio_callback", session.audio_callbacks++);
+		const auto start_time = std::chrono::steady_clock::now();
+		const std::size_t frame_count = output.size() / session.format.channels;
+		const std::size_t channels = session.format.channels;
+
+		if (!session.audio_thread_configured)
+		{
+			trace::set_thread_name("Audio");
+			const auto report = realtime::configure_current_thread("Audio", session.audio_thread);
+			CNC_INFO("{}", report);
+			realtime::prefault_stack();
+			session.audio_thread_configured = true;
+			session.output_start_time = std::chrono::system_clock::now().time_since_epoch().count();
+		}
+
+		if (!session.config.input_file.empty())
+		{
+			// Held back until the server listens, so a run always sends the whole file
+			const auto position = std::min(session.input_position, session.input_samples.size());
+			const auto count = session.streaming ? std::min(input.size(), session.input_samples.size() - position) : 0;
+			input = std::span<const sample_t>(session.input_samples).subspan(position, count);
+
+			if (position == 0 && count > 0)
+				session.input_start_time = std::chrono::system_clock::now().time_since_epoch().count();
+
+			if (session.streaming)
+				session.input_position += frame_count * channels;
+			if (session.input_position >= session.input_samples.size())
+				session.input_finished = true;
+		}
+
+		session.playout->read(output);
+
+		if (trace::is_enabled())
+			trace::counter("playout_depth_us", static_cast<std::uint64_t>(session.playout->get_stats().depth_ms * 1000.0f));
+
+		if (session.recorded_audio)
+		{
+			const auto pushed = session.recorded_audio->push(output);
+			session.recorded_overflow.fetch_add(output.size() - pushed, std::memory_order_relaxed);
+		}
+
+		if (session.streaming && session.socket.is_open())
+		{
+			for (std::size_t offset = 0; offset < input.size(); offset += session.processed_input.size())
+			{
+				const auto chunk = input.subspan(offset, std::min(input.size() - offset, session.processed_input.size()));
+				const auto processed = std::span(session.processed_input).first(chunk.size());
+
+				dsp::apply_gain(chunk, session.input_volume, processed);
+				session.input_history.push(processed);
+				session.input_bytes.add(processed.size_bytes());
+
+				const auto pushed = session.outgoing_audio->push(processed);
+				session.outgoing_overflow.fetch_add(processed.size() - pushed, std::memory_order_relaxed);
+			}
+
+			// What the file didn't cover is silence
+			if (input.size() < output.size())
+			{
+				std::ranges::fill(session.processed_input, sample_t{ 0 });
+				for (std::size_t remaining = output.size() - input.size(); remaining > 0;)
+				{
+					const auto silence = std::span<const sample_t>(session.processed_input).first(std::min(remaining, session.processed_input.size()));
+					const auto pushed = session.outgoing_audio->push(silence);
+					session.outgoing_overflow.fetch_add(silence.size() - pushed, std::memory_order_relaxed);
+					remaining -= silence.size();
+				}
+			}
+
+			// Wake up the send thread (doesn't block)
+			session.outgoing_signal.fetch_add(1, std::memory_order_release);
+			session.outgoing_signal.notify_one();
+		}
+
+		const auto elapsed = static_cast<u32>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count());
+		session.callback_time_us.record(elapsed);
+		auto worst = session.callback_time_worst_us.load(std::memory_order_relaxed);
+		while (elapsed > worst && !session.callback_time_worst_us.compare_exchange_weak(worst, elapsed, std::memory_order_relaxed));
+	}
+
+	static void data_callback(ma_device* device, void* raw_output, const void* raw_input, ma_uint32 frame_count)
+	{
+		auto& session = *(static_cast<voice_session*>(device->pUserData));
+		const std::size_t channels = session.format.channels;
+
+		process_audio(session, std::span(static_cast<const sample_t*>(raw_input), frame_count * channels), std::span(static_cast<sample_t*>(raw_output), frame_count * channels));
+	}
+
+	voice_session::voice_session(voice_chat_config cfg) :
+		config(std::move(cfg)),
+		socket(ctx)
+	{
+		input_volume = config.input_volume;
+		output_volume = config.output_volume;
+	}
+
+	voice_session::~voice_session()
+	{
+		stop();
+	}
+
+	void voice_session::start()
+	{
+		if (!config.trace_file.empty())
+			trace::enable("Client");
+
+		format = config.format;
+		processed_input.resize(format.samples_per_frame());
+		playout = std::make_unique<playout_buffer>(format);
+		outgoing_audio = std::make_unique<spsc_ring_buffer<sample_t>>(format.samples_per_frame() * 8);
+		audio_thread = config.audio_thread;
+
+		if (!config.input_file.empty())
+		{
+			// Converted to our format by miniaudio, whatever the file has
+			ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_s16, format.channels, format.sample_rate);
+			ma_uint64 frames = 0;
+			void* pcm = nullptr;
+
+			if (ma_decode_file(config.input_file.c_str(), &decoder_config, &frames, &pcm) != MA_SUCCESS)
+				throw std::runtime_error(std::format("Can't read {}", config.input_file));
+
+			input_samples.assign(static_cast<const sample_t*>(pcm), static_cast<const sample_t*>(pcm) + frames * format.channels);
+			ma_free(pcm, nullptr);
+		}
+
+		if (!config.output_file.empty())
+		{
+			const ma_encoder_config encoder_config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, format.channels, format.sample_rate);
+			if (ma_encoder_init_file(config.output_file.c_str(), &encoder_config, &encoder) != MA_SUCCESS)
+				throw std::runtime_error(std::format("Can't create {}", config.output_file));
+
+			has_encoder = true;
+			recorded_audio = std::make_unique<spsc_ring_buffer<sample_t>>(format.sample_rate * format.channels * s_recorded_seconds);
+		}
+
+		// After the audio buffers are allocated, so they're faulted in and locked right away
+		if (config.lock_memory)
+		{
+			const auto report = realtime::lock_memory();
+			CNC_INFO("{}", report);
+		}
+
+		CNC_INFO("Sample loops: {}", dsp::to_string(dsp::get_isa()));
+
+		if (config.software_clock)
+		{
+			clock_running = true;
+			clock_thread = std::thread([this] { clock_loop(); });
+		}
+		else
+		{
+			ma_device_config device_config = ma_device_config_init(ma_device_type_duplex);
+			device_config.sampleRate = format.sample_rate;
+			device_config.periodSizeInFrames = static_cast<ma_uint32>(format.frame_length());
+			device_config.capture.pDeviceID = NULL;
+			device_config.capture.format = ma_format_s16;
+			device_config.capture.channels = format.channels;
+			device_config.capture.shareMode = ma_share_mode_shared;
+			device_config.playback.pDeviceID = NULL;
+			device_config.playback.format = ma_format_s16;
+			device_config.playback.channels = format.channels;
+			device_config.pUserData = this;
+			device_config.dataCallback = data_callback;
+
+			if (ma_device_init(NULL, &device_config, &device) != MA_SUCCESS)
+			{
+				throw std::runtime_error("Can't initialize audio device!");
+			}
+
+			ma_device_start(&device);     // The device is sleeping by default so you'll need to start it manually.
+		}
+
+		_started = true;
+
+		read_thread = std::thread([this] { read_loop(); });
+		send_thread = std::thread([this] { send_loop(); });
+		stats_thread = std::thread([this] { stats_loop(); });
+
+		if (has_encoder)
+			file_thread = std::thread([this] { file_loop(); });
+	}
+
+	void voice_session::stop()
+	{
+		if (_started)
+		{
+			// The audio goes first, so the output file gets everything it played
+			if (config.software_clock)
+			{
+				clock_running = false;
+				clock_thread.join();
+			}
+			else
+			{
+				ma_device_uninit(&device);
+			}
+
+			running = false;
+			outgoing_signal.fetch_add(1);
+			outgoing_signal.notify_one();
+
+			// Closing alone doesn't wake up a blocking read everywhere, shutting down does
+			asio::error_code ignored;
+			socket.shutdown(tcp::socket::shutdown_both, ignored);
+			socket.close(ignored);
+			read_thread.join();
+			send_thread.join();
+			stats_thread.join();
+			_started = false;
+		}
+
+		// After the device, so everything it played gets written
+		if (file_thread.joinable())
+			file_thread.join();
+
+		if (has_encoder)
+		{
+			ma_encoder_uninit(&encoder);
+			has_encoder = false;
+		}
+
+		if (!config.trace_file.empty() && trace::is_enabled())
+		{
+			if (trace::write(config.trace_file))
+				CNC_INFO("Trace written to {}", config.trace_file);
+			else
+				CNC_ERROR("Can't write the trace to {}", config.trace_file);
+		}
+	}
+
+	void voice_session::clock_loop()
+	{
+		// What a device would hand over: silence in, somewhere to play to
+		std::vector<sample_t> input(format.samples_per_frame()), output(format.samples_per_frame());
+		auto next_period = std::chrono::steady_clock::now();
+
+		while (clock_running)
+		{
+			process_audio(*this, input, output);
+
+			next_period += std::chrono::milliseconds(audio_frame_duration_ms);
+			std::this_thread::sleep_until(next_period);
+		}
+	}
+
+	void voice_session::read_loop()
+	{
+		trace::set_thread_name("Network receive");
+		const auto report = realtime::configure_current_thread("Network receive", config.network_thread);
+		CNC_INFO("{}", report);
+
+		const auto fmt = format;
+
+		std::vector<sample_t> buffer(fmt.samples_per_frame());
+		std::vector<sample_t> received(fmt.samples_per_frame());
+		protocol::frame_header header;
+		fec_decoder decoder(config.fec_group_size, fmt.bytes_per_frame());
+
+		// The server may send at a lower sample rate when the link is congested
+		std::vector<float> reduced(fmt.frame_length()), upsampled(fmt.frame_length());
+		resampler upsampler;
+
+		auto deliver = [&](const u32 sequence, std::span<const std::byte> payload) {
+			const std::size_t frame_length = payload.size() / (fmt.channels * sizeof(sample_t));
+			const std::span<const sample_t> samples(reinterpret_cast<const sample_t*>(payload.data()), frame_length * fmt.channels);
+
+			if (frame_length == fmt.frame_length())
+			{
+				std::ranges::copy(samples, received.begin());
+			}
+			else
+			{
+				const auto rate = static_cast<u32>(frame_length * 1000 / audio_frame_duration_ms);
+				if (upsampler.get_from_rate() != rate)
+					upsampler = resampler(rate, fmt.sample_rate);
+
+				const auto input = std::span(reduced).first(frame_length);
+				downmix_to_float(samples, fmt.channels, input);
+				upsampler.process(input, upsampled);
+				upmix_from_float(upsampled, fmt.channels, received);
+			}
+
+			dsp::apply_gain(received, output_volume, received);
+			output_history.push(received);
+			output_bytes.add(received.size() * sizeof(sample_t));
+			playout->push(received, sequence);
+			trace::instant("playout_push", sequence);
+			received_frames.add();
+		};
+
+		while (running)
+		{
+			try {
+
+				if (socket.is_open())
+				{
+					state = connection_state::connected;
+					asio::read(socket, asio::buffer(&header, sizeof(header)));
+
+					if (!header.is_valid() || header.channels != fmt.channels || header.sample_rate > fmt.sample_rate)
+						throw std::runtime_error("Unexpected frame format");
+
+					const auto payload = std::as_bytes(std::span(buffer)).first(header.payload_size_in_bytes());
+					asio::read(socket, asio::buffer(buffer.data(), payload.size()));
+					trace::instant(header.kind == protocol::packet_kind::parity ? "receive_parity" : "receive", header.sequence);
+
+					if (header.kind == protocol::packet_kind::parity)
+						decoder.on_parity(header.sequence, payload, deliver);
+					else
+						decoder.on_frame(header.sequence, payload, deliver);
+				}
+				else
+				{
+					state = connection_state::disconnected;
+					asio::error_code error;
+					socket.connect(tcp::endpoint(asio::ip::address_v4::from_string(config.host), config.port), error);
+					if (error)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+					}
+					else
+					{
+						const protocol::hello hello{
+							.sample_rate = format.sample_rate,
+							.channels = format.channels,
+							.fec_group_size = config.fec_group_size
+						};
+						asio::write(socket, asio::buffer(&hello, sizeof(hello)));
+						decoder = fec_decoder(config.fec_group_size, fmt.bytes_per_frame());
+						streaming = true;
+					}
+				}
+
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("{}", ex.what());
+				streaming = false;
+				socket.close();
+			}
+
+			std::this_thread::yield();
+		}
+
+		CNC_INFO("Network thread exiting");
+	}
+
+	void voice_session::send_loop()
+	{
+		trace::set_thread_name("Network send");
+		const auto report = realtime::configure_current_thread("Network send", config.network_thread);
+		CNC_INFO("{}", report);
+
+		const auto fmt = format;
+		std::vector<u8> frame(sizeof(protocol::frame_header) + fmt.bytes_per_frame());
+		std::vector<u8> parity_frame(frame.size());
+		std::span<sample_t> payload(reinterpret_cast<sample_t*>(frame.data() + sizeof(protocol::frame_header)), fmt.samples_per_frame());
+		fec_encoder encoder(config.fec_group_size, fmt.bytes_per_frame());
+		u32 sequence = 0;
+
+		auto& outgoing = *outgoing_audio;
+
+		while (running)
+		{
+			if (outgoing.size() < payload.size())
+			{
+				const auto signal = outgoing_signal.load(std::memory_order_acquire);
+				if (outgoing.size() < payload.size())
+					outgoing_signal.wait(signal, std::memory_order_acquire);
+				continue;
+			}
+
+			outgoing.pop(payload);
+
+			// Whatever was captured before the handshake is just dropped
+			if (!streaming)
+				continue;
+
+			const auto header = protocol::make_frame_header(sequence, fmt);
+			std::memcpy(frame.data(), &header, sizeof(header));
+
+			try
+			{
+				const trace::scope trace_scope("send", sequence);
+				asio::write(socket, asio::buffer(frame));
+
+				if (encoder.add(sequence, std::as_bytes(payload)))
+				{
+					const auto parity_header = protocol::make_frame_header(encoder.get_group_start(), fmt, protocol::packet_kind::parity);
+					std::memcpy(parity_frame.data(), &parity_header, sizeof(parity_header));
+					std::memcpy(parity_frame.data() + sizeof(parity_header), encoder.get_parity().data(), encoder.get_parity().size());
+					asio::write(socket, asio::buffer(parity_frame));
+				}
+
+				sequence++;
+				sent_frames.add();
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("{}", ex.what());
+				streaming = false;
+				socket.close();
+			}
+		}
+
+		CNC_INFO("Send thread exiting");
+	}
+
+	void voice_session::stats_loop()
+	{
+		while (running)
+		{
+			const auto in = input_bytes.value(), out = output_bytes.value();
+			bandwidth_in = (in - std::exchange(last_input_bytes, in)) / 1024.0f;
+			bandwidth_out = (out - std::exchange(last_output_bytes, out)) / 1024.0f;
+
+			const auto callback_time = callback_time_worst_us.exchange(0);
+			if (callback_time > callback_time_record_us)
+			{
+				callback_time_record_us = callback_time;
+				CNC_INFO("Audio callback worst case: {} us", callback_time);
+			}
+
+			const auto stats = playout->get_stats();
+			if (stats.underruns != playout_underruns || stats.stretch_ratio != 1.0f)
+			{
+				playout_underruns = stats.underruns;
+				CNC_INFO("Playout: {:.0f} ms queued (target {:.0f} ms, jitter {:.1f} ms), stretch {:.2f}, {} underruns, {} frames concealed, {} late, {} samples dropped",
+					stats.depth_ms, stats.target_ms, stats.jitter_ms, stats.stretch_ratio, stats.underruns, stats.concealed_frames, stats.late_frames, stats.overflow);
+			}
+
+			if (const auto dropped = outgoing_overflow.exchange(0); dropped > 0)
+				CNC_INFO("Send queue full, dropped {} samples", dropped);
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+		CNC_INFO("Stats thread exiting");
+	}
+
+	void voice_session::file_loop()
+	{
+		std::vector<sample_t> chunk(format.samples_per_frame() * 8);
+
+		while (true)
+		{
+			// Read before draining, so everything played before stop() gets written
+			const bool was_running = running;
+
+			while (const auto n = recorded_audio->pop(chunk))
+				ma_encoder_write_pcm_frames(&encoder, chunk.data(), n / format.channels, nullptr);
+
+			if (!was_running)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(audio_frame_duration_ms * 4));
+		}
+
+		if (const auto dropped = recorded_overflow.load(); dropped > 0)
+			CNC_ERROR("Output file fell behind, {} samples missing", dropped);
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+#include <common.h>
+#include <ring_buffer.h>
+#include <realtime.h>
+#include <metrics.h>
+
+#include <miniaudio.h>
+#include <asio.hpp>
+
+#include "playout_buffer.h"
+
+namespace cnc
+{
+	struct voice_chat_config
+	{
+		std::string host;
+		u32 port;
+		audio_format format{ default_audio_format };
+		u32 fec_group_size{ 0 };
+		float input_volume{ 1.0f };
+		float output_volume{ 1.0f };
+		realtime::thread_config audio_thread{};
+		realtime::thread_config network_thread{};
+		bool lock_memory{ false };
+
+		// Without a sound card: a thread runs the audio callback every frame off the steady clock
+		bool software_clock{ false };
+
+		// Replaces the microphone, silence once it's over
+		std::string input_file{};
+
+		// Everything played out, from the first callback on
+		std::string output_file{};
+
+		// Chrome/Perfetto JSON of every frame's way through the client, written on stop
+		std::string trace_file{};
+	};
+
+	enum class connection_state
+	{
+		disconnected, connected
+	};
+
+	/*
+		Everything the client does except drawing: the audio device, the connection and the
+		threads in between. The UI reads the volumes, the histories and the state directly.
+	*/
+	struct voice_session
+	{
+		voice_chat_config config;
+
+		audio_format format{};
+
+		float input_volume{ 1.f }, output_volume{ 1.f };
+		float saved_input_volume{1.f}, saved_output_volume{1.f};
+
+		std::atomic<connection_state> state{ connection_state::disconnected };
+
+		ma_device device{};
+		std::thread clock_thread;
+		std::atomic_bool clock_running{ false };
+		asio::io_context ctx{};
+		asio::ip::tcp::socket socket;
+
+		float bandwidth_in{ 0 };
+		float bandwidth_out{ 0 };
+
+		std::thread read_thread, send_thread, stats_thread, file_thread;
+
+		std::atomic_bool running{ true };
+		std::atomic_bool streaming{ false }; // Set once the server got our hello
+
+		// Written by the network thread, read by the audio callback
+		std::unique_ptr<playout_buffer> playout;
+		u32 playout_underruns{ 0 };
+
+		// Worst audio callback duration since the stats thread last looked at it
+		std::atomic<u32> callback_time_worst_us{ 0 };
+		u32 callback_time_record_us{ 0 };
+		metrics::histogram callback_time_us{ metrics::latency_bounds_us };
+
+		// Audio through the callback and out of the network thread, the stats thread turns
+		// them into the bandwidth figures
+		metrics::counter input_bytes, output_bytes;
+		metrics::u64 last_input_bytes{ 0 }, last_output_bytes{ 0 };
+
+		// Counts the callbacks, for the traces
+		std::uint64_t audio_callbacks{ 0 };
+
+		// Scratch space for the callback, so it never allocates
+		std::vector<sample_t> processed_input;
+
+		// The device creates its own thread, it's set up from the first callback
+		realtime::thread_config audio_thread{};
+		bool audio_thread_configured{ false };
+
+		// Written by the audio callback, read by the send thread
+		std::unique_ptr<spsc_ring_buffer<sample_t>> outgoing_audio;
+		std::atomic<std::size_t> outgoing_overflow{ 0 };
+		std::atomic<u32> outgoing_signal{ 0 };
+
+		shared_history input_history;		// Written by the audio callback, read by the UI
+		shared_history output_history;		// Written by the network receive thread
+
+		// File input is decoded up front, the callback only copies from it
+		std::vector<sample_t> input_samples;
+		std::size_t input_position{ 0 };
+		std::atomic_bool input_finished{ false };
+
+		// File output goes through a queue, the callback never touches the disk
+		std::unique_ptr<spsc_ring_buffer<sample_t>> recorded_audio;
+		std::atomic<std::size_t> recorded_overflow{ 0 };
+		ma_encoder encoder{};
+		bool has_encoder{ false };
+
+		// For the headless summary
+		metrics::counter sent_frames, received_frames;
+		// When sample 0 of each file was played, to line up the files of different clients
+		std::atomic<std::chrono::system_clock::rep> input_start_time{ 0 };
+		std::atomic<std::chrono::system_clock::rep> output_start_time{ 0 };
+
+		explicit voice_session(voice_chat_config cfg);
+		~voice_session();
+
+		voice_session(const voice_session&) = delete;
+		voice_session& operator=(const voice_session&) = delete;
+
+		// Opens the device and connects, throws if there's no device or the input file can't be read
+		void start();
+		void stop();
+
+	private:
+		bool _started{ false };
+
+		void clock_loop();
+		void read_loop();
+		void send_loop();
+		void stats_loop();
+		void file_loop();
+	};
+}
@@ -3,11 +3,16 @@
 #include <cinttypes>
 #include <cstdlib>
 #include <array>
+#include <span>
+#include <bit>
+#include <cstring>
 #include <mutex>
+#include <atomic>
 #include <ranges>
 #include <utility>
 #include <algorithm>
 #include <tuple>
+#include <stdexcept>
 
 namespace cnc
 {
@@ -22,6 +27,9 @@ namespace cnc
 
 	using sample_t = i16;
 
+	// Used to keep data written by different threads apart
+	constexpr std::size_t cache_line_size = 64;
+
 	constexpr std::size_t audio_sample_rate = 16000;
 	constexpr std::size_t audio_channels = 1;
 	constexpr std::size_t buffer_size = 512 * audio_channels;
@@ -29,6 +37,33 @@ namespace cnc
 	constexpr std::size_t max_queue_size_in_bytes = buffer_size * 5 * sizeof(sample_t);
 	using buffer_t = std::array<std::int16_t, buffer_size>;
 
+	// Every frame on the wire covers the same amount of time, whatever the format
+	constexpr std::size_t audio_frame_duration_ms = buffer_size * 1000 / audio_sample_rate / audio_channels;
+	constexpr std::array<u32, 5> supported_sample_rates = { 8000, 16000, 24000, 32000, 48000 };
+	constexpr u32 max_audio_channels = 2;
+
+	struct audio_format
+	{
+		u32 sample_rate{ audio_sample_rate };
+		u32 channels{ audio_channels };
+
+		constexpr std::size_t frame_length() const { return sample_rate * audio_frame_duration_ms / 1000; }
+		constexpr std::size_t samples_per_frame() const { return frame_length() * channels; }
+		constexpr std::size_t bytes_per_frame() const { return samples_per_frame() * sizeof(sample_t); }
+
+		constexpr bool is_supported() const
+		{
+			return channels > 0 && channels <= max_audio_channels && std::ranges::find(supported_sample_rates, sample_rate) != supported_sample_rates.end();
+		}
+
+		constexpr bool operator==(const audio_format&) const = default;
+	};
+
+	constexpr audio_format default_audio_format{ audio_sample_rate, audio_channels };
+
+	// The server mixes everything in this format (as float) and converts on the way in and out
+	constexpr audio_format mix_format{ 48000, 1 };
+
 	template<typename K, typename V, std::size_t N>
 	class static_map
 	{
@@ -45,75 +80,115 @@ namespace cnc
 
 	};
 
+	/*
+		The last quarter second or so of a stream, for drawing it. The size is a power of two,
+		so indices wrap with a mask and a block goes in or out as at most two copies.
+	*/
 	class history_buffer
 	{
 	private:
 		static constexpr float history_length_in_seconds{ 0.25f };
-		static constexpr std::size_t buffer_count{ static_cast<std::size_t>(audio_sample_rate * history_length_in_seconds) / buffer_size };
-		static constexpr std::size_t size_in_samples{ buffer_size * buffer_count };
-		std::size_t _current_idx{ 0 };
-		std::size_t _insert_count{ 0 };
-		std::array<sample_t, size_in_samples> _buffer{};
-
-		std::size_t wrap(const std::size_t i) const { return i % size_in_samples; }
 
 	public:
 		using value_type = sample_t;
 
-		class iterator_sentinel {};
-
-		class iterator
-		{
-		private:
-			history_buffer& _owner;
-			std::size_t _start, _offset;
-		public:
-			iterator(history_buffer& owner, const std::size_t start, const std::size_t offset) :
-				_start(start), _owner(owner), _offset(offset) {}
-
-			sample_t& operator*() { return _owner.get(_start + _offset); }
-
-			iterator& operator++() {
-				++_offset;
-				return *this;
-			}
+		static constexpr std::size_t size_in_samples{ std::bit_ceil(static_cast<std::size_t>(audio_sample_rate * history_length_in_seconds)) };
 
-			bool operator==(iterator_sentinel) const { return _offset == size_in_samples; }
-			bool operator!=(iterator_sentinel) const { return _offset != size_in_samples; }
+	private:
+		static constexpr std::size_t mask{ size_in_samples - 1 };
+		std::size_t _current_idx{ 0 };	// The oldest sample, the next one to be overwritten
+		std::array<sample_t, size_in_samples> _buffer{};
 
-		};
+		static std::size_t wrap(const std::size_t i) { return i & mask; }
 
+	public:
 		sample_t& operator[](const std::size_t idx) { return get(idx); }
 		const sample_t& operator[](const std::size_t idx) const { return get(idx); }
 
+		// 0 is the oldest sample
 		sample_t& get(const std::size_t idx) { return _buffer[wrap(idx + _current_idx)]; }
 		const sample_t& get(const std::size_t idx) const { return _buffer[wrap(idx + _current_idx)]; }
 
-		auto begin() { return iterator{ *this, _current_idx, 0 }; }
-		auto end() { return iterator_sentinel{}; }
+		static constexpr std::size_t size() { return size_in_samples; }
 
-		std::size_t collect_inserted_bytes()
+		// The whole history as two contiguous blocks, oldest first
+		std::array<std::span<const sample_t>, 2> segments() const
 		{
-			const auto val = std::exchange(_insert_count, 0);
-			return val * sizeof(sample_t);
+			const auto all = std::span(_buffer);
+			return { all.subspan(_current_idx), all.first(_current_idx) };
+		}
+
+		void push(std::span<const sample_t> samples)
+		{
+			// Only the newest fit
+			if (samples.size() > size_in_samples)
+				samples = samples.last(size_in_samples);
+
+			const auto first = std::min(samples.size(), size_in_samples - _current_idx);
+			std::memcpy(_buffer.data() + _current_idx, samples.data(), first * sizeof(sample_t));
+			std::memcpy(_buffer.data(), samples.data() + first, (samples.size() - first) * sizeof(sample_t));
+			_current_idx = wrap(_current_idx + samples.size());
 		}
 
 		void push_back(const sample_t s)
 		{
-			get(0) = s;
+			_buffer[_current_idx] = s;
 			_current_idx = wrap(_current_idx + 1);
-			_insert_count++;
 		}
 
+		// The newest out.size() samples, oldest first. Returns how many were copied, at most size().
+		std::size_t copy_out(std::span<sample_t> out) const
+		{
+			const auto count = std::min(out.size(), size_in_samples);
+			const auto start = wrap(_current_idx - count);
+
+			const auto first = std::min(count, size_in_samples - start);
+			std::memcpy(out.data(), _buffer.data() + start, first * sizeof(sample_t));
+			std::memcpy(out.data() + first, _buffer.data(), (count - first) * sizeof(sample_t));
+			return count;
+		}
+
+		// age is from 0, the oldest sample, to 1, the newest
 		sample_t sample(const float age) const
 		{
-			/*
-			const std::size_t start = ((_current_idx / buffer_size + 1) * buffer_size) % size_in_samples;
-			return get(start + static_cast<std::size_t>(age * size_in_samples));
-			*/
-			return get(size_in_samples * age);
+			return get(static_cast<std::size_t>(size_in_samples * age));
+		}
+
+	};
+
+	/*
+		A history written by one thread and drawn by another. Triple buffered: the writer
+		publishes a full copy after every push and the reader swaps in the newest one it
+		hasn't seen, neither ever waits, and nothing is read while it's being written.
+	*/
+	class shared_history
+	{
+	private:
+		static constexpr u8 index_mask{ 0b11 };
+		static constexpr u8 fresh{ 0b100 };	// Published since the reader last looked
+
+		history_buffer _latest;				// The writer's, what the next publish starts from
+		std::array<history_buffer, 3> _buffers{};
+		u8 _back{ 0 };						// The writer's
+		alignas(cache_line_size) std::atomic<u8> _middle{ 1 };
+		alignas(cache_line_size) u8 _front{ 2 };	// The reader's
+
+	public:
+		// Writer only, one thread
+		void push(std::span<const sample_t> samples)
+		{
+			_latest.push(samples);
+			_buffers[_back] = _latest;
+			_back = _middle.exchange(_back | fresh, std::memory_order_acq_rel) & index_mask;
 		}
 
+		// Reader only, one thread. The newest history published, unchanged until the next call.
+		const history_buffer& snapshot()
+		{
+			if (_middle.load(std::memory_order_relaxed) & fresh)
+				_front = _middle.exchange(_front, std::memory_order_acq_rel) & index_mask;
+			return _buffers[_front];
+		}
 	};
 
 		
@@ -0,0 +1,230 @@
+#include "dsp.h"
+#include "dsp_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(CNC_DSP_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace cnc::dsp
+{
+	namespace scalar
+	{
+		static sample_t saturate(const float v)
+		{
+			return static_cast<sample_t>(std::clamp(v, i16_min, i16_scale));
+		}
+
+		void to_float(const sample_t* input, float* output, const std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+				output[i] = input[i] * (1.0f / i16_scale);
+		}
+
+		void to_int16(const float* input, sample_t* output, const std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+				output[i] = saturate(input[i] * i16_scale);
+		}
+
+		void apply_gain_int16(const sample_t* input, const float gain, sample_t* output, const std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+				output[i] = saturate(input[i] * gain);
+		}
+
+		void apply_gain_ramp(float* samples, const float from, const float step, const std::size_t n, const std::size_t first)
+		{
+			for (std::size_t i = first; i < n; ++i)
+				samples[i] *= from + step * static_cast<float>(i);
+		}
+
+		void accumulate(const float* input, const float from, const float step, float* acc, const std::size_t n, const std::size_t first)
+		{
+			for (std::size_t i = first; i < n; ++i)
+				acc[i] += input[i] * (from + step * static_cast<float>(i));
+		}
+
+		void measure(const float* samples, const std::size_t n, float& peak, float& sum_of_squares)
+		{
+			// In locals, the references could alias the samples as far as the compiler knows
+			float p = peak, sum = sum_of_squares;
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				p = std::max(p, std::abs(samples[i]));
+				sum += samples[i] * samples[i];
+			}
+			peak = p;
+			sum_of_squares = sum;
+		}
+
+		void deinterleave_to_mono(const sample_t* input, float* output, const std::size_t frames)
+		{
+			for (std::size_t i = 0; i < frames; ++i)
+				output[i] = (static_cast<float>(input[i * 2]) + static_cast<float>(input[i * 2 + 1])) * (1.0f / (2.0f * i16_scale));
+		}
+
+		void interleave_from_mono(const float* input, sample_t* output, const std::size_t frames)
+		{
+			for (std::size_t i = 0; i < frames; ++i)
+				output[i * 2] = output[i * 2 + 1] = saturate(input[i] * i16_scale);
+		}
+	}
+
+	const kernels& get_scalar_kernels()
+	{
+		static constexpr kernels s_kernels{
+			.to_float = &scalar::to_float,
+			.to_int16 = &scalar::to_int16,
+			.apply_gain_int16 = &scalar::apply_gain_int16,
+			.apply_gain_ramp = [](float* samples, const float from, const float step, const std::size_t n) { scalar::apply_gain_ramp(samples, from, step, n); },
+			.accumulate = [](const float* input, const float from, const float step, float* acc, const std::size_t n) { scalar::accumulate(input, from, step, acc, n); },
+			.measure = &scalar::measure,
+			.deinterleave_to_mono = &scalar::deinterleave_to_mono,
+			.interleave_from_mono = &scalar::interleave_from_mono
+		};
+		return s_kernels;
+	}
+
+	static bool cpu_has_avx2()
+	{
+#if !defined(CNC_DSP_X86)
+		return false;
+#elif defined(_MSC_VER)
+		// The CPU has it and the OS saves the AVX registers
+		int regs[4];
+		__cpuid(regs, 1);
+		if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	static const kernels& get_kernels(const isa i)
+	{
+		switch (i)
+		{
+#ifdef CNC_DSP_X86
+		case isa::avx2: return get_avx2_kernels();
+		case isa::sse2: return get_sse2_kernels();
+#endif
+		default: return get_scalar_kernels();
+		}
+	}
+
+	struct dispatch
+	{
+		isa current;
+		const kernels* k;
+	};
+
+	// Picked on first use, so no kernel can run before it's set
+	static dispatch& get_dispatch()
+	{
+		static dispatch s_dispatch{ detect_isa(), &get_kernels(detect_isa()) };
+		return s_dispatch;
+	}
+
+	static const kernels& active() { return *get_dispatch().k; }
+
+	std::string_view to_string(const isa i)
+	{
+		switch (i)
+		{
+		case isa::scalar: return "scalar";
+		case isa::sse2: return "sse2";
+		case isa::avx2: return "avx2";
+		}
+		return "unknown";
+	}
+
+	std::optional<isa> parse_isa(std::string_view name)
+	{
+		for (const auto i : { isa::scalar, isa::sse2, isa::avx2 })
+		{
+			if (name == to_string(i))
+				return i;
+		}
+		return std::nullopt;
+	}
+
+	isa detect_isa()
+	{
+#ifdef CNC_DSP_X86
+		// SSE2 is part of x86-64
+		return cpu_has_avx2() ? isa::avx2 : isa::sse2;
+#else
+		return isa::scalar;
+#endif
+	}
+
+	isa get_isa()
+	{
+		return get_dispatch().current;
+	}
+
+	bool set_isa(const isa i)
+	{
+		if (i > detect_isa())
+			return false;
+
+		get_dispatch() = { i, &get_kernels(i) };
+		return true;
+	}
+
+	void to_float(std::span<const sample_t> input, std::span<float> output)
+	{
+		active().to_float(input.data(), output.data(), input.size());
+	}
+
+	void to_int16(std::span<const float> input, std::span<sample_t> output)
+	{
+		active().to_int16(input.data(), output.data(), input.size());
+	}
+
+	void apply_gain(std::span<const sample_t> input, const float gain, std::span<sample_t> output)
+	{
+		active().apply_gain_int16(input.data(), gain, output.data(), input.size());
+	}
+
+	void apply_gain(std::span<float> samples, const float from, const float to)
+	{
+		if (!samples.empty())
+			active().apply_gain_ramp(samples.data(), from, (to - from) / samples.size(), samples.size());
+	}
+
+	void accumulate(std::span<const float> input, const float from, const float to, std::span<float> acc)
+	{
+		if (!input.empty())
+			active().accumulate(input.data(), from, (to - from) / input.size(), acc.data(), input.size());
+	}
+
+	levels measure(std::span<const float> samples)
+	{
+		levels result;
+		if (samples.empty())
+			return result;
+
+		float sum_of_squares = 0.0f;
+		active().measure(samples.data(), samples.size(), result.peak, sum_of_squares);
+		result.mean_square = sum_of_squares / samples.size();
+		return result;
+	}
+
+	void deinterleave_to_mono(std::span<const sample_t> input, std::span<float> output)
+	{
+		active().deinterleave_to_mono(input.data(), output.data(), output.size());
+	}
+
+	void interleave_from_mono(std::span<const float> input, std::span<sample_t> output)
+	{
+		active().interleave_from_mono(input.data(), output.data(), input.size());
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <optional>
+
+#include "common.h"
+
+namespace cnc::dsp
+{
+	/*
+		The sample loops of the client and the server. Every kernel comes as plain C++, SSE2 and
+		AVX2, and the best one the CPU runs is picked the first time any of them is called.
+		They give the same results down to the bit, no FMA and the same rounding and
+		saturation everywhere, but for the sums in measure(), which are added up in a
+		different order.
+
+		Floats are in [-1, 1], i16 full scale is 32767 and conversions back to i16 truncate
+		towards zero and saturate. Outputs are as long as the inputs unless said otherwise,
+		and may be the inputs.
+	*/
+	enum class isa
+	{
+		scalar, sse2, avx2
+	};
+
+	std::string_view to_string(const isa i);
+	std::optional<isa> parse_isa(std::string_view name);
+
+	// The best the CPU supports
+	isa detect_isa();
+
+	// What the kernels run with
+	isa get_isa();
+
+	// For comparing them, before any other thread calls a kernel. False, and nothing changed,
+	// if the CPU can't run it.
+	bool set_isa(const isa i);
+
+	struct levels
+	{
+		float peak{ 0.0f };			// Largest magnitude
+		float mean_square{ 0.0f };	// Energy per sample, the square of the RMS
+	};
+
+	void to_float(std::span<const sample_t> input, std::span<float> output);
+	void to_int16(std::span<const float> input, std::span<sample_t> output);
+
+	void apply_gain(std::span<const sample_t> input, const float gain, std::span<sample_t> output);
+
+	// samples *= gain, the gain sliding linearly from one value to the other over the span
+	void apply_gain(std::span<float> samples, const float from, const float to);
+
+	// acc += input * gain, same ramp as above
+	void accumulate(std::span<const float> input, const float from, const float to, std::span<float> acc);
+
+	levels measure(std::span<const float> samples);
+
+	// Interleaved stereo i16 -> mono float, the channels averaged. output.size() frames.
+	void deinterleave_to_mono(std::span<const sample_t> input, std::span<float> output);
+
+	// Mono float -> interleaved stereo i16, both channels the same. input.size() frames.
+	void interleave_from_mono(std::span<const float> input, std::span<sample_t> output);
+}
@@ -0,0 +1,166 @@
+#include "dsp_kernels.h"
+
+#ifdef CNC_DSP_X86
+
+// Built with AVX2 enabled (see premake5.lua), only ever called once the CPU said it has it
+#include <immintrin.h>
+
+namespace cnc::dsp
+{
+	namespace avx2
+	{
+		// 16 i16 -> 2 x 8 floats
+		static void widen(const __m256i v, __m256& low, __m256& high)
+		{
+			low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+			high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+		}
+
+		// 2 x 8 floats in i16 scale -> 16 i16 in order, the pack works per 128 bit lane
+		static __m256i narrow(const __m256 low, const __m256 high)
+		{
+			const __m256 min = _mm256_set1_ps(i16_min);
+			const __m256 max = _mm256_set1_ps(i16_scale);
+			const __m256i packed = _mm256_packs_epi32(
+				_mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(low, min), max)),
+				_mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(high, min), max)));
+			return _mm256_permute4x64_epi64(packed, 0b11'01'10'00);
+		}
+
+		static void to_float(const sample_t* input, float* output, const std::size_t n)
+		{
+			const __m256 scale = _mm256_set1_ps(1.0f / i16_scale);
+			std::size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				__m256 low, high;
+				widen(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i)), low, high);
+				_mm256_storeu_ps(output + i, _mm256_mul_ps(low, scale));
+				_mm256_storeu_ps(output + i + 8, _mm256_mul_ps(high, scale));
+			}
+			scalar::to_float(input + i, output + i, n - i);
+		}
+
+		static void to_int16(const float* input, sample_t* output, const std::size_t n)
+		{
+			const __m256 scale = _mm256_set1_ps(i16_scale);
+			std::size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				const __m256i v = narrow(_mm256_mul_ps(_mm256_loadu_ps(input + i), scale), _mm256_mul_ps(_mm256_loadu_ps(input + i + 8), scale));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), v);
+			}
+			scalar::to_int16(input + i, output + i, n - i);
+		}
+
+		static void apply_gain_int16(const sample_t* input, const float gain, sample_t* output, const std::size_t n)
+		{
+			const __m256 g = _mm256_set1_ps(gain);
+			std::size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				__m256 low, high;
+				widen(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i)), low, high);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), narrow(_mm256_mul_ps(low, g), _mm256_mul_ps(high, g)));
+			}
+			scalar::apply_gain_int16(input + i, gain, output + i, n - i);
+		}
+
+		static void apply_gain_ramp(float* samples, const float from, const float step, const std::size_t n)
+		{
+			const __m256 offsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+			const __m256 steps = _mm256_set1_ps(step);
+			const __m256 start = _mm256_set1_ps(from);
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				const __m256 gain = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), offsets), steps), start);
+				_mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain));
+			}
+			scalar::apply_gain_ramp(samples, from, step, n, i);
+		}
+
+		static void accumulate(const float* input, const float from, const float step, float* acc, const std::size_t n)
+		{
+			const __m256 offsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+			const __m256 steps = _mm256_set1_ps(step);
+			const __m256 start = _mm256_set1_ps(from);
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				const __m256 gain = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), offsets), steps), start);
+				_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), gain), _mm256_loadu_ps(acc + i)));
+			}
+			scalar::accumulate(input, from, step, acc, n, i);
+		}
+
+		static void measure(const float* samples, const std::size_t n, float& peak, float& sum_of_squares)
+		{
+			const __m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+			__m256 peaks = _mm256_setzero_ps();
+			__m256 sums = _mm256_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				const __m256 v = _mm256_loadu_ps(samples + i);
+				peaks = _mm256_max_ps(peaks, _mm256_and_ps(v, magnitude));
+				sums = _mm256_add_ps(sums, _mm256_mul_ps(v, v));
+			}
+
+			alignas(32) float p[8], s[8];
+			_mm256_store_ps(p, peaks);
+			_mm256_store_ps(s, sums);
+			for (int j = 0; j < 8; ++j)
+			{
+				peak = peak > p[j] ? peak : p[j];
+				sum_of_squares += s[j];
+			}
+
+			scalar::measure(samples + i, n - i, peak, sum_of_squares);
+		}
+
+		static void deinterleave_to_mono(const sample_t* input, float* output, const std::size_t frames)
+		{
+			const __m256i ones = _mm256_set1_epi16(1);
+			const __m256 scale = _mm256_set1_ps(1.0f / (2.0f * i16_scale));
+			std::size_t i = 0;
+			for (; i + 8 <= frames; i += 8)
+			{
+				const __m256i sums = _mm256_madd_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i * 2)), ones);
+				_mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(sums), scale));
+			}
+			scalar::deinterleave_to_mono(input + i * 2, output + i, frames - i);
+		}
+
+		static void interleave_from_mono(const float* input, sample_t* output, const std::size_t frames)
+		{
+			const __m256 scale = _mm256_set1_ps(i16_scale);
+			std::size_t i = 0;
+			for (; i + 16 <= frames; i += 16)
+			{
+				// The unpacks work per lane too: the first 8 samples go to the low halves of the lanes
+				const __m256i v = _mm256_permute4x64_epi64(narrow(_mm256_mul_ps(_mm256_loadu_ps(input + i), scale), _mm256_mul_ps(_mm256_loadu_ps(input + i + 8), scale)), 0b11'01'10'00);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i * 2), _mm256_unpacklo_epi16(v, v));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i * 2 + 16), _mm256_unpackhi_epi16(v, v));
+			}
+			scalar::interleave_from_mono(input + i, output + i * 2, frames - i);
+		}
+	}
+
+	const kernels& get_avx2_kernels()
+	{
+		static constexpr kernels s_kernels{
+			.to_float = &avx2::to_float,
+			.to_int16 = &avx2::to_int16,
+			.apply_gain_int16 = &avx2::apply_gain_int16,
+			.apply_gain_ramp = &avx2::apply_gain_ramp,
+			.accumulate = &avx2::accumulate,
+			.measure = &avx2::measure,
+			.deinterleave_to_mono = &avx2::deinterleave_to_mono,
+			.interleave_from_mono = &avx2::interleave_from_mono
+		};
+		return s_kernels;
+	}
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CNC_DSP_X86 1
+#endif
+
+// Only for dsp.cpp and the files with the kernels of one instruction set each
+namespace cnc::dsp
+{
+	struct kernels
+	{
+		void (*to_float)(const sample_t* input, float* output, std::size_t n);
+		void (*to_int16)(const float* input, sample_t* output, std::size_t n);
+		void (*apply_gain_int16)(const sample_t* input, float gain, sample_t* output, std::size_t n);
+		void (*apply_gain_ramp)(float* samples, float from, float step, std::size_t n);
+		void (*accumulate)(const float* input, float from, float step, float* acc, std::size_t n);
+		void (*measure)(const float* samples, std::size_t n, float& peak, float& sum_of_squares);
+		void (*deinterleave_to_mono)(const sample_t* input, float* output, std::size_t frames);
+		void (*interleave_from_mono)(const float* input, sample_t* output, std::size_t frames);
+	};
+
+	inline constexpr float i16_scale = 32767.0f;
+	inline constexpr float i16_min = -32768.0f;
+
+	/*
+		The ramps take their gain at sample i as from + step * i, with i counted from the start
+		of the whole span: the vector kernels hand their tails to the scalar ones with the
+		position they stopped at, so first is where the scalar kernel's i starts. measure()
+		carries on from the peak and the sum it's given, for the same reason.
+	*/
+	namespace scalar
+	{
+		void to_float(const sample_t* input, float* output, std::size_t n);
+		void to_int16(const float* input, sample_t* output, std::size_t n);
+		void apply_gain_int16(const sample_t* input, float gain, sample_t* output, std::size_t n);
+		void apply_gain_ramp(float* samples, float from, float step, std::size_t n, std::size_t first = 0);
+		void accumulate(const float* input, float from, float step, float* acc, std::size_t n, std::size_t first = 0);
+		void measure(const float* samples, std::size_t n, float& peak, float& sum_of_squares);
+		void deinterleave_to_mono(const sample_t* input, float* output, std::size_t frames);
+		void interleave_from_mono(const float* input, sample_t* output, std::size_t frames);
+	}
+
+	const kernels& get_scalar_kernels();
+
+#ifdef CNC_DSP_X86
+	const kernels& get_sse2_kernels();
+	const kernels& get_avx2_kernels();
+#endif
+}
@@ -0,0 +1,164 @@
+#include "dsp_kernels.h"
+
+#ifdef CNC_DSP_X86
+
+#include <emmintrin.h>
+
+namespace cnc::dsp
+{
+	namespace sse2
+	{
+		// 8 i16 -> 2 x 4 floats, sign extended
+		static void widen(const __m128i v, __m128& low, __m128& high)
+		{
+			low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+			high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+		}
+
+		// 2 x 4 floats in i16 scale -> 8 i16, clamped first so the conversion can't overflow
+		static __m128i narrow(const __m128 low, const __m128 high)
+		{
+			const __m128 min = _mm_set1_ps(i16_min);
+			const __m128 max = _mm_set1_ps(i16_scale);
+			return _mm_packs_epi32(
+				_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(low, min), max)),
+				_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(high, min), max)));
+		}
+
+		static void to_float(const sample_t* input, float* output, const std::size_t n)
+		{
+			const __m128 scale = _mm_set1_ps(1.0f / i16_scale);
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128 low, high;
+				widen(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)), low, high);
+				_mm_storeu_ps(output + i, _mm_mul_ps(low, scale));
+				_mm_storeu_ps(output + i + 4, _mm_mul_ps(high, scale));
+			}
+			scalar::to_float(input + i, output + i, n - i);
+		}
+
+		static void to_int16(const float* input, sample_t* output, const std::size_t n)
+		{
+			const __m128 scale = _mm_set1_ps(i16_scale);
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				const __m128i v = narrow(_mm_mul_ps(_mm_loadu_ps(input + i), scale), _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), v);
+			}
+			scalar::to_int16(input + i, output + i, n - i);
+		}
+
+		static void apply_gain_int16(const sample_t* input, const float gain, sample_t* output, const std::size_t n)
+		{
+			const __m128 g = _mm_set1_ps(gain);
+			std::size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				__m128 low, high;
+				widen(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)), low, high);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), narrow(_mm_mul_ps(low, g), _mm_mul_ps(high, g)));
+			}
+			scalar::apply_gain_int16(input + i, gain, output + i, n - i);
+		}
+
+		static void apply_gain_ramp(float* samples, const float from, const float step, const std::size_t n)
+		{
+			const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const __m128 steps = _mm_set1_ps(step);
+			const __m128 start = _mm_set1_ps(from);
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				const __m128 gain = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), offsets), steps), start);
+				_mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain));
+			}
+			scalar::apply_gain_ramp(samples, from, step, n, i);
+		}
+
+		static void accumulate(const float* input, const float from, const float step, float* acc, const std::size_t n)
+		{
+			const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const __m128 steps = _mm_set1_ps(step);
+			const __m128 start = _mm_set1_ps(from);
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				const __m128 gain = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i)), offsets), steps), start);
+				_mm_storeu_ps(acc + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input + i), gain), _mm_loadu_ps(acc + i)));
+			}
+			scalar::accumulate(input, from, step, acc, n, i);
+		}
+
+		static void measure(const float* samples, const std::size_t n, float& peak, float& sum_of_squares)
+		{
+			const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 peaks = _mm_setzero_ps();
+			__m128 sums = _mm_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				const __m128 v = _mm_loadu_ps(samples + i);
+				peaks = _mm_max_ps(peaks, _mm_and_ps(v, magnitude));
+				sums = _mm_add_ps(sums, _mm_mul_ps(v, v));
+			}
+
+			alignas(16) float p[4], s[4];
+			_mm_store_ps(p, peaks);
+			_mm_store_ps(s, sums);
+			for (int j = 0; j < 4; ++j)
+			{
+				peak = peak > p[j] ? peak : p[j];
+				sum_of_squares += s[j];
+			}
+
+			scalar::measure(samples + i, n - i, peak, sum_of_squares);
+		}
+
+		static void deinterleave_to_mono(const sample_t* input, float* output, const std::size_t frames)
+		{
+			// Left and right added up as i32, exactly what the floats would give
+			const __m128i ones = _mm_set1_epi16(1);
+			const __m128 scale = _mm_set1_ps(1.0f / (2.0f * i16_scale));
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4)
+			{
+				const __m128i sums = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 2)), ones);
+				_mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(sums), scale));
+			}
+			scalar::deinterleave_to_mono(input + i * 2, output + i, frames - i);
+		}
+
+		static void interleave_from_mono(const float* input, sample_t* output, const std::size_t frames)
+		{
+			const __m128 scale = _mm_set1_ps(i16_scale);
+			std::size_t i = 0;
+			for (; i + 8 <= frames; i += 8)
+			{
+				const __m128i v = narrow(_mm_mul_ps(_mm_loadu_ps(input + i), scale), _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 2), _mm_unpacklo_epi16(v, v));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 2 + 8), _mm_unpackhi_epi16(v, v));
+			}
+			scalar::interleave_from_mono(input + i, output + i * 2, frames - i);
+		}
+	}
+
+	const kernels& get_sse2_kernels()
+	{
+		static constexpr kernels s_kernels{
+			.to_float = &sse2::to_float,
+			.to_int16 = &sse2::to_int16,
+			.apply_gain_int16 = &sse2::apply_gain_int16,
+			.apply_gain_ramp = &sse2::apply_gain_ramp,
+			.accumulate = &sse2::accumulate,
+			.measure = &sse2::measure,
+			.deinterleave_to_mono = &sse2::deinterleave_to_mono,
+			.interleave_from_mono = &sse2::interleave_from_mono
+		};
+		return s_kernels;
+	}
+}
+
+#endif
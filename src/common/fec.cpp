@@ -0,0 +1,55 @@
+#include "fec.h"
+
+namespace cnc
+{
+	void xor_into(std::span<std::byte> dst, std::span<const std::byte> src)
+	{
+		const std::size_t n = std::min(dst.size(), src.size());
+		for (std::size_t i = 0; i < n; ++i)
+			dst[i] ^= src[i];
+	}
+
+	fec_encoder::fec_encoder(const std::size_t group_size, const std::size_t max_payload_size) :
+		_group_size(group_size),
+		_parity(max_payload_size)
+	{
+	}
+
+	bool fec_encoder::add(const u32 sequence, std::span<const std::byte> payload)
+	{
+		if (!is_enabled())
+			return false;
+
+		if (sequence % _group_size == 0)
+		{
+			_group_start = sequence;
+			_group_payload_size = std::min(payload.size(), _parity.size());
+			std::ranges::fill(_parity, std::byte{ 0 });
+		}
+
+		xor_into(std::span(_parity).first(_group_payload_size), payload);
+
+		return sequence % _group_size == _group_size - 1;
+	}
+
+	fec_decoder::fec_decoder(const std::size_t group_size, const std::size_t max_payload_size) :
+		_group_size(group_size),
+		_payload_size(max_payload_size),
+		_slots(std::max<std::size_t>(group_size, 1) * max_payload_size),
+		_accumulator(max_payload_size),
+		_received(std::max<std::size_t>(group_size, 1), false)
+	{
+	}
+
+	void fec_decoder::start(const u32 group)
+	{
+		_group = group;
+		_started = true;
+		_closed = false;
+		_next = 0;
+		_received_count = 0;
+		std::fill(_received.begin(), _received.end(), false);
+		std::ranges::fill(_accumulator, std::byte{ 0 });
+		_group_payload_size = 0;
+	}
+}
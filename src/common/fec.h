@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <cstddef>
+
+#include "common.h"
+
+namespace cnc
+{
+	constexpr std::size_t max_fec_group_size = 16;
+
+	void xor_into(std::span<std::byte> dst, std::span<const std::byte> src);
+
+	/*
+		XOR parity over groups of consecutive frames. Groups are aligned on the sequence number
+		(frames group_size * n to group_size * (n + 1) - 1), so both ends agree without signaling.
+		A group size below 2 disables it. Payloads may be smaller than the size given at construction
+		but must all have the same size within a group.
+	*/
+	class fec_encoder
+	{
+	private:
+		std::size_t _group_size;
+		std::vector<std::byte> _parity;
+		std::size_t _group_payload_size{ 0 };
+		u32 _group_start{ 0 };
+	public:
+		fec_encoder(const std::size_t group_size, const std::size_t max_payload_size);
+
+		bool is_enabled() const { return _group_size > 1; }
+
+		// Returns true when the frame completes a group, get_parity() is then valid until the next call
+		bool add(const u32 sequence, std::span<const std::byte> payload);
+
+		std::span<const std::byte> get_parity() const { return std::span(_parity).first(_group_payload_size); }
+		u32 get_group_start() const { return _group_start; }
+
+		// True if the next frame starts a new group, which is when the payload size may change
+		bool is_group_boundary(const u32 sequence) const { return !is_enabled() || sequence % _group_size == 0; }
+	};
+
+	struct fec_stats
+	{
+		std::size_t received{ 0 };
+		std::size_t recovered{ 0 };
+		std::size_t lost{ 0 };
+	};
+
+	/*
+		Receiving end of fec_encoder. Frames are delivered in order, as soon as every frame before
+		them in their group has been delivered; after a loss the rest of the group is held until the
+		parity (or the next group) shows up. A single missing frame per group is rebuilt, the others
+		are skipped, and the gap in the sequence numbers tells the next stage.
+	*/
+	class fec_decoder
+	{
+	private:
+		std::size_t _group_size, _payload_size;
+		std::size_t _group_payload_size{ 0 };
+		std::vector<std::byte> _slots, _accumulator;
+		std::vector<bool> _received;
+		std::size_t _received_count{ 0 };
+		std::size_t _next{ 0 };
+		u32 _group{ 0 };
+		bool _started{ false };
+		bool _first_group{ true };
+		bool _closed{ false };
+		fec_stats _stats;
+
+		std::span<std::byte> slot(const std::size_t i) { return std::span(_slots).subspan(i * _payload_size, _group_payload_size); }
+
+		void start(const u32 group);
+
+		template<typename Deliver>
+		void release(Deliver&& deliver)
+		{
+			for (; _next < _group_size; ++_next)
+			{
+				if (_received[_next])
+					deliver(static_cast<u32>(_group * _group_size + _next), std::span<const std::byte>(slot(_next)));
+				else if (_closed)
+					_stats.lost++;
+				else
+					break;
+			}
+		}
+
+		template<typename Deliver>
+		bool enter_group(const u32 group, const std::size_t payload_size, Deliver&& deliver)
+		{
+			if (payload_size > _payload_size)
+				return false;
+
+			if (!_started || group > _group)
+			{
+				const bool first = !_started;
+				if (_started)
+				{
+					_closed = true;
+					release(deliver);
+				}
+				start(group);
+				_first_group = first;
+				_group_payload_size = payload_size;
+			}
+			return group == _group && !_closed;
+		}
+
+	public:
+		fec_decoder(const std::size_t group_size, const std::size_t max_payload_size);
+
+		bool is_enabled() const { return _group_size > 1; }
+		const fec_stats& get_stats() const { return _stats; }
+
+		// deliver(sequence, payload) is called for every frame that can be played, in order
+		template<typename Deliver>
+		void on_frame(const u32 sequence, std::span<const std::byte> payload, Deliver&& deliver)
+		{
+			_stats.received++;
+
+			if (!is_enabled())
+			{
+				deliver(sequence, payload);
+				return;
+			}
+
+			const auto i = sequence % _group_size;
+			if (!enter_group(static_cast<u32>(sequence / _group_size), payload.size(), deliver) || _received[i] || payload.size() != _group_payload_size)
+				return;
+
+			// The stream may start in the middle of a group
+			if (_first_group && _received_count == 0)
+				_next = std::max(_next, i);
+
+			std::ranges::copy(payload, slot(i).begin());
+			xor_into(_accumulator, payload);
+			_received[i] = true;
+			_received_count++;
+
+			release(deliver);
+		}
+
+		template<typename Deliver>
+		void on_parity(const u32 group_start, std::span<const std::byte> parity, Deliver&& deliver)
+		{
+			if (!is_enabled() || !enter_group(static_cast<u32>(group_start / _group_size), parity.size(), deliver) || parity.size() != _group_payload_size)
+				return;
+
+			if (_received_count + 1 == _group_size)
+			{
+				const auto missing = static_cast<std::size_t>(std::find(_received.begin(), _received.end(), false) - _received.begin());
+				auto s = slot(missing);
+				std::ranges::copy(parity, s.begin());
+				xor_into(s, _accumulator);
+				_received[missing] = true;
+				_stats.recovered++;
+			}
+
+			_closed = true;
+			release(deliver);
+		}
+	};
+}
@@ -0,0 +1,463 @@
+#include "link_emulator.h"
+
+#include <queue>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstring>
+
+#include "protocol.h"
+
+namespace cnc
+{
+	using asio::ip::tcp;
+	using link_clock = std::chrono::steady_clock;
+
+	// Without a bandwidth cap nothing else bounds what a pipe holds
+	static constexpr std::size_t s_max_scheduled_packets = 4096;
+
+	static link_clock::duration from_ms(const float ms)
+	{
+		return std::chrono::duration_cast<link_clock::duration>(std::chrono::duration<float, std::milli>(ms));
+	}
+
+	bool parse_link_option(std::string_view name, const std::string& value, link_profile& up, link_profile& down)
+	{
+		bool apply_up = true, apply_down = true;
+
+		if (name.starts_with("link_up_"))
+		{
+			apply_down = false;
+			name.remove_prefix(8);
+		}
+		else if (name.starts_with("link_down_"))
+		{
+			apply_up = false;
+			name.remove_prefix(10);
+		}
+		else if (name.starts_with("link_"))
+		{
+			name.remove_prefix(5);
+		}
+		else
+		{
+			return false;
+		}
+
+		const float number = static_cast<float>(std::atof(value.c_str()));
+
+		auto set = [&](auto link_profile::* member, const auto v) {
+			if (apply_up)
+				up.*member = v;
+			if (apply_down)
+				down.*member = v;
+			return true;
+		};
+
+		if (name == "delay_ms")
+			return set(&link_profile::delay_ms, std::max(number, 0.0f));
+		if (name == "jitter_ms")
+			return set(&link_profile::jitter_ms, std::max(number, 0.0f));
+		if (name == "loss_percent")
+			return set(&link_profile::loss, std::clamp(number / 100.0f, 0.0f, 1.0f));
+		if (name == "loss_burst")
+			return set(&link_profile::loss_burst, std::max(number, 1.0f));
+		if (name == "reorder_percent")
+			return set(&link_profile::reorder, std::clamp(number / 100.0f, 0.0f, 1.0f));
+		if (name == "kbps")
+			return set(&link_profile::bandwidth_kbps, std::max(number, 0.0f));
+		if (name == "queue_ms")
+			return set(&link_profile::queue_ms, std::max(number, 0.0f));
+		if (name == "tail_drop")
+			return set(&link_profile::tail_drop, number != 0.0f);
+		if (name == "seed")
+			return set(&link_profile::seed, static_cast<u32>(std::atoi(value.c_str())));
+		if (name == "distribution")
+		{
+			if (value == "uniform")
+				return set(&link_profile::distribution, delay_distribution::uniform);
+			if (value == "normal")
+				return set(&link_profile::distribution, delay_distribution::normal);
+			if (value == "exponential")
+				return set(&link_profile::distribution, delay_distribution::exponential);
+		}
+
+		return false;
+	}
+
+	/*
+		One direction of a connection. Packets are read whole, go through loss, the bottleneck
+		and the delay line, and are written out in the order they're released. While the
+		bottleneck is full nothing is read, so the sender's socket backs up the way it would
+		behind a slow link, unless the profile asks for tail drop instead.
+	*/
+	class link_emulator::pipe
+	{
+	private:
+		struct scheduled_packet
+		{
+			link_clock::time_point release;
+			std::size_t order;
+			std::vector<std::byte> data;
+
+			bool operator>(const scheduled_packet& other) const { return std::tie(release, order) > std::tie(other.release, other.order); }
+		};
+
+		tcp::socket& _from;
+		tcp::socket& _to;
+		const link_profile& _profile;
+		direction_counters& _counters;
+		std::function<void()> _on_error;
+
+		std::mt19937 _random;
+		std::uniform_real_distribution<float> _uniform{ 0.0f, 1.0f };
+		bool _bursting{ false };	// Gilbert-Elliott: in the bad state everything is lost
+
+		bool _expect_hello;
+		std::vector<std::byte> _read_buffer;
+
+		std::priority_queue<scheduled_packet, std::vector<scheduled_packet>, std::greater<>> _scheduled;
+		std::size_t _order{ 0 };
+		link_clock::time_point _bottleneck_free{};	// When the bottleneck is done with what it holds
+		link_clock::time_point _last_release{};		// Packets not reordered leave in order
+
+		asio::steady_timer _timer;
+		link_clock::time_point _timer_expiry{ link_clock::time_point::max() };
+		std::size_t _timer_waits{ 0 };
+
+		asio::steady_timer _resume_timer;
+		bool _paused{ false };
+
+		std::deque<std::vector<std::byte>> _outgoing;
+		bool _reading{ false };
+		bool _writing{ false };
+
+		void read_hello()
+		{
+			_read_buffer.resize(sizeof(protocol::hello));
+			_reading = true;
+			asio::async_read(_from, asio::buffer(_read_buffer), [this](const asio::error_code error, const std::size_t) {
+				_reading = false;
+				if (error)
+					return _on_error();
+
+				schedule(std::move(_read_buffer), false);
+				read_next();
+			});
+		}
+
+		void read_header()
+		{
+			_read_buffer.resize(sizeof(protocol::frame_header));
+			_reading = true;
+			asio::async_read(_from, asio::buffer(_read_buffer), [this](const asio::error_code error, const std::size_t) {
+				_reading = false;
+				if (error)
+					return _on_error();
+
+				protocol::frame_header header;
+				std::memcpy(&header, _read_buffer.data(), sizeof(header));
+
+				// Without frame boundaries there's nothing sensible left to do
+				if (!header.is_valid())
+					return _on_error();
+
+				read_payload(header.payload_size_in_bytes());
+			});
+		}
+
+		void read_payload(const std::size_t size)
+		{
+			_read_buffer.resize(sizeof(protocol::frame_header) + size);
+			_reading = true;
+			asio::async_read(_from, asio::buffer(_read_buffer.data() + sizeof(protocol::frame_header), size), [this](const asio::error_code error, const std::size_t) {
+				_reading = false;
+				if (error)
+					return _on_error();
+
+				schedule(std::move(_read_buffer), true);
+				read_next();
+			});
+		}
+
+		void read_next()
+		{
+			const auto backlog = _bottleneck_free - link_clock::now();
+			const auto limit = from_ms(_profile.queue_ms);
+
+			if (_profile.bandwidth_kbps <= 0.0f || _profile.tail_drop || backlog <= limit)
+				return read_header();
+
+			// Resumes once the bottleneck has drained back to its queue size
+			_paused = true;
+			_resume_timer.expires_after(backlog - limit);
+			_resume_timer.async_wait([this](const asio::error_code error) {
+				_paused = false;
+				if (!error)
+					read_header();
+			});
+		}
+
+		bool lose()
+		{
+			if (_profile.loss <= 0.0f)
+				return false;
+
+			// Stays in the bad state for loss_burst packets on average, and the long-term loss matches
+			const float leave_bad = 1.0f / _profile.loss_burst;
+			const float enter_bad = std::min(1.0f, _profile.loss * leave_bad / std::max(1.0f - _profile.loss, 1e-6f));
+
+			_bursting = _uniform(_random) < (_bursting ? 1.0f - leave_bad : enter_bad);
+			return _bursting;
+		}
+
+		float jitter_ms()
+		{
+			const float j = _profile.jitter_ms;
+			if (j <= 0.0f)
+				return 0.0f;
+
+			switch (_profile.distribution)
+			{
+			case delay_distribution::uniform:
+				return _uniform(_random) * 2.0f * j;
+			case delay_distribution::exponential:
+				return std::exponential_distribution<float>(1.0f / j)(_random);
+			default:
+				return std::max(0.0f, std::normal_distribution<float>(0.0f, j)(_random));
+			}
+		}
+
+		void schedule(std::vector<std::byte>&& packet, const bool droppable)
+		{
+			const auto now = link_clock::now();
+
+			if (droppable && lose())
+			{
+				_counters.lost++;
+				return;
+			}
+
+			if (droppable && _scheduled.size() >= s_max_scheduled_packets)
+			{
+				_counters.queue_drops++;
+				return;
+			}
+
+			auto start = now;
+
+			if (_profile.bandwidth_kbps > 0.0f)
+			{
+				// Tail drop when the bottleneck's queue is full
+				if (droppable && _profile.tail_drop && _bottleneck_free - now > from_ms(_profile.queue_ms))
+				{
+					_counters.queue_drops++;
+					return;
+				}
+
+				const float transmission_ms = packet.size() * 8.0f / _profile.bandwidth_kbps;
+				_bottleneck_free = std::max(_bottleneck_free, now) + from_ms(transmission_ms);
+				start = _bottleneck_free;
+			}
+
+			auto release = start + from_ms(_profile.delay_ms + jitter_ms());
+
+			if (droppable && _profile.reorder > 0.0f && _uniform(_random) < _profile.reorder)
+			{
+				// Late by one or two frames, whatever comes next overtakes it
+				release += from_ms(audio_frame_duration_ms * (1.0f + _uniform(_random)));
+				_counters.reordered++;
+			}
+			else
+			{
+				release = std::max(release, _last_release);
+				_last_release = release;
+			}
+
+			_scheduled.push({ release, _order++, std::move(packet) });
+			arm_timer();
+		}
+
+		void arm_timer()
+		{
+			if (_scheduled.empty() || _scheduled.top().release >= _timer_expiry)
+				return;
+
+			// Cancels the wait for a later packet, if there was one
+			_timer_expiry = _scheduled.top().release;
+			_timer.expires_at(_timer_expiry);
+			_timer_waits++;
+
+			_timer.async_wait([this](const asio::error_code error) {
+				_timer_waits--;
+				if (error)
+					return;
+
+				_timer_expiry = link_clock::time_point::max();
+				const auto now = link_clock::now();
+
+				while (!_scheduled.empty() && _scheduled.top().release <= now)
+				{
+					// The queue only hands out const references, the packet is popped right after
+					_outgoing.push_back(std::move(const_cast<scheduled_packet&>(_scheduled.top()).data));
+					_scheduled.pop();
+				}
+
+				write();
+				arm_timer();
+			});
+		}
+
+		void write()
+		{
+			if (_writing || _outgoing.empty())
+				return;
+
+			_writing = true;
+			asio::async_write(_to, asio::buffer(_outgoing.front()), [this](const asio::error_code error, const std::size_t) {
+				_writing = false;
+				if (error)
+					return _on_error();
+
+				_counters.forwarded++;
+				_outgoing.pop_front();
+				write();
+			});
+		}
+
+	public:
+		pipe(tcp::socket& from, tcp::socket& to, const link_profile& profile, direction_counters& counters, const u32 seed, const bool expect_hello,
+			std::function<void()> on_error) :
+			_from(from),
+			_to(to),
+			_profile(profile),
+			_counters(counters),
+			_on_error(std::move(on_error)),
+			_random(seed),
+			_expect_hello(expect_hello),
+			_timer(from.get_executor()),
+			_resume_timer(from.get_executor())
+		{
+		}
+
+		void start()
+		{
+			if (_expect_hello)
+				read_hello();
+			else
+				read_header();
+		}
+
+		void stop()
+		{
+			_timer.cancel();
+			_resume_timer.cancel();
+		}
+
+		bool is_busy() const { return _reading || _writing || _paused || _timer_waits > 0; }
+	};
+
+	class link_emulator::connection
+	{
+	private:
+		tcp::socket _client;
+		tcp::socket _server;
+		pipe _up, _down;
+		bool _connecting{ false };
+		bool _closed{ false };
+
+	public:
+		connection(tcp::socket&& client, link_emulator& owner, const u32 index) :
+			_client(std::move(client)),
+			_server(_client.get_executor()),
+			_up(_client, _server, owner._up, owner._up_counters, owner._up.seed + 2 * index, true, [this] { close(); }),
+			_down(_server, _client, owner._down, owner._down_counters, owner._down.seed + 2 * index + 1, false, [this] { close(); })
+		{
+		}
+
+		void connect(const tcp::resolver::results_type& target)
+		{
+			_connecting = true;
+			asio::async_connect(_server, target, [this](const asio::error_code error, const tcp::endpoint&) {
+				_connecting = false;
+				if (error || _closed)
+					return close();
+
+				_client.set_option(tcp::no_delay(true));
+				_server.set_option(tcp::no_delay(true));
+				_up.start();
+				_down.start();
+			});
+		}
+
+		void close()
+		{
+			_closed = true;
+
+			asio::error_code ignored;
+			_client.close(ignored);
+			_server.close(ignored);
+			_up.stop();
+			_down.stop();
+		}
+
+		bool is_closed() const { return _closed; }
+		bool is_busy() const { return _connecting || _up.is_busy() || _down.is_busy(); }
+	};
+
+	link_emulator::link_emulator(const std::string& host, const std::string& port, const link_profile& up, const link_profile& down, const u16 listen_port) :
+		_up(up),
+		_down(down),
+		_acceptor(_ctx, tcp::endpoint(asio::ip::address_v4::loopback(), listen_port)),
+		_sweep_timer(_ctx)
+	{
+		tcp::resolver resolver(_ctx);
+		_target = resolver.resolve(host, port);
+		_port = _acceptor.local_endpoint().port();
+
+		accept();
+		sweep();
+
+		_thread = std::thread([this] { _ctx.run(); });
+	}
+
+	link_emulator::~link_emulator()
+	{
+		_ctx.stop();
+		_thread.join();
+	}
+
+	void link_emulator::accept()
+	{
+		_acceptor.async_accept([this](const asio::error_code error, tcp::socket socket) {
+			if (!error)
+			{
+				auto& c = _connections.emplace_back(std::make_unique<connection>(std::move(socket), *this, _connection_count++));
+				c->connect(_target);
+			}
+
+			accept();
+		});
+	}
+
+	void link_emulator::sweep()
+	{
+		std::erase_if(_connections, [](const auto& c) { return c->is_closed() && !c->is_busy(); });
+
+		_sweep_timer.expires_after(std::chrono::seconds(1));
+		_sweep_timer.async_wait([this](const asio::error_code error) {
+			if (!error)
+				sweep();
+		});
+	}
+
+	link_stats link_emulator::get_stats() const
+	{
+		auto snapshot = [](const direction_counters& c) {
+			return link_direction_stats{ c.forwarded.load(), c.lost.load(), c.queue_drops.load(), c.reordered.load() };
+		};
+
+		return { snapshot(_up_counters), snapshot(_down_counters) };
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include <asio.hpp>
+
+#include "common.h"
+
+namespace cnc
+{
+	enum class delay_distribution
+	{
+		uniform,		// Between 0 and twice the jitter
+		normal,			// Jitter is the standard deviation, negative draws count as 0
+		exponential,	// Jitter is the mean, the long tail of a queue somewhere
+	};
+
+	// One direction of an emulated link
+	struct link_profile
+	{
+		float delay_ms{ 0.0f };			// Before jitter
+		float jitter_ms{ 0.0f };
+		delay_distribution distribution{ delay_distribution::normal };
+		float loss{ 0.0f };				// Fraction of packets lost
+		float loss_burst{ 1.0f };		// Mean length of a loss burst, in packets
+		float reorder{ 0.0f };			// Fraction of packets held back so the next ones overtake them
+		float bandwidth_kbps{ 0.0f };	// 0 for no cap
+		float queue_ms{ 200.0f };		// What the bottleneck holds, with a cap
+		bool tail_drop{ false };		// Drop at a full bottleneck instead of no longer reading from the sender
+		u32 seed{ 1 };
+
+		bool is_transparent() const { return delay_ms == 0.0f && jitter_ms == 0.0f && loss == 0.0f && reorder == 0.0f && bandwidth_kbps == 0.0f; }
+	};
+
+	/*
+		Options for both directions: link_delay_ms, link_jitter_ms, link_distribution
+		(uniform, normal or exponential), link_loss_percent, link_loss_burst,
+		link_reorder_percent, link_kbps, link_queue_ms, link_tail_drop and link_seed. With link_up_ or
+		link_down_ instead of link_ they only apply to the way to the server or back.
+		False if the name isn't one of them.
+	*/
+	bool parse_link_option(std::string_view name, const std::string& value, link_profile& up, link_profile& down);
+
+	struct link_direction_stats
+	{
+		std::size_t forwarded{ 0 };
+		std::size_t lost{ 0 };
+		std::size_t queue_drops{ 0 };
+		std::size_t reordered{ 0 };
+	};
+
+	struct link_stats
+	{
+		link_direction_stats up, down;
+	};
+
+	/*
+		A proxy on the loopback that behaves like a bad network between the clients and the
+		server. It reads whole packets, so losses and reordering hit frames the way they
+		would on a datagram link: the hello always goes through, audio and parity packets may
+		not. Each direction of each connection has its own bottleneck and random state, the
+		way every client would have its own access link, and the same seed gives the same
+		losses for the same traffic. Runs on a thread of its own.
+	*/
+	class link_emulator
+	{
+	private:
+		class pipe;
+		class connection;
+
+		struct direction_counters
+		{
+			std::atomic<std::size_t> forwarded{ 0 }, lost{ 0 }, queue_drops{ 0 }, reordered{ 0 };
+		};
+
+		link_profile _up, _down;
+		direction_counters _up_counters, _down_counters;
+
+		asio::io_context _ctx;
+		asio::ip::tcp::acceptor _acceptor;
+		asio::ip::tcp::resolver::results_type _target;
+		u16 _port{ 0 };
+		asio::steady_timer _sweep_timer;
+		std::vector<std::unique_ptr<connection>> _connections;
+		u32 _connection_count{ 0 };
+		std::thread _thread;
+
+		void accept();
+		void sweep();
+
+	public:
+		// Listens on the loopback, port 0 picks a free one
+		link_emulator(const std::string& host, const std::string& port, const link_profile& up, const link_profile& down, const u16 listen_port = 0);
+		~link_emulator();
+
+		link_emulator(const link_emulator&) = delete;
+		link_emulator& operator=(const link_emulator&) = delete;
+
+		u16 get_port() const { return _port; }
+		link_stats get_stats() const;
+	};
+}
@@ -0,0 +1,372 @@
+#include "local_transport.h"
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <format>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace cnc::local
+{
+	static constexpr std::size_t round_up(const std::size_t n, const std::size_t alignment)
+	{
+		return (n + alignment - 1) / alignment * alignment;
+	}
+
+	static constexpr std::size_t s_control_size = round_up(sizeof(ring_control), cache_line_size);
+	static constexpr std::size_t s_slot_size = round_up(max_packet_size, cache_line_size);
+
+	static std::system_error system_error(const char* what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+
+	std::size_t shared_frame_ring::memory_size(const u32 slot_count)
+	{
+		return s_control_size + slot_count * s_slot_size;
+	}
+
+	shared_frame_ring::shared_frame_ring(std::span<std::byte> memory, const u32 slot_count, const bool initialize) :
+		_slot_count(slot_count)
+	{
+		if (memory.size() < memory_size(slot_count))
+			throw std::runtime_error("Shared memory too small for the ring");
+
+		if (initialize)
+		{
+			_control = new (memory.data()) ring_control{};
+			_control->magic = ring_magic;
+			_control->slot_count = slot_count;
+			_control->slot_size = static_cast<u32>(s_slot_size);
+		}
+		else
+		{
+			_control = std::launder(reinterpret_cast<ring_control*>(memory.data()));
+			if (_control->magic != ring_magic || _control->slot_count != slot_count || _control->slot_size != s_slot_size)
+				throw std::runtime_error("Shared memory doesn't hold a compatible ring");
+		}
+
+		_slots = memory.data() + s_control_size;
+	}
+
+	bool shared_frame_ring::push(const protocol::frame_header& header, std::span<const std::byte> payload)
+	{
+		if (sizeof(header) + payload.size() > s_slot_size)
+			throw std::logic_error("Packet larger than a ring slot");
+
+		const auto head = _control->head.load(std::memory_order_relaxed);
+		const auto tail = _control->tail.load(std::memory_order_acquire);
+
+		if (head - tail >= _slot_count)
+			return false;
+
+		std::byte* slot = _slots + (head % _slot_count) * s_slot_size;
+		std::memcpy(slot, &header, sizeof(header));
+		std::memcpy(slot + sizeof(header), payload.data(), payload.size());
+
+		_control->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool shared_frame_ring::pop(protocol::frame_header& header, std::span<std::byte> payload)
+	{
+		const auto tail = _control->tail.load(std::memory_order_relaxed);
+		const auto head = _control->head.load(std::memory_order_acquire);
+
+		if (head == tail)
+			return false;
+
+		if (head - tail > _slot_count)
+			throw std::runtime_error("Corrupted ring indices");
+
+		const std::byte* slot = _slots + (tail % _slot_count) * s_slot_size;
+		std::memcpy(&header, slot, sizeof(header));
+
+		const std::size_t size = header.payload_size_in_bytes();
+		if (!header.is_valid() || size > payload.size() || sizeof(header) + size > s_slot_size)
+			throw std::runtime_error("Malformed packet in ring");
+
+		std::memcpy(payload.data(), slot + sizeof(header), size);
+
+		_control->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	void shared_frame_ring::discard(const std::size_t count)
+	{
+		const auto tail = _control->tail.load(std::memory_order_relaxed);
+		_control->tail.store(tail + std::min(count, size()), std::memory_order_release);
+	}
+
+	std::size_t shared_frame_ring::size() const
+	{
+		const auto head = _control->head.load(std::memory_order_acquire);
+		const auto tail = _control->tail.load(std::memory_order_acquire);
+		return static_cast<std::size_t>(std::min<std::uint64_t>(head - tail, _slot_count));
+	}
+
+	shared_memory_link::~shared_memory_link()
+	{
+		release();
+	}
+
+	shared_memory_link::shared_memory_link(shared_memory_link&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	shared_memory_link& shared_memory_link::operator=(shared_memory_link&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			_memory = std::exchange(other._memory, -1);
+			_upstream_event = std::exchange(other._upstream_event, -1);
+			_downstream_event = std::exchange(other._downstream_event, -1);
+			_mapping = std::exchange(other._mapping, nullptr);
+			_size = std::exchange(other._size, 0);
+			_upstream = std::exchange(other._upstream, {});
+			_downstream = std::exchange(other._downstream, {});
+		}
+		return *this;
+	}
+
+	void shared_memory_link::release()
+	{
+		if (_mapping)
+			munmap(_mapping, _size);
+
+		for (const int fd : { _memory, _upstream_event, _downstream_event })
+			if (fd >= 0)
+				close(fd);
+
+		_mapping = nullptr;
+		_memory = _upstream_event = _downstream_event = -1;
+	}
+
+	void shared_memory_link::map(const bool initialize)
+	{
+		const std::size_t ring_size = shared_frame_ring::memory_size(slot_count);
+		_size = 2 * ring_size;
+
+		void* mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _memory, 0);
+		if (mapping == MAP_FAILED)
+			throw system_error("mmap");
+
+		_mapping = static_cast<std::byte*>(mapping);
+		_upstream = shared_frame_ring(std::span(_mapping, ring_size), slot_count, initialize);
+		_downstream = shared_frame_ring(std::span(_mapping + ring_size, ring_size), slot_count, initialize);
+	}
+
+	shared_memory_link shared_memory_link::create()
+	{
+		shared_memory_link link;
+
+		link._memory = memfd_create("concordia", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (link._memory < 0)
+			throw system_error("memfd_create");
+
+		if (ftruncate(link._memory, 2 * shared_frame_ring::memory_size(slot_count)) != 0)
+			throw system_error("ftruncate");
+
+		// The server only maps memory that can't shrink under it
+		if (fcntl(link._memory, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+			throw system_error("F_ADD_SEALS");
+
+		link._upstream_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		link._downstream_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (link._upstream_event < 0 || link._downstream_event < 0)
+			throw system_error("eventfd");
+
+		link.map(true);
+		return link;
+	}
+
+	shared_memory_link shared_memory_link::adopt(const std::array<int, 3>& descriptors)
+	{
+		shared_memory_link link;
+		link._memory = descriptors[0];
+		link._upstream_event = descriptors[1];
+		link._downstream_event = descriptors[2];
+
+		// Mapping past the end of a file faults on access: the size must be right and stay so
+		struct stat info{};
+		const int seals = fcntl(link._memory, F_GET_SEALS);
+		if (fstat(link._memory, &info) != 0 || !S_ISREG(info.st_mode) || static_cast<std::size_t>(info.st_size) < 2 * shared_frame_ring::memory_size(slot_count) ||
+			seals < 0 || !(seals & F_SEAL_SHRINK))
+			throw std::runtime_error("The shared memory the client sent is unusable");
+
+		// signal() must never block the mixer
+		for (const int fd : { link._upstream_event, link._downstream_event })
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		link.map(false);
+		return link;
+	}
+
+	void signal(const int event)
+	{
+		const std::uint64_t one = 1;
+		[[maybe_unused]] const auto written = write(event, &one, sizeof(one));
+	}
+
+	bool wait(const int event, const std::chrono::milliseconds timeout)
+	{
+		pollfd fd{ .fd = event, .events = POLLIN, .revents = 0 };
+		if (poll(&fd, 1, static_cast<int>(timeout.count())) <= 0)
+			return false;
+
+		std::uint64_t value;
+		[[maybe_unused]] const auto read_bytes = read(event, &value, sizeof(value));
+		return true;
+	}
+
+	void send_hello(const int socket, const protocol::hello& hello, const std::array<int, 3>& descriptors)
+	{
+		iovec data{ .iov_base = const_cast<protocol::hello*>(&hello), .iov_len = sizeof(hello) };
+
+		alignas(cmsghdr) std::byte control[CMSG_SPACE(sizeof(descriptors))]{};
+		msghdr message{};
+		message.msg_iov = &data;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		cmsghdr* header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+		std::memcpy(CMSG_DATA(header), descriptors.data(), sizeof(descriptors));
+
+		if (sendmsg(socket, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(hello)))
+			throw system_error("sendmsg");
+	}
+
+	protocol::hello receive_hello(const int socket, std::array<int, 3>& descriptors)
+	{
+		protocol::hello hello;
+		iovec data{ .iov_base = &hello, .iov_len = sizeof(hello) };
+
+		alignas(cmsghdr) std::byte control[CMSG_SPACE(sizeof(descriptors))]{};
+		msghdr message{};
+		message.msg_iov = &data;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		const auto received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+
+		// Whatever came with it is ours to close, even if it's not what we expected
+		std::size_t count = 0;
+		for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+		{
+			if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			const std::size_t n = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				int fd;
+				std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+				if (count < descriptors.size())
+					descriptors[count] = fd;
+				else
+					close(fd);
+				count++;
+			}
+		}
+
+		if (received != static_cast<ssize_t>(sizeof(hello)) || count != descriptors.size() || (message.msg_flags & MSG_CTRUNC))
+		{
+			for (std::size_t i = 0; i < std::min(count, descriptors.size()); ++i)
+				close(descriptors[i]);
+			throw std::runtime_error("Local client didn't send a valid hello");
+		}
+
+		return hello;
+	}
+
+	local_connection::local_connection(const std::string& path, const protocol::hello& hello)
+	{
+		sockaddr_un address{ .sun_family = AF_UNIX, .sun_path = {} };
+		if (path.size() >= sizeof(address.sun_path))
+			throw std::runtime_error(std::format("Socket path too long: {}", path));
+		std::ranges::copy(path, address.sun_path);
+
+		_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (_socket < 0)
+			throw system_error("socket");
+
+		if (connect(_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			const auto error = system_error("connect");
+			close(_socket);
+			throw error;
+		}
+
+		try
+		{
+			_link = shared_memory_link::create();
+			send_hello(_socket, hello, _link.get_descriptors());
+		}
+		catch (...)
+		{
+			close(_socket);
+			throw;
+		}
+	}
+
+	local_connection::~local_connection()
+	{
+		if (_socket >= 0)
+			close(_socket);
+	}
+
+	bool local_connection::send(const protocol::frame_header& header, std::span<const std::byte> payload)
+	{
+		if (!_link.get_upstream().push(header, payload))
+			return false;
+
+		signal(_link.get_upstream_event());
+		return true;
+	}
+
+	bool local_connection::receive(protocol::frame_header& header, std::span<std::byte> payload, const std::chrono::milliseconds timeout)
+	{
+		if (_link.get_downstream().pop(header, payload))
+			return true;
+
+		// The server never writes to the socket, it only becomes readable when the server hangs up
+		std::array<pollfd, 2> fds{ {
+			{ .fd = _link.get_downstream_event(), .events = POLLIN, .revents = 0 },
+			{ .fd = _socket, .events = POLLIN, .revents = 0 },
+		} };
+
+		if (poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) <= 0)
+			return false;
+
+		if (fds[1].revents != 0)
+			throw std::runtime_error("Server closed the connection");
+
+		std::uint64_t value;
+		[[maybe_unused]] const auto read_bytes = read(_link.get_downstream_event(), &value, sizeof(value));
+
+		return _link.get_downstream().pop(header, payload);
+	}
+}
+
+#endif
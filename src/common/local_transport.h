@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <span>
+#include <string>
+
+#include "common.h"
+#include "protocol.h"
+
+// memfd, eventfd and descriptor passing over Unix sockets
+#if defined(__linux__)
+#define CNC_HAS_LOCAL_TRANSPORT 1
+#endif
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+
+namespace cnc::local
+{
+	/*
+		Transport for clients on the same host as the server. The client connects to the server's
+		Unix socket and sends its hello along with three descriptors: a shared memory block and
+		two eventfds. The memory holds one packet ring per direction, the eventfds wake up the
+		consumer of each. After that the socket only tells either side when the other one is gone.
+		Packets are the same as on TCP (frame_header + payload), without FEC.
+	*/
+
+	constexpr u32 ring_magic = 0x434e4352; // "CNCR"
+	constexpr std::size_t max_packet_size = sizeof(protocol::frame_header) + 48000 * audio_frame_duration_ms / 1000 * max_audio_channels * sizeof(sample_t);
+
+	struct ring_control
+	{
+		u32 magic;
+		u32 slot_count;
+		u32 slot_size;
+		u32 reserved;
+		alignas(cache_line_size) std::atomic<std::uint64_t> head; // Written by the producer
+		alignas(cache_line_size) std::atomic<std::uint64_t> tail; // Written by the consumer
+	};
+
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "The ring is shared between processes");
+
+	// Single producer, single consumer ring of whole packets, in memory shared with another
+	// process. That process isn't trusted: whatever it wrote is checked before it's used.
+	class shared_frame_ring
+	{
+	private:
+		ring_control* _control{ nullptr };
+		std::byte* _slots{ nullptr };
+		u32 _slot_count{ 0 };
+
+	public:
+		static std::size_t memory_size(const u32 slot_count);
+
+		shared_frame_ring() = default;
+
+		// Lays out a new ring if initialize is set, otherwise checks the existing one. Throws if the memory doesn't fit.
+		shared_frame_ring(std::span<std::byte> memory, const u32 slot_count, const bool initialize);
+
+		// Producer. False if the ring is full.
+		bool push(const protocol::frame_header& header, std::span<const std::byte> payload);
+
+		// Consumer. False if the ring is empty, throws if the packet is malformed.
+		bool pop(protocol::frame_header& header, std::span<std::byte> payload);
+
+		// Consumer. Drops the oldest packets.
+		void discard(const std::size_t count);
+
+		std::size_t size() const;
+	};
+
+	class shared_memory_link
+	{
+	private:
+		int _memory{ -1 };
+		int _upstream_event{ -1 };
+		int _downstream_event{ -1 };
+		std::byte* _mapping{ nullptr };
+		std::size_t _size{ 0 };
+
+		shared_frame_ring _upstream;	// Client to server
+		shared_frame_ring _downstream;	// Server to client
+
+		void map(const bool initialize);
+		void release();
+
+	public:
+		static constexpr u32 slot_count = 16;
+
+		shared_memory_link() = default;
+		~shared_memory_link();
+
+		shared_memory_link(const shared_memory_link&) = delete;
+		shared_memory_link& operator=(const shared_memory_link&) = delete;
+
+		shared_memory_link(shared_memory_link&& other) noexcept;
+		shared_memory_link& operator=(shared_memory_link&& other) noexcept;
+
+		// Client side, new memory and eventfds
+		static shared_memory_link create();
+
+		// Server side, takes ownership of the descriptors the client sent
+		static shared_memory_link adopt(const std::array<int, 3>& descriptors);
+
+		std::array<int, 3> get_descriptors() const { return { _memory, _upstream_event, _downstream_event }; }
+
+		shared_frame_ring& get_upstream() { return _upstream; }
+		shared_frame_ring& get_downstream() { return _downstream; }
+
+		int get_upstream_event() const { return _upstream_event; }
+		int get_downstream_event() const { return _downstream_event; }
+	};
+
+	// Wakes up whoever waits on the eventfd, never blocks
+	void signal(const int event);
+
+	// Waits until the eventfd is signaled or the timeout expires, false on timeout
+	bool wait(const int event, const std::chrono::milliseconds timeout);
+
+	// Hello plus descriptors over a connected Unix socket. receive_hello() throws if there's no valid hello.
+	void send_hello(const int socket, const protocol::hello& hello, const std::array<int, 3>& descriptors);
+	protocol::hello receive_hello(const int socket, std::array<int, 3>& descriptors);
+
+	// What a local client needs: connects, sends the hello and moves packets
+	class local_connection
+	{
+	private:
+		int _socket{ -1 };
+		shared_memory_link _link;
+
+	public:
+		local_connection(const std::string& path, const protocol::hello& hello);
+		~local_connection();
+
+		local_connection(const local_connection&) = delete;
+		local_connection& operator=(const local_connection&) = delete;
+
+		// False if the server didn't keep up and the ring is full
+		bool send(const protocol::frame_header& header, std::span<const std::byte> payload);
+
+		// False if nothing arrived within the timeout, throws if the server went away
+		bool receive(protocol::frame_header& header, std::span<std::byte> payload, const std::chrono::milliseconds timeout);
+	};
+}
+
+#endif
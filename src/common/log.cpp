@@ -1,9 +1,14 @@
 #include "log.h"
 
 #include "common.h"
+#include "ring_buffer.h"
 
-#include <iostream>
-#include <format>
+#include <cstdio>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace cnc::log
 {
@@ -13,9 +18,176 @@ namespace cnc::log
 		std::pair{ level::error,	"E" }
 	};
 
+	// Per site and second, a burst at startup fits but a message per frame doesn't
+	static constexpr std::uint32_t s_messages_per_second = 20;
 
-	void send_message(const std::string_view message, level lvl)
+	// Per thread, a few hundred messages
+	static constexpr std::size_t s_queue_size = 64 * 1024;
+
+	static constexpr auto s_drain_period = std::chrono::milliseconds(10);
+
+	struct thread_queue
+	{
+		spsc_ring_buffer<std::byte> records{ s_queue_size };
+		std::atomic<std::size_t> dropped{ 0 };
+		std::atomic_bool abandoned{ false };	// The thread is gone, freed once empty
+	};
+
+	/*
+		Owns every thread's queue and the thread that drains them. Producers only take the
+		lock once per thread, to hand over their queue.
+	*/
+	class logger
+	{
+	private:
+		std::mutex _queues_mutex;
+		std::vector<std::shared_ptr<thread_queue>> _queues;
+
+		std::mutex _drain_mutex;	// Held by whoever drains, the thread or a flush
+		std::string _batch;
+		std::vector<std::pair<std::chrono::steady_clock::rep, std::string>> _pending;
+
+		std::mutex _wake_mutex;
+		std::condition_variable _wake;
+		bool _stopping{ false };
+		std::thread _thread;
+
+		void run()
+		{
+			std::unique_lock lock(_wake_mutex);
+			while (!_stopping)
+			{
+				_wake.wait_for(lock, s_drain_period);
+				lock.unlock();
+				drain();
+				lock.lock();
+			}
+		}
+
+	public:
+		logger() : _thread([this] { run(); }) {}
+
+		~logger()
+		{
+			{
+				std::scoped_lock lock(_wake_mutex);
+				_stopping = true;
+			}
+			_wake.notify_one();
+			_thread.join();
+			drain();
+		}
+
+		std::shared_ptr<thread_queue> add_queue()
+		{
+			auto queue = std::make_shared<thread_queue>();
+			std::scoped_lock lock(_queues_mutex);
+			_queues.push_back(queue);
+			return queue;
+		}
+
+		void drain()
+		{
+			std::scoped_lock drain_lock(_drain_mutex);
+
+			std::vector<std::shared_ptr<thread_queue>> queues;
+			{
+				std::scoped_lock lock(_queues_mutex);
+				std::erase_if(_queues, [](const auto& q) { return q->abandoned && q->records.empty(); });
+				queues = _queues;
+			}
+
+			std::array<std::byte, max_record_size> record;
+
+			for (const auto& q : queues)
+			{
+				record_header header;
+				while (q->records.pop(std::span(record).first(sizeof(header))) == sizeof(header))
+				{
+					std::memcpy(&header, record.data(), sizeof(header));
+					const auto args = std::span(record).subspan(sizeof(header), header.size - sizeof(header));
+					q->records.pop(args);
+
+					std::string text = std::format("[{}] ", s_message_levels[header.origin->lvl]);
+					header.decode({ header.format, header.format_size }, args.data(), args.size(), text);
+					if (header.suppressed > 0)
+						std::format_to(std::back_inserter(text), " ({} more like it suppressed)", header.suppressed);
+
+					_pending.emplace_back(header.time, std::move(text));
+				}
+
+				if (const auto dropped = q->dropped.exchange(0); dropped > 0)
+					_pending.emplace_back(std::chrono::steady_clock::now().time_since_epoch().count(), std::format("[{}] {} messages dropped, a thread's log queue was full", s_message_levels[level::warning], dropped));
+			}
+
+			if (_pending.empty())
+				return;
+
+			// Each thread's messages are in order already, this interleaves the threads
+			std::ranges::stable_sort(_pending, {}, &std::pair<std::chrono::steady_clock::rep, std::string>::first);
+
+			_batch.clear();
+			for (const auto& [time, text] : _pending)
+			{
+				_batch += text;
+				_batch += '\n';
+			}
+			_pending.clear();
+
+			std::fwrite(_batch.data(), 1, _batch.size(), stdout);
+			std::fflush(stdout);
+		}
+	};
+
+	static logger& get_logger()
+	{
+		static logger s_logger;
+		return s_logger;
+	}
+
+	// Marks the queue abandoned when its thread exits
+	struct queue_handle
+	{
+		std::shared_ptr<thread_queue> queue = get_logger().add_queue();
+		~queue_handle() { queue->abandoned = true; }
+	};
+
+	bool admit(site& s, const std::chrono::steady_clock::time_point now, std::uint32_t& suppressed)
+	{
+		const auto second = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+
+		// Whoever moves the window on resets the count, racing threads may let a few more through
+		auto window = s.window.load(std::memory_order_relaxed);
+		if (window != second && s.window.compare_exchange_strong(window, second, std::memory_order_relaxed))
+			s.count.store(0, std::memory_order_relaxed);
+
+		if (s.count.fetch_add(1, std::memory_order_relaxed) >= s_messages_per_second)
+		{
+			s.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		suppressed = s.suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	void commit(std::span<const std::byte> record)
+	{
+		thread_local queue_handle t_handle;
+		auto& q = *t_handle.queue;
+
+		// Only this thread pushes, the space can only grow until the push
+		if (q.records.free_space() < record.size())
+		{
+			q.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		q.records.push(record);
+	}
+
+	void flush()
 	{
-		std::cout << std::format("[{}] {}", s_message_levels[lvl], message) << std::endl;
+		get_logger().drain();
 	}
-}
\ No newline at end of file
+}
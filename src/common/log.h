@@ -1,26 +1,228 @@
 #pragma once
 
 #include <string_view>
+#include <string>
+#include <format>
+#include <tuple>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <span>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
 
 namespace cnc::log
 {
-	enum class level
+	enum class level : std::uint8_t
 	{
 		info = 0,
 		warning = 1,
 		error = 2
 	};
 
-	void send_message(const std::string_view message, level lvl);
-	inline void info(const std::string_view message) { send_message(message, level::info); }
-	inline void warning(const std::string_view message) { send_message(message, level::warning); }
-	inline void error(const std::string_view message) { send_message(message, level::error); }
+	// One per call site, the macros declare it
+	struct site
+	{
+		level lvl;
+
+		// Rate limiting, see admit()
+		std::atomic<std::int64_t> window{ -1 };
+		std::atomic<std::uint32_t> count{ 0 };
+		std::atomic<std::uint32_t> suppressed{ 0 };
+
+		constexpr explicit site(const level l) : lvl(l) {}
+	};
+
+	// Turns the arguments stored after a record back into text, on the logging thread
+	using decoder = void(*)(std::string_view format, const std::byte* args, std::size_t size, std::string& out);
+
+	struct record_header
+	{
+		std::uint32_t size;			// Header included
+		std::uint32_t suppressed;	// Messages from the same site that were dropped before this one
+		const site* origin;
+		decoder decode;
+		const char* format;
+		std::uint32_t format_size;
+		std::chrono::steady_clock::rep time;
+	};
+
+	// Everything a record holds, header included. Longer strings are cut short.
+	constexpr std::size_t max_record_size = 1024;
+
+	/*
+		False once the site went over its share for the current second, the drop is counted
+		and reported with the next message that gets through: suppressed is set to how many
+		that message follows.
+	*/
+	bool admit(site& s, const std::chrono::steady_clock::time_point now, std::uint32_t& suppressed);
+
+	// Copies the record into the calling thread's queue, dropped if it's full
+	void commit(std::span<const std::byte> record);
+
+	namespace detail
+	{
+		template<typename T>
+		constexpr bool is_string_like = std::is_convertible_v<const T&, std::string_view>;
+
+		// Strings are copied into the record, everything else must be trivially copyable
+		template<typename T>
+		using stored_t = std::conditional_t<is_string_like<std::decay_t<T>>, std::string_view, std::decay_t<T>>;
+
+		class writer
+		{
+		private:
+			std::span<std::byte> _out;
+			std::size_t _used;
+
+		public:
+			writer(std::span<std::byte> out, const std::size_t used) : _out(out), _used(used) {}
+
+			template<typename T>
+			void put(const T& value)
+			{
+				if constexpr (is_string_like<T>)
+				{
+					const std::string_view text(value);
+					const auto room = _out.size() - _used;
+					const auto length = static_cast<std::uint32_t>(std::min(text.size(), room > sizeof(std::uint32_t) ? room - sizeof(std::uint32_t) : 0));
+
+					if (room < sizeof(std::uint32_t))
+						return;
+
+					std::memcpy(_out.data() + _used, &length, sizeof(length));
+					std::memcpy(_out.data() + _used + sizeof(length), text.data(), length);
+					_used += sizeof(length) + length;
+				}
+				else
+				{
+					static_assert(std::is_trivially_copyable_v<T>, "Format this argument at the call site");
+					if (_out.size() - _used < sizeof(T))
+						return;
+
+					std::memcpy(_out.data() + _used, &value, sizeof(T));
+					_used += sizeof(T);
+				}
+			}
+
+			std::size_t get_size() const { return _used; }
+		};
+
+		class reader
+		{
+		private:
+			const std::byte* _data;
+			std::size_t _size;
+			std::size_t _position{ 0 };
+
+		public:
+			reader(const std::byte* data, const std::size_t size) : _data(data), _size(size) {}
+
+			// What a record cut short didn't hold reads as 0 or empty
+			template<typename T>
+			T get()
+			{
+				if constexpr (std::is_same_v<T, std::string_view>)
+				{
+					std::uint32_t length = 0;
+					if (_size - _position < sizeof(length))
+						return {};
+
+					std::memcpy(&length, _data + _position, sizeof(length));
+					_position += sizeof(length);
+					const std::string_view text(reinterpret_cast<const char*>(_data + _position), length);
+					_position += length;
+					return text;
+				}
+				else
+				{
+					T value{};
+					if (_size - _position >= sizeof(T))
+						std::memcpy(&value, _data + _position, sizeof(T));
+					_position += sizeof(T);
+					return value;
+				}
+			}
+		};
+
+		template<typename... Args>
+		void decode(std::string_view format, const std::byte* args, const std::size_t size, std::string& out)
+		{
+			reader r(args, size);
+
+			// Braced, so the arguments are read in order
+			std::tuple<stored_t<Args>...> values{ r.get<stored_t<Args>>()... };
+
+			std::apply([&](auto&... v) { std::vformat_to(std::back_inserter(out), format, std::make_format_args(v...)); }, values);
+		}
+
+		// A message without arguments is taken as it is, braces and all
+		inline void decode_message(std::string_view, const std::byte* args, const std::size_t size, std::string& out)
+		{
+			reader r(args, size);
+			out += r.get<std::string_view>();
+		}
+
+		template<typename... Args>
+		void post(site& s, const decoder decode, const std::string_view format, const Args&... args)
+		{
+			const auto now = std::chrono::steady_clock::now();
+
+			std::uint32_t suppressed = 0;
+			if (!admit(s, now, suppressed))
+				return;
+
+			alignas(record_header) std::array<std::byte, max_record_size> record;
+			writer w(record, sizeof(record_header));
+			(w.put(args), ...);
+
+			const record_header header{
+				.size = static_cast<std::uint32_t>(w.get_size()),
+				.suppressed = suppressed,
+				.origin = &s,
+				.decode = decode,
+				.format = format.data(),
+				.format_size = static_cast<std::uint32_t>(format.size()),
+				.time = now.time_since_epoch().count()
+			};
+			std::memcpy(record.data(), &header, sizeof(header));
+
+			commit(std::span(record).first(header.size));
+		}
+	}
+
+	/*
+		Logging never waits. The caller only copies the format string's address and the
+		arguments into a queue of its own thread, and a background thread formats them and
+		writes them out in batches, every few milliseconds. Every site gets a share of
+		messages per second, so one in a hot loop can't flood the queue: what goes over is
+		dropped and counted. A full queue drops too.
+	*/
+	inline void message(site& s, const std::string_view text)
+	{
+		detail::post(s, &detail::decode_message, {}, text);
+	}
+
+	template<typename... Args>
+	void message(site& s, std::format_string<const Args&...> format, const Args&... args)
+	{
+		detail::post(s, &detail::decode<Args...>, format.get(), args...);
+	}
+
+	// Writes out what's queued before returning. Not for threads that mustn't wait.
+	void flush();
 }
 
+#define CNC_LOG(lvl, ...) do { static cnc::log::site s_cnc_log_site{ lvl }; cnc::log::message(s_cnc_log_site, __VA_ARGS__); } while (false)
+
 #ifdef DEBUG
-#define CNC_INFO(...) cnc::log::info(__VA_ARGS__)
-#define CNC_ERROR(...) cnc::log::error(__VA_ARGS__)
+#define CNC_INFO(...) CNC_LOG(cnc::log::level::info, __VA_ARGS__)
+#define CNC_ERROR(...) CNC_LOG(cnc::log::level::error, __VA_ARGS__)
 #else
-#define CNC_INFO(...)
-#define CNC_ERROR(...)
-#endif
\ No newline at end of file
+// Still a statement, so an if or an else with only a log in it isn't left empty
+#define CNC_INFO(...) do {} while (false)
+#define CNC_ERROR(...) do {} while (false)
+#endif
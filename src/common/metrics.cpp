@@ -0,0 +1,153 @@
+#include "metrics.h"
+
+#include <stdexcept>
+#include <format>
+#include <iterator>
+
+namespace cnc::metrics
+{
+	std::size_t assign_shard()
+	{
+		static std::atomic<std::size_t> s_next{ 0 };
+		return s_next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+	}
+
+	u64 counter::value() const
+	{
+		u64 total = 0;
+		for (const auto& s : _shards)
+			total += s.value.load(std::memory_order_relaxed);
+		return total;
+	}
+
+	u64 histogram_snapshot::upper_bound_of(const double quantile) const
+	{
+		const auto rank = static_cast<u64>(quantile * count + 0.5);
+		u64 seen = 0;
+
+		for (std::size_t i = 0; i < bounds.size(); ++i)
+		{
+			seen += counts[i];
+			if (seen >= rank)
+				return bounds[i];
+		}
+
+		return bounds.empty() ? 0 : bounds.back();
+	}
+
+	histogram::histogram(std::span<const u64> bounds) :
+		_bucket_count(bounds.size())
+	{
+		if (bounds.size() > max_histogram_buckets || !std::ranges::is_sorted(bounds))
+			throw std::invalid_argument("Histogram bounds must be sorted and fit in max_histogram_buckets");
+
+		std::ranges::copy(bounds, _bounds.begin());
+	}
+
+	histogram_snapshot histogram::snapshot() const
+	{
+		histogram_snapshot result;
+		result.bounds.assign(_bounds.begin(), _bounds.begin() + _bucket_count);
+		result.counts.resize(_bucket_count + 1);
+
+		for (const auto& s : _shards)
+		{
+			for (std::size_t i = 0; i < result.counts.size(); ++i)
+				result.counts[i] += s.counts[i].load(std::memory_order_relaxed);
+			result.sum += s.sum.load(std::memory_order_relaxed);
+		}
+
+		for (const auto c : result.counts)
+			result.count += c;
+
+		return result;
+	}
+
+	void registry::insert(series&& s)
+	{
+		_series.use([&](std::vector<series>& all) {
+			const auto it = std::ranges::upper_bound(all, s.name, {}, &series::name);
+			all.insert(it, std::move(s));
+		});
+	}
+
+	counter& registry::add_counter(std::string name, std::string help, std::string labels)
+	{
+		auto metric = std::make_unique<counter>();
+		auto& result = *metric;
+		insert({ std::move(name), std::move(help), std::move(labels), std::move(metric) });
+		return result;
+	}
+
+	gauge& registry::add_gauge(std::string name, std::string help, std::string labels)
+	{
+		auto metric = std::make_unique<gauge>();
+		auto& result = *metric;
+		insert({ std::move(name), std::move(help), std::move(labels), std::move(metric) });
+		return result;
+	}
+
+	histogram& registry::add_histogram(std::string name, std::string help, std::span<const u64> bounds, std::string labels)
+	{
+		auto metric = std::make_unique<histogram>(bounds);
+		auto& result = *metric;
+		insert({ std::move(name), std::move(help), std::move(labels), std::move(metric) });
+		return result;
+	}
+
+	void registry::remove(const void* metric)
+	{
+		_series.use([&](std::vector<series>& all) {
+			std::erase_if(all, [&](const series& s) { return s.get_address() == metric; });
+		});
+	}
+
+	std::string to_text(registry& r)
+	{
+		std::string out;
+		auto it = std::back_inserter(out);
+		const std::string* previous_name = nullptr;
+
+		static constexpr std::array<const char*, 3> s_type_names = { "counter", "gauge", "histogram" };
+
+		r.visit([&](const series& s) {
+			if (!previous_name || *previous_name != s.name)
+			{
+				std::format_to(it, "# HELP {} {}\n# TYPE {} {}\n", s.name, s.help, s.name, s_type_names[s.metric.index()]);
+				previous_name = &s.name;
+			}
+
+			const auto braced = s.labels.empty() ? std::string{} : std::format("{{{}}}", s.labels);
+
+			switch (s.get_type())
+			{
+			case metric_type::counter:
+				std::format_to(it, "{}{} {}\n", s.name, braced, std::get<0>(s.metric)->value());
+				break;
+
+			case metric_type::gauge:
+				std::format_to(it, "{}{} {}\n", s.name, braced, std::get<1>(s.metric)->value());
+				break;
+
+			case metric_type::histogram:
+			{
+				const auto snapshot = std::get<2>(s.metric)->snapshot();
+				const auto separator = s.labels.empty() ? "" : ",";
+
+				u64 cumulative = 0;
+				for (std::size_t i = 0; i < snapshot.bounds.size(); ++i)
+				{
+					cumulative += snapshot.counts[i];
+					std::format_to(it, "{}_bucket{{{}{}le=\"{}\"}} {}\n", s.name, s.labels, separator, snapshot.bounds[i], cumulative);
+				}
+
+				std::format_to(it, "{}_bucket{{{}{}le=\"+Inf\"}} {}\n", s.name, s.labels, separator, snapshot.count);
+				std::format_to(it, "{}_sum{} {}\n{}_count{} {}\n", s.name, braced, snapshot.sum, s.name, braced, snapshot.count);
+				break;
+			}
+			}
+		});
+
+		return out;
+	}
+}
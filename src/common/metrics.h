@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <span>
+#include <memory>
+#include <variant>
+#include <chrono>
+#include <algorithm>
+
+#include "common.h"
+
+namespace cnc::metrics
+{
+	using u64 = std::uint64_t;
+	using i64 = std::int64_t;
+
+	// Threads are spread over the shards round robin, past that many they share
+	constexpr std::size_t shard_count = 8;
+
+	// Doesn't count the overflow bucket
+	constexpr std::size_t max_histogram_buckets = 24;
+
+	std::size_t assign_shard();
+
+	// The calling thread's shard, picked on its first use
+	inline std::size_t current_shard()
+	{
+		thread_local const std::size_t shard = assign_shard();
+		return shard;
+	}
+
+	/*
+		Only goes up. Every thread adds to its own cache line with a relaxed atomic, so
+		recording is a handful of cycles and never waits; reading sums the shards.
+	*/
+	class counter
+	{
+	private:
+		struct alignas(cache_line_size) shard
+		{
+			std::atomic<u64> value{ 0 };
+		};
+
+		std::array<shard, shard_count> _shards{};
+
+	public:
+		void add(const u64 n = 1) { _shards[current_shard()].value.fetch_add(n, std::memory_order_relaxed); }
+
+		// A sum of relaxed loads, good enough for anything that looks at it twice
+		u64 value() const;
+	};
+
+	// A level that's set rather than accumulated, a single atomic is all it takes
+	class gauge
+	{
+	private:
+		std::atomic<i64> _value{ 0 };
+
+	public:
+		void set(const i64 v) { _value.store(v, std::memory_order_relaxed); }
+		void add(const i64 n) { _value.fetch_add(n, std::memory_order_relaxed); }
+
+		i64 value() const { return _value.load(std::memory_order_relaxed); }
+	};
+
+	struct histogram_snapshot
+	{
+		std::vector<u64> bounds;	// Inclusive upper bounds
+		std::vector<u64> counts;	// One per bound plus the overflow, not cumulative
+		u64 sum{ 0 };
+		u64 count{ 0 };
+
+		// The bound of the bucket the quantile falls in, the highest bound if that's the overflow
+		u64 upper_bound_of(const double quantile) const;
+	};
+
+	/*
+		Fixed buckets over integer values, microseconds for times. A bucket holds what's no
+		more than its bound and greater than the one before, the last one everything past
+		the highest bound. Sharded like the counter.
+	*/
+	class histogram
+	{
+	private:
+		struct alignas(cache_line_size) shard
+		{
+			std::array<std::atomic<u64>, max_histogram_buckets + 1> counts{};
+			std::atomic<u64> sum{ 0 };
+		};
+
+		std::array<u64, max_histogram_buckets> _bounds{};
+		std::size_t _bucket_count;
+		std::array<shard, shard_count> _shards{};
+
+	public:
+		// Sorted, at most max_histogram_buckets of them, throws otherwise
+		explicit histogram(std::span<const u64> bounds);
+
+		void record(const u64 value)
+		{
+			const auto bounds = std::span(_bounds).first(_bucket_count);
+			const auto bucket = static_cast<std::size_t>(std::ranges::lower_bound(bounds, value) - bounds.begin());
+
+			auto& s = _shards[current_shard()];
+			s.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+			s.sum.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		histogram_snapshot snapshot() const;
+	};
+
+	// 50 us to 250 ms, for what has to fit in a frame and what blew through it
+	constexpr std::array<u64, 14> latency_bounds_us = { 50, 100, 250, 500, 1000, 2000, 4000, 8000, 16000, 32000, 48000, 64000, 100000, 250000 };
+
+	// Records how long it lived, in microseconds
+	class scoped_timer
+	{
+	private:
+		histogram& _histogram;
+		std::chrono::steady_clock::time_point _start;
+
+	public:
+		explicit scoped_timer(histogram& h) : _histogram(h), _start(std::chrono::steady_clock::now()) {}
+		~scoped_timer()
+		{
+			_histogram.record(static_cast<u64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count()));
+		}
+
+		scoped_timer(const scoped_timer&) = delete;
+		scoped_timer& operator=(const scoped_timer&) = delete;
+	};
+
+	enum class metric_type
+	{
+		counter, gauge, histogram
+	};
+
+	struct series
+	{
+		std::string name;
+		std::string help;
+		std::string labels;		// Already in exposition form, client="3",room="1"
+		std::variant<std::unique_ptr<counter>, std::unique_ptr<gauge>, std::unique_ptr<histogram>> metric;
+
+		metric_type get_type() const { return static_cast<metric_type>(metric.index()); }
+		const void* get_address() const { return std::visit([](const auto& m) -> const void* { return m.get(); }, metric); }
+	};
+
+	/*
+		Owns the metrics and the names they're exported under. Adding, removing and visiting
+		take a lock, recording never touches the registry: hold on to the reference. A metric
+		has to be removed before whatever records to it is gone, never while it still might.
+	*/
+	class registry
+	{
+	private:
+		exclusive_resource<std::vector<series>> _series;
+
+		void insert(series&& s);
+
+	public:
+		counter& add_counter(std::string name, std::string help, std::string labels = {});
+		gauge& add_gauge(std::string name, std::string help, std::string labels = {});
+		histogram& add_histogram(std::string name, std::string help, std::span<const u64> bounds, std::string labels = {});
+
+		void remove(const void* metric);
+
+		// Ordered by name, series with the same name next to each other
+		template<typename Function> requires requires(Function f, const series& s) { f(s); }
+		void visit(Function&& f)
+		{
+			_series.use([&](const std::vector<series>& all) {
+				for (const auto& s : all)
+					f(s);
+			});
+		}
+	};
+
+	// The Prometheus text format, times stay in the unit they were recorded in
+	std::string to_text(registry& r);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+
+namespace cnc::protocol
+{
+	constexpr u32 magic = 0x434e4331; // "CNC1"
+	constexpr u32 version = 2;
+
+	// Sent once by the client right after connecting. The settings apply to both directions.
+	struct hello
+	{
+		u32 magic{ protocol::magic };
+		u32 version{ protocol::version };
+		u32 sample_rate{};
+		u32 channels{};
+		u32 fec_group_size{ 0 }; // Frames per parity packet, 0 for no FEC
+
+		audio_format get_format() const { return { sample_rate, channels }; }
+	};
+
+	enum class packet_kind : u8
+	{
+		audio = 0,
+		parity = 1
+	};
+
+	// Precedes every packet, in both directions. The payload is frame_length * channels samples.
+	// For parity packets the sequence is the first one of the group.
+	struct frame_header
+	{
+		u32 sequence{};
+		u32 sample_rate{};
+		u16 channels{};
+		u16 frame_length{};
+		packet_kind kind{ packet_kind::audio };
+		u8 reserved[3]{};
+
+		audio_format get_format() const { return { sample_rate, channels }; }
+		std::size_t payload_size_in_bytes() const { return std::size_t{ frame_length } * channels * sizeof(sample_t); }
+		bool is_valid() const
+		{
+			return get_format().is_supported() && frame_length == get_format().frame_length() && (kind == packet_kind::audio || kind == packet_kind::parity);
+		}
+	};
+
+	inline frame_header make_frame_header(const u32 sequence, const audio_format& fmt, const packet_kind kind = packet_kind::audio)
+	{
+		return { sequence, fmt.sample_rate, static_cast<u16>(fmt.channels), static_cast<u16>(fmt.frame_length()), kind };
+	}
+
+	static_assert(sizeof(hello) == 20);
+	static_assert(sizeof(frame_header) == 16);
+}
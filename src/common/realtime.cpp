@@ -0,0 +1,153 @@
+#include "realtime.h"
+
+#include <format>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace cnc::realtime
+{
+	std::optional<scheduling> parse_scheduling(std::string_view name)
+	{
+		if (name == "normal" || name == "other")
+			return scheduling::normal;
+		if (name == "fifo")
+			return scheduling::fifo;
+		if (name == "rr" || name == "round_robin")
+			return scheduling::round_robin;
+		return std::nullopt;
+	}
+
+	static constexpr std::size_t s_page_size = 4096;
+
+	void prefault_stack(const std::size_t bytes)
+	{
+		volatile std::byte chunk[16 * 1024];
+		for (std::size_t i = 0; i < sizeof(chunk); i += s_page_size)
+			chunk[i] = std::byte{ 0 };
+
+		if (bytes > sizeof(chunk))
+			prefault_stack(bytes - sizeof(chunk));
+
+		// Used after the call, so it can't become a jump that reuses this frame
+		chunk[0] = chunk[0];
+	}
+
+#ifdef __linux__
+
+	static const char* policy_name(const int policy)
+	{
+		switch (policy)
+		{
+		case SCHED_FIFO: return "SCHED_FIFO";
+		case SCHED_RR: return "SCHED_RR";
+		case SCHED_OTHER: return "SCHED_OTHER";
+		default: return "unknown";
+		}
+	}
+
+	std::string configure_current_thread(std::string_view name, const thread_config& config)
+	{
+		std::string failures;
+		const auto self = pthread_self();
+
+		// CPU_SET doesn't check, past the end of the set it writes over the stack
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+		if (config.cpu >= CPU_SETSIZE || (online > 0 && config.cpu >= online))
+		{
+			failures += std::format(", can't pin to cpu {} ({} online)", config.cpu, online);
+		}
+		else if (config.cpu >= 0)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(config.cpu, &set);
+			if (const int error = pthread_setaffinity_np(self, sizeof(set), &set); error != 0)
+				failures += std::format(", pinning to cpu {} failed ({})", config.cpu, std::strerror(error));
+		}
+
+		if (config.policy != scheduling::normal)
+		{
+			const int policy = config.policy == scheduling::fifo ? SCHED_FIFO : SCHED_RR;
+			sched_param param{};
+			param.sched_priority = std::clamp(config.priority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+
+			if (const int error = pthread_setschedparam(self, policy, &param); error != 0)
+			{
+				rlimit limit{};
+				getrlimit(RLIMIT_RTPRIO, &limit);
+				failures += std::format(", {} {} failed ({}, RLIMIT_RTPRIO is {})", policy_name(policy), param.sched_priority, std::strerror(error), limit.rlim_cur);
+			}
+		}
+
+		// What we ended up with, whatever was asked
+		std::string cpus;
+		if (cpu_set_t set; pthread_getaffinity_np(self, sizeof(set), &set) == 0)
+		{
+			const int count = CPU_COUNT(&set);
+			if (config.cpu < 0 && count == sysconf(_SC_NPROCESSORS_ONLN))
+			{
+				cpus = "any cpu";
+			}
+			else
+			{
+				cpus = count == 1 ? "cpu" : "cpus";
+				for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+					if (CPU_ISSET(cpu, &set))
+						cpus += std::format(" {}", cpu);
+			}
+		}
+
+		int policy = SCHED_OTHER;
+		sched_param param{};
+		pthread_getschedparam(self, &policy, &param);
+
+		return std::format("{} thread: {}, {} priority {}{}", name, cpus, policy_name(policy), param.sched_priority, failures);
+	}
+
+	std::string lock_memory()
+	{
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		{
+			rlimit limit{};
+			getrlimit(RLIMIT_MEMLOCK, &limit);
+			return std::format("Memory lock failed ({}, RLIMIT_MEMLOCK is {} bytes)", std::strerror(errno), limit.rlim_cur);
+		}
+
+#ifdef __GLIBC__
+		// Freed memory stays in the heap, already locked, and big blocks don't get their own mapping
+		mallopt(M_TRIM_THRESHOLD, -1);
+		mallopt(M_MMAP_MAX, 0);
+#endif
+
+		return "Memory locked";
+	}
+
+#else
+
+	std::string configure_current_thread(std::string_view name, const thread_config& config)
+	{
+		if (config.cpu >= 0 || config.policy != scheduling::normal)
+			return std::format("{} thread: affinity and real-time scheduling aren't supported on this platform", name);
+		return std::format("{} thread: default scheduling", name);
+	}
+
+	std::string lock_memory()
+	{
+		return "Memory locking isn't supported on this platform";
+	}
+
+#endif
+}
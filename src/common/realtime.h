@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <cstddef>
+
+namespace cnc::realtime
+{
+	enum class scheduling
+	{
+		normal, fifo, round_robin
+	};
+
+	struct thread_config
+	{
+		int cpu{ -1 }; // -1 lets the thread migrate
+		scheduling policy{ scheduling::normal };
+		int priority{ 0 }; // 1 to 99, only used by fifo and round_robin
+	};
+
+	std::optional<scheduling> parse_scheduling(std::string_view name);
+
+	// Applies to the calling thread and reads back what the kernel actually did. The result
+	// is one line for the startup report, failures included: they're never fatal.
+	std::string configure_current_thread(std::string_view name, const thread_config& config);
+
+	// Locks current and future pages and keeps freed heap memory around, so the audio path
+	// never waits for a page to come back or be faulted in. Also a report line. The buffers on
+	// that path are filled with zeros when they're allocated, that's all the faulting they need.
+	std::string lock_memory();
+
+	// Touches the calling thread's stack down to the given depth, so the first deep call doesn't fault
+	void prefault_stack(const std::size_t bytes = 256 * 1024);
+}
@@ -0,0 +1,84 @@
+#include "resampler.h"
+#include "dsp.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace cnc
+{
+	static constexpr float s_i16_scale = static_cast<float>(std::numeric_limits<i16>::max());
+
+	void downmix_to_float(std::span<const sample_t> input, const u32 channels, std::span<float> output)
+	{
+		if (channels == 1)
+			return dsp::to_float(input.first(output.size()), output);
+		if (channels == 2)
+			return dsp::deinterleave_to_mono(input, output);
+
+		const float scale = 1.0f / (s_i16_scale * channels);
+		for (std::size_t i = 0; i < output.size(); ++i)
+		{
+			float acc = 0.0f;
+			for (u32 c = 0; c < channels; ++c)
+				acc += input[i * channels + c];
+			output[i] = acc * scale;
+		}
+	}
+
+	void upmix_from_float(std::span<const float> input, const u32 channels, std::span<sample_t> output)
+	{
+		if (channels == 1)
+			return dsp::to_int16(input, output);
+		if (channels == 2)
+			return dsp::interleave_from_mono(input, output);
+
+		for (std::size_t i = 0; i < input.size(); ++i)
+		{
+			const auto s = static_cast<sample_t>(std::clamp(input[i] * s_i16_scale, -s_i16_scale - 1.0f, s_i16_scale));
+			for (u32 c = 0; c < channels; ++c)
+				output[i * channels + c] = s;
+		}
+	}
+
+	void resampler::process(std::span<const float> input, std::span<float> output)
+	{
+		if (input.empty() || output.empty())
+			return;
+
+		if (input.size() == output.size())
+		{
+			std::ranges::copy(input, output.begin());
+		}
+		else if (input.size() < output.size())
+		{
+			// Upsampling: linear interpolation, where position -1 is the last sample of the previous frame
+			const double step = static_cast<double>(input.size()) / output.size();
+			for (std::size_t j = 0; j < output.size(); ++j)
+			{
+				const double x = (j + 1) * step - 1.0;
+				const auto i = static_cast<std::ptrdiff_t>(std::floor(x));
+				const float t = static_cast<float>(x - i);
+				const float a = i < 0 ? _last : input[i];
+				const float b = static_cast<std::size_t>(i + 1) < input.size() ? input[i + 1] : input[i];
+				output[j] = a + (b - a) * t;
+			}
+		}
+		else
+		{
+			// Downsampling: box filter over the input samples covered by each output sample
+			std::size_t k = 0;
+			for (std::size_t j = 0; j < output.size(); ++j)
+			{
+				const std::size_t end = (j + 1) * input.size() / output.size();
+				float acc = 0.0f;
+				const std::size_t count = end - k;
+				for (; k < end; ++k)
+					acc += input[k];
+				output[j] = acc / count;
+			}
+		}
+
+		_last = input.back();
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+
+#include "common.h"
+
+namespace cnc
+{
+	// Interleaved i16 -> mono float in [-1, 1], channels are averaged
+	void downmix_to_float(std::span<const sample_t> input, const u32 channels, std::span<float> output);
+
+	// Mono float -> interleaved i16, saturating
+	void upmix_from_float(std::span<const float> input, const u32 channels, std::span<sample_t> output);
+
+	// Streaming mono resampler for whole frames. Keeps the last input sample around
+	// so consecutive frames are interpolated without seams.
+	class resampler
+	{
+	private:
+		u32 _from_rate{}, _to_rate{};
+		float _last{ 0.0f };
+	public:
+		resampler() = default;
+		resampler(const u32 from_rate, const u32 to_rate) : _from_rate(from_rate), _to_rate(to_rate) {}
+
+		u32 get_from_rate() const { return _from_rate; }
+		u32 get_to_rate() const { return _to_rate; }
+
+		void process(std::span<const float> input, std::span<float> output);
+	};
+}
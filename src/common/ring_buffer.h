@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <bit>
+#include <type_traits>
+
+#include "common.h"
+
+namespace cnc
+{
+	/*
+		Wait-free ring buffer for exactly one producer thread and one consumer thread.
+		Storage is allocated once, in the constructor; push and pop never block or allocate
+		and copy at most two contiguous segments.
+	*/
+	template<typename T> requires std::is_trivially_copyable_v<T>
+	class spsc_ring_buffer
+	{
+	private:
+		std::vector<T> _buffer;
+		std::size_t _mask;
+
+		// Monotonic counters, the index in the buffer is counter & _mask
+		alignas(cache_line_size) std::atomic<std::size_t> _head{ 0 }; // Written by the producer
+		alignas(cache_line_size) std::atomic<std::size_t> _tail{ 0 }; // Written by the consumer
+
+	public:
+		using value_type = T;
+
+		// The capacity is rounded up to a power of two
+		explicit spsc_ring_buffer(const std::size_t min_capacity) :
+			_buffer(std::bit_ceil(std::max<std::size_t>(min_capacity, 1))),
+			_mask(_buffer.size() - 1)
+		{
+		}
+
+		spsc_ring_buffer(const spsc_ring_buffer&) = delete;
+		spsc_ring_buffer& operator=(const spsc_ring_buffer&) = delete;
+
+		std::size_t capacity() const { return _buffer.size(); }
+
+		// Exact when called from either end, a snapshot otherwise
+		std::size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+		std::size_t free_space() const { return capacity() - size(); }
+		bool empty() const { return size() == 0; }
+
+		// Producer side. Pushes as many elements as fit and returns that number.
+		std::size_t push(std::span<const T> items)
+		{
+			const auto head = _head.load(std::memory_order_relaxed);
+			const auto tail = _tail.load(std::memory_order_acquire);
+			const auto count = std::min(items.size(), capacity() - (head - tail));
+
+			const auto start = head & _mask;
+			const auto first = std::min(count, capacity() - start);
+			std::copy_n(items.data(), first, _buffer.data() + start);
+			std::copy_n(items.data() + first, count - first, _buffer.data());
+
+			_head.store(head + count, std::memory_order_release);
+			return count;
+		}
+
+		// Consumer side. Pops up to items.size() elements and returns that number.
+		std::size_t pop(std::span<T> items)
+		{
+			const auto tail = _tail.load(std::memory_order_relaxed);
+			const auto head = _head.load(std::memory_order_acquire);
+			const auto count = std::min(items.size(), head - tail);
+
+			const auto start = tail & _mask;
+			const auto first = std::min(count, capacity() - start);
+			std::copy_n(_buffer.data() + start, first, items.data());
+			std::copy_n(_buffer.data(), count - first, items.data() + first);
+
+			_tail.store(tail + count, std::memory_order_release);
+			return count;
+		}
+	};
+}
@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <format>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <process.h>
+#define CNC_GETPID _getpid
+#else
+#include <unistd.h>
+#define CNC_GETPID getpid
+#endif
+
+#include "ring_buffer.h"
+
+namespace cnc::trace
+{
+	std::atomic_bool g_enabled{ false };
+
+	// Per thread, about 15 seconds of everything the client or a busy server thread records
+	static constexpr std::size_t s_buffer_events = 1 << 16;
+
+	struct thread_buffer
+	{
+		spsc_ring_buffer<event> events{ s_buffer_events };
+		std::atomic<std::size_t> dropped{ 0 };
+		std::string name;
+		std::uint32_t tid;
+	};
+
+	static std::mutex s_mutex;
+	static std::vector<std::shared_ptr<thread_buffer>> s_buffers;
+	static std::string s_process_name;
+	static std::uint32_t s_next_tid{ 1 };
+
+	struct thread_state
+	{
+		std::string name;
+		std::shared_ptr<thread_buffer> buffer;
+	};
+
+	static thread_state& get_thread_state()
+	{
+		thread_local thread_state t_state;
+		return t_state;
+	}
+
+	void record(const event& e)
+	{
+		auto& state = get_thread_state();
+
+		// The first event of the thread registers its buffer
+		if (!state.buffer)
+		{
+			auto buffer = std::make_shared<thread_buffer>();
+			buffer->name = state.name;
+
+			std::scoped_lock lock(s_mutex);
+			buffer->tid = s_next_tid++;
+			s_buffers.push_back(buffer);
+			state.buffer = std::move(buffer);
+		}
+
+		if (state.buffer->events.push({ &e, 1 }) == 0)
+			state.buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void enable(std::string_view process_name)
+	{
+		{
+			std::scoped_lock lock(s_mutex);
+			s_process_name = process_name;
+		}
+		g_enabled = true;
+	}
+
+	void set_thread_name(std::string_view name)
+	{
+		auto& state = get_thread_state();
+		state.name = name;
+
+		if (state.buffer)
+		{
+			std::scoped_lock lock(s_mutex);
+			state.buffer->name = name;
+		}
+	}
+
+	// Only what the names and the metadata need
+	static std::string escape(std::string_view text)
+	{
+		std::string result;
+		for (const char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+			if (static_cast<unsigned char>(c) >= 0x20)
+				result += c;
+		}
+		return result;
+	}
+
+	bool write(const std::filesystem::path& path)
+	{
+		g_enabled = false;
+
+		std::scoped_lock lock(s_mutex);
+
+		const auto pid = static_cast<std::uint32_t>(CNC_GETPID());
+		std::string out = "[\n";
+
+		std::format_to(std::back_inserter(out), "{{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":{},\"tid\":0,\"args\":{{\"name\":\"{}\"}}}}", pid, escape(s_process_name));
+
+		std::vector<event> events(s_buffer_events);
+
+		for (const auto& b : s_buffers)
+		{
+			const auto name = b->name.empty() ? std::format("Thread {}", b->tid) : b->name;
+			std::format_to(std::back_inserter(out), ",\n{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", pid, b->tid, escape(name));
+
+			if (const auto dropped = b->dropped.exchange(0); dropped > 0)
+				std::format_to(std::back_inserter(out), ",\n{{\"ph\":\"M\",\"name\":\"dropped_events\",\"pid\":{},\"tid\":{},\"args\":{{\"count\":{}}}}}", pid, b->tid, dropped);
+
+			const auto count = b->events.pop(events);
+
+			for (const auto& e : std::span(events).first(count))
+			{
+				// Microseconds with the nanoseconds kept as a fraction
+				std::format_to(std::back_inserter(out), ",\n{{\"ph\":\"{}\",\"name\":\"{}\",\"pid\":{},\"tid\":{},\"ts\":{}.{:03}", static_cast<char>(e.ph), e.name, pid, b->tid, e.time_ns / 1000, e.time_ns % 1000);
+
+				if (e.ph == phase::complete)
+					std::format_to(std::back_inserter(out), ",\"dur\":{}.{:03}", e.duration_ns / 1000, e.duration_ns % 1000);
+				else if (e.ph == phase::instant)
+					out += ",\"s\":\"t\"";
+
+				if (e.ph == phase::counter)
+					std::format_to(std::back_inserter(out), ",\"args\":{{\"value\":{}}}}}", e.frame);
+				else if (e.client != 0)
+					std::format_to(std::back_inserter(out), ",\"args\":{{\"frame\":{},\"client\":{}}}}}", e.frame, e.client);
+				else
+					std::format_to(std::back_inserter(out), ",\"args\":{{\"frame\":{}}}}}", e.frame);
+			}
+		}
+
+		out += "\n]\n";
+
+		// Threads that are gone have nothing left to give
+		std::erase_if(s_buffers, [](const auto& b) { return b.use_count() == 1; });
+
+		std::ofstream os(path, std::ios::binary | std::ios::trunc);
+		os << out;
+		return os.good();
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <filesystem>
+#include <cstdint>
+
+namespace cnc::trace
+{
+	enum class phase : char
+	{
+		complete = 'X',
+		instant = 'i',
+		counter = 'C'
+	};
+
+	// Names must be string literals, only the pointer is kept
+	struct event
+	{
+		const char* name;
+		std::int64_t time_ns;		// System clock, so traces from different processes line up
+		std::int64_t duration_ns;
+		std::uint64_t frame;		// The sequence number on the link the event is about, the value of a counter
+		std::uint32_t client;		// 0 when it isn't about one client
+		phase ph;
+	};
+
+	extern std::atomic_bool g_enabled;
+
+	inline bool is_enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+	inline std::int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	// Into the calling thread's buffer, dropped if it's full
+	void record(const event& e);
+
+	/*
+		Starts recording. Every thread gets a buffer of its own the first time it records, so
+		recording is a copy into memory nobody else writes. When tracing is off, every call
+		below costs a relaxed load.
+
+		The files are JSON arrays of trace events with system clock timestamps: the client's
+		and the server's can be merged (jq -s add client.json server.json) and opened in
+		Perfetto or chrome://tracing as one timeline. A frame is followed by its sequence
+		number: the client's on the way up, the server's for that client on the way down.
+	*/
+	void enable(std::string_view process_name);
+
+	// Stops recording and writes what was recorded as Chrome/Perfetto JSON, false on failure
+	bool write(const std::filesystem::path& path);
+
+	// Shown instead of the thread id, the calling thread's
+	void set_thread_name(std::string_view name);
+
+	inline void instant(const char* name, const std::uint64_t frame, const std::uint32_t client = 0)
+	{
+		if (is_enabled())
+			record({ name, now_ns(), 0, frame, client, phase::instant });
+	}
+
+	inline void counter(const char* name, const std::uint64_t value)
+	{
+		if (is_enabled())
+			record({ name, now_ns(), 0, value, 0, phase::counter });
+	}
+
+	// A complete event from construction to destruction
+	class scope
+	{
+	private:
+		const char* _name;
+		std::uint64_t _frame;
+		std::uint32_t _client;
+		std::int64_t _start;
+
+	public:
+		scope(const char* name, const std::uint64_t frame, const std::uint32_t client = 0) :
+			_name(name), _frame(frame), _client(client), _start(is_enabled() ? now_ns() : 0) {}
+
+		~scope()
+		{
+			if (_start != 0 && is_enabled())
+				record({ _name, _start, now_ns() - _start, _frame, _client, phase::complete });
+		}
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+	};
+}
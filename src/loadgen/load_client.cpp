@@ -0,0 +1,355 @@
+#include "load_client.h"
+
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <algorithm>
+
+namespace cnc
+{
+	static constexpr std::size_t s_speech_frames = 4000 / audio_frame_duration_ms;
+	static constexpr float s_burst_frequency = 3000.0f;
+
+	// Amplitude at the burst's frequency, as a fraction of full scale. The burst arrives at 0.1
+	// and up whatever the AGC did to it, speaker switches stay around 0.03.
+	static constexpr float s_burst_threshold = 0.06f;
+	static constexpr std::size_t s_quiet_frames_to_arm = 2;
+	static constexpr std::size_t s_window_ms = 4;
+
+	load_source::load_source(const audio_format& format) :
+		_format(format),
+		_burst(format.samples_per_frame() * burst_frames),
+		_silence(format.samples_per_frame(), 0)
+	{
+		constexpr float two_pi = 2.0f * std::numbers::pi_v<float>;
+		const float rate = static_cast<float>(format.sample_rate);
+
+		// A voice at a few pitches: harmonics falling off as 1/k, some vibrato, syllables and pauses
+		for (const float f0 : { 110.0f, 150.0f, 210.0f })
+		{
+			auto& table = _speech.emplace_back(format.samples_per_frame() * s_speech_frames);
+			float phase = 0.0f;
+
+			for (std::size_t i = 0; i < table.size() / format.channels; ++i)
+			{
+				const float t = i / rate;
+				// Both envelopes are smooth, edges would leak into the band the listeners watch
+				const float syllable = std::max(0.0f, std::sin(two_pi * 3.7f * t));
+				const float gate = std::clamp((std::sin(two_pi * 0.25f * t + f0) + 0.3f) * 3.0f, 0.0f, 1.0f);
+				const float syllables = syllable * syllable;
+				const float phrases = gate * gate * (3.0f - 2.0f * gate);
+
+				phase += two_pi * f0 * (1.0f + 0.05f * std::sin(two_pi * 2.0f * t)) / rate;
+
+				float value = 0.0f;
+				for (std::size_t k = 1; k * f0 < 600.0f; ++k)
+					value += std::sin(phase * k) / k;
+
+				const auto s = static_cast<sample_t>(value * syllables * phrases * 0.2f * 32767.0f);
+				for (std::size_t c = 0; c < format.channels; ++c)
+					table[i * format.channels + c] = s;
+			}
+		}
+
+		for (std::size_t i = 0; i < _burst.size() / format.channels; ++i)
+		{
+			const auto s = static_cast<sample_t>(0.5f * 32767.0f * std::sin(two_pi * s_burst_frequency * i / rate));
+			for (std::size_t c = 0; c < format.channels; ++c)
+				_burst[i * format.channels + c] = s;
+		}
+	}
+
+	std::span<const sample_t> load_source::get_frame(const std::size_t client, const u32 sequence) const
+	{
+		const auto frame_size = _format.samples_per_frame();
+
+		if (client == 0)
+		{
+			const auto position = sequence % marker_period_frames;
+			return position < burst_frames ? std::span(_burst).subspan(position * frame_size, frame_size) : std::span<const sample_t>(_silence);
+		}
+
+		const auto& table = _speech[client % _speech.size()];
+		const auto frame = (sequence + client * 7) % s_speech_frames;
+		return std::span(table).subspan(frame * frame_size, frame_size);
+	}
+
+	void load_source::on_marker_sent(const u32 sequence, const load_clock::time_point time)
+	{
+		if (sequence % marker_period_frames == 0)
+			_markers.push_back(time);
+	}
+
+	std::ptrdiff_t load_source::find_marker(const load_clock::time_point time) const
+	{
+		const auto it = std::ranges::upper_bound(_markers, time);
+		return std::distance(_markers.begin(), it) - 1;
+	}
+
+	load_client::load_client(asio::io_context& ctx, const std::size_t index, load_source& source, const u32 fec_group_size) :
+		_socket(ctx),
+		_index(index),
+		_source(source),
+		_fec_encoder(fec_group_size, source.get_format().bytes_per_frame()),
+		_read_buffer(source.get_format().bytes_per_frame()),
+		_write_buffer(2 * (sizeof(protocol::frame_header) + source.get_format().bytes_per_frame()))
+	{
+		const auto& fmt = source.get_format();
+		_hello.sample_rate = fmt.sample_rate;
+		_hello.channels = fmt.channels;
+		_hello.fec_group_size = fec_group_size;
+	}
+
+	void load_client::async_connect(const tcp::resolver::results_type& endpoints)
+	{
+		asio::async_connect(_socket, endpoints, [this](const asio::error_code error, const tcp::endpoint&) {
+			if (error)
+			{
+				fail();
+				return;
+			}
+
+			_socket.set_option(tcp::no_delay(true));
+
+			asio::async_write(_socket, asio::buffer(&_hello, sizeof(_hello)), [this](const asio::error_code error, const std::size_t) {
+				if (error)
+				{
+					fail();
+					return;
+				}
+
+				_connected = true;
+				read_header();
+			});
+		});
+	}
+
+	void load_client::fail()
+	{
+		_failed = true;
+		_connected = false;
+
+		asio::error_code ignored;
+		_socket.close(ignored);
+	}
+
+	void load_client::close()
+	{
+		_connected = false;
+
+		asio::error_code ignored;
+		_socket.close(ignored);
+	}
+
+	void load_client::read_header()
+	{
+		asio::async_read(_socket, asio::buffer(&_read_header, sizeof(_read_header)), [this](const asio::error_code error, const std::size_t) {
+			if (error)
+			{
+				if (_connected)
+					fail();
+				return;
+			}
+
+			// The server may send any format up to ours, whatever congestion control decides
+			const auto& fmt = _source.get_format();
+			if (!_read_header.is_valid() || _read_header.channels != fmt.channels || _read_header.sample_rate > fmt.sample_rate)
+			{
+				fail();
+				return;
+			}
+
+			read_payload();
+		});
+	}
+
+	void load_client::read_payload()
+	{
+		const auto size = _read_header.payload_size_in_bytes();
+		asio::async_read(_socket, asio::buffer(_read_buffer.data(), size), [this, size](const asio::error_code error, const std::size_t) {
+			if (error)
+			{
+				if (_connected)
+					fail();
+				return;
+			}
+
+			if (_read_header.kind == protocol::packet_kind::audio)
+			{
+				on_frame(load_clock::now());
+				if (_measuring)
+					_stats.received_bytes += sizeof(protocol::frame_header) + size;
+			}
+			else if (_measuring)
+			{
+				_stats.received_bytes += sizeof(protocol::frame_header) + size;
+			}
+
+			read_header();
+		});
+	}
+
+	void burst_detector::reset(const u32 sample_rate)
+	{
+		_sample_rate = sample_rate;
+		const float w = 2.0f * std::numbers::pi_v<float> * s_burst_frequency / sample_rate;
+		_coefficient = 2.0f * std::cos(w);
+		_gain = 4.0f * std::sin(w / 2.0f) * std::sin(w / 2.0f);
+		_window.assign(sample_rate * s_window_ms / 1000, 0.0f);
+		_position = 0;
+		_hop = _window.size() / s_window_ms;
+		_until_hop = _hop;
+		_x1 = _x2 = 0.0f;
+		_quiet_frames = 0;
+	}
+
+	float burst_detector::amplitude() const
+	{
+		float s1 = 0.0f, s2 = 0.0f;
+		for (std::size_t i = 0; i < _window.size(); ++i)
+		{
+			const float s = _window[(_position + i) % _window.size()] + _coefficient * s1 - s2;
+			s2 = s1;
+			s1 = s;
+		}
+		const float power = s1 * s1 + s2 * s2 - _coefficient * s1 * s2;
+		return 2.0f * std::sqrt(std::max(power, 0.0f)) / (_window.size() * _gain);
+	}
+
+	std::optional<std::ptrdiff_t> burst_detector::process(std::span<const sample_t> samples, const audio_format& format)
+	{
+		// Congestion control changed the rate
+		if (format.sample_rate != _sample_rate)
+			reset(format.sample_rate);
+
+		std::optional<std::ptrdiff_t> onset;
+		float peak = 0.0f;
+		const bool armed = _quiet_frames >= s_quiet_frames_to_arm;
+
+		for (std::size_t i = 0; i < format.frame_length(); ++i)
+		{
+			// Second difference, about 25 dB more gain at the burst's frequency than for the talkers
+			const float x = samples[i * format.channels] / 32768.0f;
+			_window[_position] = x - 2.0f * _x1 + _x2;
+			_position = (_position + 1) % _window.size();
+			_x2 = _x1;
+			_x1 = x;
+
+			if (--_until_hop > 0)
+				continue;
+			_until_hop = _hop;
+
+			const float a = amplitude();
+			peak = std::max(peak, a);
+
+			if (armed && !onset && a > s_burst_threshold)
+			{
+				std::size_t first = 0;
+				while (first + 1 < _window.size() && std::abs(_window[(_position + first) % _window.size()]) < s_burst_threshold * _gain)
+					first++;
+
+				onset = static_cast<std::ptrdiff_t>(i + 1) - static_cast<std::ptrdiff_t>(_window.size() - first);
+			}
+		}
+
+		_quiet_frames = peak < s_burst_threshold ? _quiet_frames + 1 : 0;
+		return onset;
+	}
+
+	void load_client::on_frame(const load_clock::time_point arrival)
+	{
+		const auto fmt = _read_header.get_format();
+		const auto samples = std::span(reinterpret_cast<const sample_t*>(_read_buffer.data()), fmt.samples_per_frame());
+
+		// The marker is the one sending the bursts
+		const auto onset = is_marker() ? std::nullopt : _detector.process(samples, fmt);
+		if (onset)
+		{
+			// Sample i of the frame is due i / rate after the frame arrived
+			const auto due = arrival + std::chrono::duration_cast<load_clock::duration>(std::chrono::duration<double>(static_cast<double>(*onset) / fmt.sample_rate));
+			const auto marker = _source.find_marker(due);
+
+			if (marker >= 0 && marker != _last_marker)
+			{
+				_last_marker = marker;
+				if (_measuring)
+					_stats.latencies_ms.push_back(std::chrono::duration<float, std::milli>(due - _source.get_marker_time(marker)).count());
+			}
+		}
+
+		if (!_measuring)
+			return;
+
+		if (_has_arrival)
+		{
+			const float transit = std::chrono::duration<float, std::milli>(arrival - _last_arrival).count() - audio_frame_duration_ms;
+			_stats.jitter_ms += (std::abs(transit) - _stats.jitter_ms) / 16.0f;
+		}
+
+		_stats.received_frames++;
+		_last_arrival = arrival;
+		_has_arrival = true;
+	}
+
+	void load_client::send(const load_clock::time_point now)
+	{
+		if (!_connected)
+			return;
+
+		// Like a real client, a frame that can't go out now is gone
+		if (_writing)
+		{
+			_write_sequence++;
+			if (_measuring)
+				_stats.skipped_writes++;
+			return;
+		}
+
+		const auto& fmt = _source.get_format();
+		const auto sequence = _write_sequence++;
+		const auto payload = std::as_bytes(_source.get_frame(_index, sequence));
+		const std::size_t packet_size = sizeof(protocol::frame_header) + payload.size();
+
+		if (is_marker())
+			_source.on_marker_sent(sequence, now);
+
+		const auto header = protocol::make_frame_header(sequence, fmt);
+		std::memcpy(_write_buffer.data(), &header, sizeof(header));
+		std::memcpy(_write_buffer.data() + sizeof(header), payload.data(), payload.size());
+
+		std::size_t size = packet_size;
+
+		if (_fec_encoder.add(sequence, payload))
+		{
+			const auto parity_header = protocol::make_frame_header(_fec_encoder.get_group_start(), fmt, protocol::packet_kind::parity);
+			std::memcpy(_write_buffer.data() + size, &parity_header, sizeof(parity_header));
+			std::memcpy(_write_buffer.data() + size + sizeof(parity_header), _fec_encoder.get_parity().data(), payload.size());
+			size += packet_size;
+		}
+
+		if (_measuring)
+			_stats.sent_bytes += size;
+
+		_writing = true;
+		asio::async_write(_socket, asio::buffer(_write_buffer.data(), size), [this](const asio::error_code error, const std::size_t) {
+			_writing = false;
+			if (error && _connected)
+				fail();
+		});
+	}
+
+	void load_client::begin_measurement(const load_clock::time_point now)
+	{
+		_stats = {};
+		_measuring = true;
+		_measure_start = now;
+		_has_arrival = false;
+	}
+
+	load_stats load_client::end_measurement(const load_clock::time_point now)
+	{
+		_measuring = false;
+		_stats.expected_frames = static_cast<std::size_t>((now - _measure_start) / std::chrono::milliseconds(audio_frame_duration_ms));
+		return std::move(_stats);
+	}
+}
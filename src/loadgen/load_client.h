@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <span>
+
+#include <asio.hpp>
+
+#include <common.h>
+#include <protocol.h>
+#include <fec.h>
+
+namespace cnc
+{
+	using asio::ip::tcp;
+	using load_clock = std::chrono::steady_clock;
+
+	/*
+		What the clients send, shared by all of them. Talkers loop over a few seconds of
+		speech-like audio, every harmonic under 600 Hz, each from its own offset so they don't
+		line up. One client, the marker, is silent except for a short 3 kHz burst about once a
+		second; a listener high-passes what it receives and times the burst's onset against
+		when the marker sent it. All clients live in one process, so they share the clock.
+	*/
+	class load_source
+	{
+	private:
+		audio_format _format;
+		std::vector<std::vector<sample_t>> _speech;
+		std::vector<sample_t> _burst;
+		std::vector<sample_t> _silence;
+		std::vector<load_clock::time_point> _markers; // When each burst was sent
+
+	public:
+		static constexpr std::size_t marker_period_frames = 1000 / audio_frame_duration_ms;
+		static constexpr std::size_t burst_frames = 3;
+
+		explicit load_source(const audio_format& format);
+
+		// The frame a client sends with the given sequence number
+		std::span<const sample_t> get_frame(const std::size_t client, const u32 sequence) const;
+
+		void on_marker_sent(const u32 sequence, const load_clock::time_point time);
+
+		// Latest burst sent at or before the time, -1 if none
+		std::ptrdiff_t find_marker(const load_clock::time_point time) const;
+		load_clock::time_point get_marker_time(const std::size_t marker) const { return _markers[marker]; }
+
+		const audio_format& get_format() const { return _format; }
+	};
+
+	/*
+		Finds the marker's burst in what a listener receives. The mixer switches speakers with
+		hard edges, which a plain threshold would take for the burst, so this looks for the
+		burst's frequency: a Goertzel filter over the last 4 ms, every millisecond, on a
+		high-passed signal. The onset is then the first sample of that window over the threshold.
+	*/
+	class burst_detector
+	{
+	private:
+		u32 _sample_rate{ 0 };
+		float _coefficient{ 0.0f };
+		float _gain{ 1.0f }; // Of the high-pass at the burst's frequency
+		std::vector<float> _window;
+		std::size_t _position{ 0 };
+		std::size_t _hop{ 0 }, _until_hop{ 0 };
+		float _x1{ 0.0f }, _x2{ 0.0f };
+		std::size_t _quiet_frames{ 0 };
+
+		void reset(const u32 sample_rate);
+		float amplitude() const;
+
+	public:
+		// Offset of the onset in the frame, negative if it started in the previous one.
+		// Only on the burst's first frame: the ones before must be quiet.
+		std::optional<std::ptrdiff_t> process(std::span<const sample_t> samples, const audio_format& format);
+	};
+
+	struct load_stats
+	{
+		std::size_t received_frames{ 0 };
+		std::size_t expected_frames{ 0 };
+		std::size_t received_bytes{ 0 };
+		std::size_t sent_bytes{ 0 };
+		std::size_t skipped_writes{ 0 };	// The previous frame was still being written
+		float jitter_ms{ 0.0f };			// RFC 3550 interarrival jitter
+		std::vector<float> latencies_ms;	// One per burst heard
+	};
+
+	/*
+		One connection speaking the real protocol: hello, then a frame every tick, reading
+		back whatever the server mixes for it, in whatever format congestion control picks.
+	*/
+	class load_client
+	{
+	private:
+		tcp::socket _socket;
+		std::size_t _index;
+		load_source& _source;
+		fec_encoder _fec_encoder;
+
+		protocol::hello _hello;
+		protocol::frame_header _read_header;
+		std::vector<std::byte> _read_buffer;
+		std::vector<std::byte> _write_buffer;
+		u32 _write_sequence{ 0 };
+
+		bool _connected{ false };
+		bool _failed{ false };
+		bool _writing{ false };
+		bool _measuring{ false };
+
+		load_stats _stats;
+		load_clock::time_point _measure_start{}, _last_arrival{};
+		bool _has_arrival{ false };
+
+		burst_detector _detector;
+		std::ptrdiff_t _last_marker{ -1 };
+
+		void read_header();
+		void read_payload();
+		void on_frame(const load_clock::time_point arrival);
+		void fail();
+
+	public:
+		load_client(asio::io_context& ctx, const std::size_t index, load_source& source, const u32 fec_group_size);
+
+		void async_connect(const tcp::resolver::results_type& endpoints);
+
+		// Once per tick
+		void send(const load_clock::time_point now);
+
+		// Clears the counters, everything from here on counts
+		void begin_measurement(const load_clock::time_point now);
+		load_stats end_measurement(const load_clock::time_point now);
+
+		void close();
+
+		bool is_connected() const { return _connected; }
+		bool has_failed() const { return _failed; }
+		bool is_marker() const { return _index == 0; }
+	};
+}
@@ -0,0 +1,266 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <span>
+
+#include <asio.hpp>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <common.h>
+#include <link_emulator.h>
+#include "load_client.h"
+
+namespace cnc
+{
+	struct load_config
+	{
+		std::string host{ "127.0.0.1" };
+		std::string port{ "3000" };
+		std::size_t clients{ 100 };
+		u32 seconds{ 30 };			// Measured, after everybody connected and the warm-up
+		u32 warmup_seconds{ 3 };
+		u32 ramp{ 200 };			// New connections per second
+		audio_format format{ 16000, 1 };
+		u32 fec_group_size{ 0 };
+		link_profile link_up, link_down;
+	};
+
+	static load_config parse_arguments(std::span<char*> args)
+	{
+		load_config config;
+
+		for (const std::string_view arg : args)
+		{
+			const auto pos = arg.find('=');
+			if (pos == std::string_view::npos)
+				continue;
+
+			const auto name = arg.substr(0, pos);
+			const std::string value{ arg.substr(pos + 1) };
+
+			if (name == "host")
+				config.host = value;
+			else if (name == "port")
+				config.port = value;
+			else if (name == "clients")
+				config.clients = std::max(std::atoi(value.c_str()), 2);
+			else if (name == "seconds")
+				config.seconds = std::atoi(value.c_str());
+			else if (name == "warmup")
+				config.warmup_seconds = std::atoi(value.c_str());
+			else if (name == "ramp")
+				config.ramp = std::max(std::atoi(value.c_str()), 1);
+			else if (name == "sample_rate")
+				config.format.sample_rate = std::atoi(value.c_str());
+			else if (name == "channels")
+				config.format.channels = std::atoi(value.c_str());
+			else if (name == "fec")
+				config.fec_group_size = std::atoi(value.c_str());
+			else if (parse_link_option(name, value, config.link_up, config.link_down))
+				continue;
+			else
+				std::printf("Unknown option \"%s\"\n", std::string(name).c_str());
+		}
+
+		return config;
+	}
+
+	// Thousands of sockets need more descriptors than the usual default
+	static void raise_descriptor_limit(const std::size_t needed)
+	{
+#ifndef _WIN32
+		rlimit limit{};
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < needed)
+		{
+			limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, needed);
+			setrlimit(RLIMIT_NOFILE, &limit);
+			if (limit.rlim_cur < needed)
+				std::printf("Only %zu descriptors allowed, raise the hard limit for more clients\n", static_cast<std::size_t>(limit.rlim_cur));
+		}
+#endif
+	}
+
+	// Nearest rank
+	static float percentile(std::vector<float>& values, const double p)
+	{
+		if (values.empty())
+			return 0.0f;
+		std::ranges::sort(values);
+		return values[static_cast<std::size_t>(p * (values.size() - 1) + 0.5)];
+	}
+
+	static void print_row(const char* name, std::vector<float> values)
+	{
+		std::printf("%-22s %10.2f %10.2f %10.2f %10.2f %10.2f\n", name, percentile(values, 0.5), percentile(values, 0.9),
+			percentile(values, 0.99), percentile(values, 0.0), percentile(values, 1.0));
+	}
+
+	static void print_link_stats(const char* name, const link_direction_stats& stats)
+	{
+		std::printf("Link %-4s %zu forwarded, %zu lost, %zu dropped by the queue, %zu reordered\n", name, stats.forwarded, stats.lost, stats.queue_drops, stats.reordered);
+	}
+}
+
+/*
+	ConcordiaLoadGen [host=127.0.0.1] [port=3000] [clients=100] [seconds=30] [warmup=3] [ramp=200]
+		[sample_rate=16000] [channels=1] [fec=0] [link_...]
+
+	Opens the connections at the ramp rate, lets everything settle, then measures for the given
+	time and prints percentiles over the clients. Runs on one thread: if it reports late ticks,
+	the numbers describe the load generator as much as the server. With link options (see
+	link_emulator.h) the clients go through an emulated link instead of straight to the server.
+*/
+int main(int argc, char** argv)
+{
+	using namespace cnc;
+
+	const auto config = parse_arguments(std::span(argv + 1, argc - 1));
+
+	if (!config.format.is_supported())
+	{
+		std::printf("Unsupported format: %u Hz, %u channels\n", config.format.sample_rate, config.format.channels);
+		return 1;
+	}
+
+	raise_descriptor_limit(config.clients + 64);
+
+	std::unique_ptr<link_emulator> link;
+	if (!config.link_up.is_transparent() || !config.link_down.is_transparent())
+		link = std::make_unique<link_emulator>(config.host, config.port, config.link_up, config.link_down);
+
+	asio::io_context ctx;
+	tcp::resolver resolver(ctx);
+	const auto endpoints = link ? resolver.resolve("127.0.0.1", std::to_string(link->get_port())) : resolver.resolve(config.host, config.port);
+
+	load_source source(config.format);
+
+	std::vector<std::unique_ptr<load_client>> clients;
+	clients.reserve(config.clients);
+
+	const auto tick = std::chrono::milliseconds(audio_frame_duration_ms);
+	const std::size_t connects_per_tick = std::max<std::size_t>(config.ramp * audio_frame_duration_ms / 1000, 1);
+
+	asio::steady_timer timer(ctx);
+	auto next_tick = load_clock::now();
+
+	load_clock::time_point measure_start{}, measure_end{};
+	bool measuring = false;
+	std::size_t ticks = 0, late_ticks = 0;
+	std::vector<load_stats> results;
+
+	std::printf("Connecting %zu clients to %s:%s, %u Hz, %u channels, FEC group %u\n", config.clients, config.host.c_str(), config.port.c_str(),
+		config.format.sample_rate, config.format.channels, config.fec_group_size);
+
+	std::function<void(const asio::error_code&)> on_tick = [&](const asio::error_code& error) {
+		if (error)
+			return;
+
+		const auto now = load_clock::now();
+
+		// Ramp up
+		for (std::size_t i = 0; i < connects_per_tick && clients.size() < config.clients; ++i)
+		{
+			clients.push_back(std::make_unique<load_client>(ctx, clients.size(), source, config.fec_group_size));
+			clients.back()->async_connect(endpoints);
+		}
+
+		for (auto& c : clients)
+			c->send(now);
+
+		if (measuring)
+		{
+			ticks++;
+			if (now - next_tick > tick / 4)
+				late_ticks++;
+		}
+
+		const bool ramped = clients.size() == config.clients;
+
+		if (ramped && !measuring && measure_start == load_clock::time_point{})
+		{
+			measure_start = now + std::chrono::seconds(config.warmup_seconds);
+			measure_end = measure_start + std::chrono::seconds(config.seconds);
+		}
+
+		if (!measuring && ramped && now >= measure_start)
+		{
+			const auto connected = std::ranges::count_if(clients, [](const auto& c) { return c->is_connected(); });
+			std::printf("%zu connected, %zu failed, measuring for %u s\n", static_cast<std::size_t>(connected), config.clients - connected, config.seconds);
+
+			measuring = true;
+			for (auto& c : clients)
+				c->begin_measurement(now);
+		}
+
+		if (measuring && now >= measure_end)
+		{
+			for (auto& c : clients)
+			{
+				if (c->is_connected())
+					results.push_back(c->end_measurement(now));
+				c->close();
+			}
+			return;
+		}
+
+		next_tick += tick;
+		timer.expires_at(next_tick);
+		timer.async_wait(on_tick);
+	};
+
+	timer.expires_at(next_tick);
+	timer.async_wait(on_tick);
+	ctx.run();
+
+	if (results.empty())
+	{
+		std::printf("No client stayed connected\n");
+		return 1;
+	}
+
+	std::vector<float> latency, client_latency, jitter, loss, rx, tx;
+	std::size_t skipped = 0;
+	const float seconds = static_cast<float>(config.seconds);
+
+	for (auto& r : results)
+	{
+		latency.insert(latency.end(), r.latencies_ms.begin(), r.latencies_ms.end());
+		if (!r.latencies_ms.empty())
+			client_latency.push_back(percentile(r.latencies_ms, 0.5));
+
+		jitter.push_back(r.jitter_ms);
+		loss.push_back(r.expected_frames ? 100.0f * (1.0f - std::min(1.0f, static_cast<float>(r.received_frames) / r.expected_frames)) : 0.0f);
+		rx.push_back(r.received_bytes * 8 / 1000.0f / seconds);
+		tx.push_back(r.sent_bytes * 8 / 1000.0f / seconds);
+		skipped += r.skipped_writes;
+	}
+
+	std::printf("\n%zu clients measured, %zu latency samples\n", results.size(), latency.size());
+	std::printf("%-22s %10s %10s %10s %10s %10s\n", "", "p50", "p90", "p99", "min", "max");
+	print_row("latency ms", latency);
+	print_row("client median ms", client_latency);
+	print_row("jitter ms", jitter);
+	print_row("loss %", loss);
+	print_row("rx kbit/s", rx);
+	print_row("tx kbit/s", tx);
+	std::printf("\nServer throughput %.1f Mbit/s out, %.1f Mbit/s in\n", std::accumulate(rx.begin(), rx.end(), 0.0f) / 1000.0f, std::accumulate(tx.begin(), tx.end(), 0.0f) / 1000.0f);
+	std::printf("Load generator: %zu of %zu ticks late, %zu frames not sent because the previous one was still queued\n", late_ticks, ticks, skipped);
+
+	if (link)
+	{
+		const auto stats = link->get_stats();
+		print_link_stats("up", stats.up);
+		print_link_stats("down", stats.down);
+	}
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+#include "capture.h"
+
+#include <format>
+#include <cstring>
+
+#include <log.h>
+
+namespace cnc
+{
+	// A couple of seconds of a busy room
+	static constexpr std::size_t s_queue_size_in_bytes = 32 << 20;
+
+	// Ticks are queued whole, this is just where the buffer starts
+	static constexpr std::size_t s_initial_record_size = 64 * (sizeof(capture_stream_header) + mix_format.bytes_per_frame());
+
+	static std::int64_t since(const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point t)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(t - start).count();
+	}
+
+	template<typename T>
+	static void append(std::vector<std::byte>& buffer, const T& value)
+	{
+		const auto bytes = std::as_bytes(std::span(&value, 1));
+		buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+	}
+
+	capture_writer::capture_writer(const std::filesystem::path& path) :
+		_file(path, std::ios::binary | std::ios::trunc),
+		_start(std::chrono::steady_clock::now()),
+		_queue(s_queue_size_in_bytes)
+	{
+		if (!_file)
+			throw std::runtime_error(std::format("Can't create {}", path.string()));
+
+		const capture_file_header header;
+		_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		_record.reserve(s_initial_record_size);
+		_writer = std::thread([this] { write_loop(); });
+	}
+
+	capture_writer::~capture_writer()
+	{
+		_running = false;
+		_writer.join();
+	}
+
+	void capture_writer::add_tick(const std::chrono::steady_clock::time_point start, const mixer& m, std::span<const mixer_stream> streams,
+		std::span<const std::chrono::steady_clock::time_point> arrivals)
+	{
+		const capture_tick_header tick{
+			.index = _tick++,
+			.time_ns = since(_start, start),
+			.stream_count = static_cast<u16>(streams.size()),
+			.max_speakers = static_cast<u16>(m.get_max_speakers()),
+			.agc = m.is_agc_enabled(),
+			.limiter = m.is_limiter_enabled(),
+			.personal_gains = m.is_personal_gains_enabled(),
+		};
+
+		_record.clear();
+		append(_record, tick);
+
+		for (std::size_t i = 0; i < streams.size(); ++i)
+		{
+			const auto& s = streams[i];
+			const capture_stream_header stream{
+				.id = s.id,
+				.sample_rate = s.format.sample_rate,
+				.output_sample_rate = s.output_format.sample_rate,
+				.channels = static_cast<u16>(s.format.channels),
+				.output_channels = static_cast<u16>(s.output_format.channels),
+				.arrival_ns = s.samples.empty() ? -1 : since(_start, arrivals[i]),
+				.sample_count = static_cast<u32>(s.samples.size()),
+			};
+
+			append(_record, stream);
+			const auto samples = std::as_bytes(s.samples);
+			_record.insert(_record.end(), samples.begin(), samples.end());
+		}
+
+		// Whole ticks or nothing, the writer must never see half of one
+		if (_queue.free_space() < _record.size())
+		{
+			_dropped_ticks++;
+			return;
+		}
+
+		_queue.push(_record);
+	}
+
+	void capture_writer::write_loop()
+	{
+		std::vector<std::byte> chunk(1 << 20);
+
+		while (true)
+		{
+			// Read before draining, so everything queued before the destructor ran gets written
+			const bool running = _running;
+
+			while (const auto n = _queue.pop(chunk))
+				_file.write(reinterpret_cast<const char*>(chunk.data()), n);
+
+			if (!running)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(audio_frame_duration_ms * 4));
+		}
+
+		_file.close();
+
+		CNC_INFO("Capture finished: {} ticks, {} dropped", _tick, _dropped_ticks.load());
+	}
+
+	void captured_tick::apply_settings(mixer& m) const
+	{
+		m.set_max_speakers(header.max_speakers);
+		m.set_agc_enabled(header.agc);
+		m.set_limiter_enabled(header.limiter);
+		m.set_personal_gains_enabled(header.personal_gains);
+	}
+
+	void captured_tick::get_mixer_streams(std::vector<mixer_stream>& out) const
+	{
+		out.clear();
+		for (const auto& s : streams)
+		{
+			const auto& h = s.header;
+			out.push_back({ h.id, { h.sample_rate, h.channels }, s.samples, { h.output_sample_rate, h.output_channels } });
+		}
+	}
+
+	capture_reader::capture_reader(const std::filesystem::path& path) :
+		_file(path, std::ios::binary)
+	{
+		if (!_file)
+			throw std::runtime_error(std::format("Can't open {}", path.string()));
+
+		capture_file_header header;
+		_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+		if (!_file || header.magic != capture_file_header::s_magic)
+			throw std::runtime_error(std::format("{} isn't a capture", path.string()));
+
+		if (header.version != capture_file_header::s_version || header.frame_duration_ms != audio_frame_duration_ms || header.mix_sample_rate != mix_format.sample_rate)
+			throw std::runtime_error(std::format("{} was captured by an incompatible server", path.string()));
+	}
+
+	bool capture_reader::next(captured_tick& tick)
+	{
+		if (!_file.read(reinterpret_cast<char*>(&tick.header), sizeof(tick.header)))
+			return false;
+
+		tick.streams.resize(tick.header.stream_count);
+
+		for (auto& s : tick.streams)
+		{
+			if (!_file.read(reinterpret_cast<char*>(&s.header), sizeof(s.header)))
+				return false;
+
+			const audio_format fmt{ s.header.sample_rate, s.header.channels };
+			const audio_format output{ s.header.output_sample_rate, s.header.output_channels };
+			if (!fmt.is_supported() || !output.is_supported() || (s.header.sample_count != 0 && s.header.sample_count != fmt.samples_per_frame()))
+				throw std::runtime_error(std::format("Corrupt capture at tick {}", tick.header.index));
+
+			s.samples.resize(s.header.sample_count);
+			if (!_file.read(reinterpret_cast<char*>(s.samples.data()), s.samples.size() * sizeof(sample_t)))
+				return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <span>
+
+#include <common.h>
+#include <ring_buffer.h>
+
+#include "mixer.h"
+
+namespace cnc
+{
+	/*
+		Capture files hold what went into the mixer, tick by tick: every client's frame with the
+		time it arrived, the formats, and the mixer settings the overload levels left in place.
+		Fed back into a mixer they reproduce the room's output exactly, at any speed.
+
+		Layout, little-endian, no padding: a capture_file_header, then per tick a
+		capture_tick_header followed by stream_count capture_stream_headers, each followed by
+		its sample_count samples.
+	*/
+	struct capture_file_header
+	{
+		static constexpr u32 s_magic = 0x50414343; // "CCAP"
+		static constexpr u32 s_version = 1;
+
+		u32 magic{ s_magic };
+		u32 version{ s_version };
+		u32 frame_duration_ms{ audio_frame_duration_ms };
+		u32 mix_sample_rate{ mix_format.sample_rate };
+	};
+
+	struct capture_tick_header
+	{
+		std::uint64_t index;		// Consecutive unless ticks were dropped
+		std::int64_t time_ns;		// Since the capture started, when mixing began
+		u16 stream_count;
+		u16 max_speakers;
+		u8 agc;
+		u8 limiter;
+		u8 personal_gains;
+		u8 reserved{ 0 };
+	};
+
+	struct capture_stream_header
+	{
+		u32 id;
+		u32 sample_rate;
+		u32 output_sample_rate;
+		u16 channels;
+		u16 output_channels;
+		std::int64_t arrival_ns;	// Since the capture started, -1 without a frame
+		u32 sample_count;
+		u32 reserved{ 0 };
+	};
+
+	static_assert(sizeof(capture_file_header) == 16 && sizeof(capture_tick_header) == 24 && sizeof(capture_stream_header) == 32);
+
+	/*
+		Server side. The mixer thread serializes each tick into a queue allocated up front, a
+		background thread writes it out; when the writer falls behind, whole ticks are dropped.
+	*/
+	class capture_writer
+	{
+	private:
+		std::ofstream _file;
+		std::chrono::steady_clock::time_point _start;
+		std::uint64_t _tick{ 0 };
+
+		spsc_ring_buffer<std::byte> _queue;
+		std::vector<std::byte> _record;
+		std::atomic<std::size_t> _dropped_ticks{ 0 };
+
+		std::atomic_bool _running{ true };
+		std::thread _writer;
+
+		void write_loop();
+
+	public:
+		// Throws if the file can't be created
+		explicit capture_writer(const std::filesystem::path& path);
+		~capture_writer();
+
+		capture_writer(const capture_writer&) = delete;
+		capture_writer& operator=(const capture_writer&) = delete;
+
+		// Mixer thread, once per tick after mixing. One arrival time per stream.
+		void add_tick(const std::chrono::steady_clock::time_point start, const mixer& m, std::span<const mixer_stream> streams,
+			std::span<const std::chrono::steady_clock::time_point> arrivals);
+
+		std::size_t get_dropped_ticks() const { return _dropped_ticks; }
+	};
+
+	struct captured_stream
+	{
+		capture_stream_header header;
+		std::vector<sample_t> samples;
+	};
+
+	struct captured_tick
+	{
+		capture_tick_header header;
+		std::vector<captured_stream> streams;
+
+		// Puts the mixer in the state it was in during this tick
+		void apply_settings(mixer& m) const;
+
+		// Valid until the tick is read into again
+		void get_mixer_streams(std::vector<mixer_stream>& streams) const;
+	};
+
+	class capture_reader
+	{
+	private:
+		std::ifstream _file;
+
+	public:
+		// Throws if the file can't be opened or isn't a capture
+		explicit capture_reader(const std::filesystem::path& path);
+
+		// False at the end of the file, or of what was written before the server stopped.
+		// Reuses the tick's buffers.
+		bool next(captured_tick& tick);
+	};
+}
@@ -0,0 +1,87 @@
+#include "client_session.h"
+
+#include <format>
+#include <stdexcept>
+#include <initializer_list>
+
+#include <fec.h>
+
+namespace cnc
+{
+	static std::string client_label(const u32 id)
+	{
+		return std::format("client=\"{}\"", id);
+	}
+
+	session_metrics::session_metrics(metrics::registry& registry, const u32 id) :
+		_registry(registry),
+		received_bytes(registry.add_counter("concordia_client_received_bytes_total", "Bytes received from the client", client_label(id))),
+		received_frames(registry.add_counter("concordia_client_received_frames_total", "Audio frames received from the client", client_label(id))),
+		sent_bytes(registry.add_counter("concordia_client_sent_bytes_total", "Bytes sent to the client", client_label(id))),
+		sent_frames(registry.add_counter("concordia_client_sent_frames_total", "Audio frames sent to the client", client_label(id))),
+		ingress_drops(registry.add_counter("concordia_client_dropped_frames_total", "Frames dropped on the way in or out", client_label(id) + ",direction=\"in\"")),
+		egress_drops(registry.add_counter("concordia_client_dropped_frames_total", "Frames dropped on the way in or out", client_label(id) + ",direction=\"out\"")),
+		queued_frames(registry.add_gauge("concordia_client_jitter_buffer_frames", "Frames received and waiting to be mixed", client_label(id))),
+		send_queue_bytes(registry.add_gauge("concordia_client_send_queue_bytes", "Bytes written to the client but not acknowledged", client_label(id)))
+	{
+	}
+
+	session_metrics::~session_metrics()
+	{
+		for (const void* m : std::initializer_list<const void*>{ &received_bytes, &received_frames, &sent_bytes, &sent_frames, &ingress_drops, &egress_drops, &queued_frames, &send_queue_bytes })
+			_registry.remove(m);
+	}
+
+	client_session::client_session(const u32 id, const audio_format& format) :
+		_ingress(std::make_unique<spsc_ring_buffer<sample_t>>(format.samples_per_frame() * s_max_queued_frames)),
+		// The ingress capacity is rounded up to a power of two, it can hold up to twice as many frames
+		_arrivals(std::make_unique<spsc_ring_buffer<std::chrono::steady_clock::rep>>(s_max_queued_frames * 2)),
+		_frame(format.samples_per_frame()),
+		_id(id),
+		_format(format),
+		_egress_format(format)
+	{
+	}
+
+	void client_session::validate(const protocol::hello& hello)
+	{
+		if (hello.magic != protocol::magic || hello.version != protocol::version)
+			throw std::runtime_error("Protocol mismatch");
+
+		const auto fmt = hello.get_format();
+		if (!fmt.is_supported())
+			throw std::runtime_error(std::format("Unsupported audio format: {} Hz, {} channels", fmt.sample_rate, fmt.channels));
+
+		if (hello.fec_group_size > max_fec_group_size)
+			throw std::runtime_error(std::format("Unsupported FEC group size: {}", hello.fec_group_size));
+	}
+
+	void client_session::queue_frame(std::span<const sample_t> samples)
+	{
+		if (_ingress->free_space() < samples.size())
+		{
+			if (_metrics)
+				_metrics->ingress_drops.add();
+			return;
+		}
+
+		const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+		_ingress->push(samples);
+		_arrivals->push({ &now, 1 });
+	}
+
+	void client_session::next_frame()
+	{
+		_has_frame = _ingress->size() >= _frame.size();
+		if (_has_frame)
+		{
+			std::chrono::steady_clock::rep arrival{};
+			_ingress->pop(_frame);
+			_arrivals->pop({ &arrival, 1 });
+			_arrival = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(arrival));
+		}
+
+		if (_metrics)
+			_metrics->queued_frames.set(static_cast<metrics::i64>(_ingress->size() / _frame.size()));
+	}
+}
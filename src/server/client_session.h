@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <ranges>
+#include <span>
+
+#include <common.h>
+#include <protocol.h>
+#include <ring_buffer.h>
+#include <metrics.h>
+
+namespace cnc
+{
+	// One client's series in the metrics registry, removed along with the session
+	class session_metrics
+	{
+	private:
+		metrics::registry& _registry;
+
+	public:
+		metrics::counter& received_bytes;	// Headers and parity included
+		metrics::counter& received_frames;	// Audio only
+		metrics::counter& sent_bytes;
+		metrics::counter& sent_frames;
+		metrics::counter& ingress_drops;	// Received frames the queue had no room for
+		metrics::counter& egress_drops;		// Mixed frames that weren't sent
+		metrics::gauge& queued_frames;		// Waiting to be mixed, the server's jitter buffer
+		metrics::gauge& send_queue_bytes;	// Written but not acknowledged, TCP only
+
+		session_metrics(metrics::registry& registry, const u32 id);
+		~session_metrics();
+
+		session_metrics(const session_metrics&) = delete;
+		session_metrics& operator=(const session_metrics&) = delete;
+	};
+
+	/*
+		A client as the mixer thread sees it, whatever carries its audio. Every tick: async_read()
+		and run the I/O until is_reading() is false, next_frame(), update_congestion(), mix,
+		async_write(). A destroyed session is only dropped once it isn't busy, since pending
+		operations refer to it.
+	*/
+	class client_session
+	{
+	private:
+		// Frames that are ready to be mixed, one per tick
+		std::unique_ptr<spsc_ring_buffer<sample_t>> _ingress;
+		std::unique_ptr<spsc_ring_buffer<std::chrono::steady_clock::rep>> _arrivals; // One per queued frame
+		std::vector<sample_t> _frame;
+		std::chrono::steady_clock::time_point _arrival{};
+		bool _has_frame{ false };
+
+		u32 _id{};
+		audio_format _format{};
+
+	protected:
+		static constexpr std::size_t s_max_queued_frames = max_queue_size_in_bytes / buffer_size_in_bytes;
+
+		// Null until attached, sessions in tests and replays go without
+		std::unique_ptr<session_metrics> _metrics;
+
+		audio_format _egress_format{};
+
+		bool _reading{ false };
+		bool _destroyed{ false };
+
+		client_session(const u32 id, const audio_format& format);
+
+		// Queues one received frame for mixing, dropped if the queue is full
+		void queue_frame(std::span<const sample_t> samples);
+
+	public:
+		virtual ~client_session() = default;
+
+		client_session(const client_session&) = delete;
+		client_session& operator=(const client_session&) = delete;
+
+		// Throws if the client can't be served
+		static void validate(const protocol::hello& hello);
+
+		// Clients that haven't sent their hello by then are closed
+		static constexpr auto s_handshake_timeout = std::chrono::seconds(5);
+
+		// Before the session is handed to the mixer thread
+		void attach_metrics(metrics::registry& registry) { _metrics = std::make_unique<session_metrics>(registry, _id); }
+
+		virtual void async_read() = 0;
+
+		// Samples must be in get_egress_format()
+		virtual void async_write(std::span<const sample_t> samples) = 0;
+
+		// Once per tick, before mixing. Picks the egress format and whether to send a frame at all.
+		virtual void update_congestion() {}
+
+		virtual void destroy() = 0;
+		virtual bool is_busy() const = 0;
+
+		// Takes the next received frame, call once per tick after the reads completed
+		void next_frame();
+
+		// Empty if there was no frame for this tick
+		std::span<const sample_t> get_read_buffer() const { return _has_frame ? std::span<const sample_t>(_frame) : std::span<const sample_t>{}; }
+
+		// When this tick's frame was received, meaningless without one
+		std::chrono::steady_clock::time_point get_arrival_time() const { return _arrival; }
+
+		const audio_format& get_egress_format() const { return _egress_format; }
+
+		bool is_reading() const { return _reading; }
+		bool is_destroyed() const { return _destroyed; }
+
+		u32 get_id() const { return _id; }
+		const audio_format& get_format() const { return _format; }
+	};
+
+	constexpr auto not_destroyed = std::views::filter([](const std::unique_ptr<client_session>& c) { return !c->is_destroyed(); });
+}
@@ -0,0 +1,119 @@
+#include "congestion.h"
+
+#include <algorithm>
+#include <ranges>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
+
+namespace cnc
+{
+	link_sample sample_link(asio::ip::tcp::socket& socket)
+	{
+		link_sample result;
+
+#ifdef __linux__
+		const auto fd = socket.native_handle();
+
+		tcp_info info{};
+		socklen_t length = sizeof(info);
+		if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+		{
+			result.valid = true;
+			result.rtt_ms = info.tcpi_rtt / 1000.0f;
+			result.cwnd = info.tcpi_snd_cwnd;
+		}
+
+		int queued = 0;
+		if (ioctl(fd, SIOCOUTQ, &queued) == 0)
+			result.queued_bytes = static_cast<std::size_t>(queued);
+
+#ifdef SIOCOUTQNSD
+		int unsent = 0;
+		if (ioctl(fd, SIOCOUTQNSD, &unsent) == 0)
+			result.unsent_bytes = static_cast<std::size_t>(unsent);
+#endif
+#else
+		(void)socket;
+#endif
+
+		return result;
+	}
+
+	congestion_controller::congestion_controller(const audio_format& fmt, const float target_delay_ms) :
+		_target_delay_ms(target_delay_ms)
+	{
+		// Same channels, every supported rate up to the negotiated one, best first
+		for (const auto rate : supported_sample_rates | std::views::reverse)
+			if (rate <= fmt.sample_rate)
+				_ladder.push_back({ rate, fmt.channels });
+	}
+
+	bool congestion_controller::update(const link_sample& link, const bool write_pending)
+	{
+		static constexpr float frame_ms = static_cast<float>(audio_frame_duration_ms);
+
+		const float bytes_per_ms = get_format().bytes_per_frame() / frame_ms;
+
+		_delay_ms = link.unsent_bytes / bytes_per_ms;
+
+		if (link.valid)
+		{
+			_rtt_ms = link.rtt_ms;
+			_cwnd = link.cwnd;
+
+			// Slowly forget the minimum, routes change
+			_min_rtt_ms = _min_rtt_ms == 0.0f ? _rtt_ms : std::min(_rtt_ms, _min_rtt_ms * 1.001f);
+			_delay_ms = std::max(_delay_ms, _rtt_ms - _min_rtt_ms);
+		}
+
+		if (write_pending)
+			_delay_ms = std::max(_delay_ms, frame_ms);
+
+		_smoothed_delay_ms += (_delay_ms - _smoothed_delay_ms) * 0.2f;
+
+		_ticks_since_change++;
+		_ticks_uncongested = _smoothed_delay_ms < _target_delay_ms / 4.0f ? _ticks_uncongested + 1 : 0;
+
+		if (_ticks_since_change >= s_hold_ticks)
+		{
+			if (_smoothed_delay_ms > _target_delay_ms && _level + 1 < _ladder.size())
+			{
+				_level++;
+				_downgrades++;
+				_ticks_since_change = 0;
+			}
+			else if (_ticks_uncongested >= s_upgrade_ticks && _level > 0)
+			{
+				_level--;
+				_upgrades++;
+				_ticks_since_change = 0;
+				_ticks_uncongested = 0;
+			}
+		}
+
+		const bool send = !write_pending && _delay_ms < 2.0f * _target_delay_ms;
+		if (!send)
+			_dropped++;
+
+		return send;
+	}
+
+	congestion_stats congestion_controller::get_stats() const
+	{
+		return {
+			.queue_delay_ms = _smoothed_delay_ms,
+			.rtt_ms = _rtt_ms,
+			.cwnd = _cwnd,
+			.level = _level,
+			.sample_rate = get_format().sample_rate,
+			.dropped_frames = _dropped,
+			.downgrades = _downgrades,
+			.upgrades = _upgrades
+		};
+	}
+}
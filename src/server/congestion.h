@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include <common.h>
+
+#include <asio.hpp>
+
+namespace cnc
+{
+	struct link_sample
+	{
+		bool valid{ false };
+		float rtt_ms{ 0.0f };
+		u32 cwnd{ 0 };					// In segments
+		std::size_t queued_bytes{ 0 };	// Written to the socket but not acknowledged yet
+		std::size_t unsent_bytes{ 0 };	// Written to the socket but not sent yet, the local backlog
+	};
+
+	// TCP_INFO, SIOCOUTQ and SIOCOUTQNSD on Linux, nothing elsewhere
+	link_sample sample_link(asio::ip::tcp::socket& socket);
+
+	struct congestion_stats
+	{
+		float queue_delay_ms;
+		float rtt_ms;
+		u32 cwnd;
+		std::size_t level;
+		u32 sample_rate;
+		std::size_t dropped_frames;
+		std::size_t downgrades;
+		std::size_t upgrades;
+	};
+
+	/*
+		Keeps the delay queued towards one listener under a target. The delay is estimated from
+		the bytes the socket hasn't sent yet and from the RTT above its minimum. Bytes in flight
+		don't count: at a steady rate they're about one RTT, congested or not, and the queues
+		along the path already show in the RTT. When the delay stays above the target the
+		listener's stream steps down to a lower sample rate (same channels), when it stays well
+		below for a while it steps back up. Frames are dropped outright, rather than queued,
+		while a write is still pending or the delay is twice the target.
+		Works in ticks so it behaves the same in real time and in replays.
+	*/
+	class congestion_controller
+	{
+	private:
+		static constexpr std::size_t s_hold_ticks = 1000 / audio_frame_duration_ms;
+		static constexpr std::size_t s_upgrade_ticks = 5000 / audio_frame_duration_ms;
+
+		std::vector<audio_format> _ladder;
+		std::size_t _level{ 0 };
+		float _target_delay_ms;
+
+		float _delay_ms{ 0.0f };
+		float _smoothed_delay_ms{ 0.0f };
+		float _min_rtt_ms{ 0.0f };
+		float _rtt_ms{ 0.0f };
+		u32 _cwnd{ 0 };
+
+		std::size_t _ticks_since_change{ 0 };
+		std::size_t _ticks_uncongested{ 0 };
+
+		std::size_t _dropped{ 0 }, _downgrades{ 0 }, _upgrades{ 0 };
+
+	public:
+		static constexpr float default_target_delay_ms = 80.0f;
+
+		explicit congestion_controller(const audio_format& fmt, const float target_delay_ms = default_target_delay_ms);
+
+		// Once per tick. Returns false if this tick's frame should be dropped.
+		bool update(const link_sample& link, const bool write_pending);
+
+		const audio_format& get_format() const { return _ladder[_level]; }
+		std::size_t get_level() const { return _level; }
+
+		congestion_stats get_stats() const;
+	};
+}
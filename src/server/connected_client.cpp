@@ -2,15 +2,26 @@
 
 #include <algorithm>
 #include <ranges>
+#include <format>
+#include <cstring>
 
 #include "log.h"
+#include "trace.h"
 
 namespace cnc
 {
-	connected_client::connected_client(const u32 id, tcp::socket&& socket) :
-		_id(id),
+	connected_client::connected_client(const u32 id, const protocol::hello& hello, tcp::socket&& socket) :
+		client_session(id, hello.get_format()),
+		_read_buffer(hello.get_format().samples_per_frame()),
+		_fec_decoder(hello.fec_group_size, hello.get_format().bytes_per_frame()),
+		_fec_encoder(hello.fec_group_size, hello.get_format().bytes_per_frame()),
+		_write_buffer(2 * (sizeof(protocol::frame_header) + hello.get_format().bytes_per_frame())),
+		_congestion(hello.get_format()),
 		_socket(std::move(socket))
 	{
+		// Keep the kernel from queueing much more than the congestion target
+		_socket.set_option(tcp::no_delay(true));
+		_socket.set_option(asio::socket_base::send_buffer_size(static_cast<int>(_write_buffer.size() * s_max_queued_frames)));
 	}
 	connected_client::~connected_client()
 	{
@@ -18,48 +29,218 @@ namespace cnc
 			_socket.close();
 	}
 
-	void connected_client::async_read()
+	void connected_client::async_handshake(tcp::socket&& socket, handshake_handler handler)
 	{
+		struct handshake
+		{
+			tcp::socket socket;
+			asio::steady_timer deadline;
+			protocol::hello hello{};
+			bool timed_out{ false };
+
+			explicit handshake(tcp::socket&& s) : socket(std::move(s)), deadline(socket.get_executor()) {}
+		};
+
+		auto state = std::make_shared<handshake>(std::move(socket));
+
+		state->deadline.expires_after(s_handshake_timeout);
+		state->deadline.async_wait([state](const asio::error_code error) {
+			// Cancelled when the hello came in first
+			if (error)
+				return;
+
+			state->timed_out = true;
+			asio::error_code ignored;
+			state->socket.close(ignored);
+		});
 
+		asio::async_read(state->socket, asio::buffer(&state->hello, sizeof(state->hello)), [state, handler = std::move(handler)](const asio::error_code error, const std::size_t) {
+			state->deadline.cancel();
+
+			if (error)
+			{
+				if (state->timed_out)
+					CNC_ERROR("Client refused: no hello within {} s", s_handshake_timeout.count());
+				else
+					CNC_ERROR("Client refused: {}", error.message());
+				return;
+			}
+
+			try
+			{
+				validate(state->hello);
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("Client refused: {}", ex.what());
+				asio::error_code ignored;
+				state->socket.close(ignored);
+				return;
+			}
+
+			handler(std::move(state->socket), state->hello);
+		});
+	}
+
+	void connected_client::destroy()
+	{
+		_destroyed = true;
+
+		// Cancels whatever is pending, the handlers still run
+		asio::error_code error;
+		_socket.close(error);
+	}
+
+	void connected_client::async_read()
+	{
 		// Empty the queue
-		while (_socket.available() > max_queue_size_in_bytes)
+		const std::size_t frame_size = sizeof(protocol::frame_header) + get_format().bytes_per_frame();
+		while (_socket.available() > frame_size * s_max_queued_frames)
 		{
+			asio::read(_socket, asio::buffer(&_read_header, sizeof(_read_header)));
 			const auto discared_bytes = asio::read(_socket, asio::buffer(_read_buffer));
-			CNC_INFO(std::format("Discarded {} bytes from client {}", discared_bytes, get_id()));
+			CNC_INFO("Discarded {} bytes from client {}", discared_bytes, get_id());
+
+			if (_metrics)
+			{
+				_metrics->received_bytes.add(sizeof(_read_header) + discared_bytes);
+				_metrics->ingress_drops.add();
+			}
 		}
 
-		std::ranges::fill(_read_buffer, 0);
+		_reading = true;
+		read_header();
+	}
 
-		asio::async_read(_socket, asio::buffer(_read_buffer), [this](const asio::error_code error, const std::size_t bytes_read) {
+	void connected_client::read_header()
+	{
+		asio::async_read(_socket, asio::buffer(&_read_header, sizeof(_read_header)), [this](const asio::error_code error, const std::size_t bytes_read) {
 			if (error)
 			{
-				CNC_ERROR(std::format("Destroying client {}: {}", get_id(), error.message()));
+				CNC_ERROR("Destroying client {}: {}", get_id(), error.message());
+				_reading = false;
 				destroy();
 			}
+			else if (!_read_header.is_valid() || _read_header.get_format() != get_format())
+			{
+				CNC_ERROR("Destroying client {}: unexpected frame format", get_id());
+				_reading = false;
+				destroy();
+			}
+			else
+			{
+				read_payload();
+			}
 		});
 	}
 
-	void connected_client::async_write(const buffer_t& buf)
+	void connected_client::read_payload()
 	{
-		std::ranges::copy(buf, _write_buffer.begin());
-		asio::async_write(_socket, asio::buffer(_write_buffer), [this](const asio::error_code error, const std::size_t bytes_written) {
+		asio::async_read(_socket, asio::buffer(_read_buffer), [this](const asio::error_code error, const std::size_t bytes_read) {
 			if (error)
 			{
-				CNC_ERROR(std::format("Destroying client {}: {}", get_id(), error.message()));
+				CNC_ERROR("Destroying client {}: {}", get_id(), error.message());
+				_reading = false;
 				destroy();
+				return;
+			}
+
+			auto deliver = [this](const u32, std::span<const std::byte> payload) {
+				queue_frame({ reinterpret_cast<const sample_t*>(payload.data()), payload.size() / sizeof(sample_t) });
+			};
+
+			const auto payload = std::as_bytes(std::span(_read_buffer));
+
+			if (_metrics)
+			{
+				_metrics->received_bytes.add(sizeof(_read_header) + payload.size());
+				if (_read_header.kind == protocol::packet_kind::audio)
+					_metrics->received_frames.add();
+			}
+
+			trace::instant(_read_header.kind == protocol::packet_kind::parity ? "ingest_parity" : "ingest", _read_header.sequence, get_id());
+
+			if (_read_header.kind == protocol::packet_kind::parity)
+			{
+				// Parity doesn't count as this tick's frame, keep reading
+				_fec_decoder.on_parity(_read_header.sequence, payload, deliver);
+				read_header();
+			}
+			else
+			{
+				_fec_decoder.on_frame(_read_header.sequence, payload, deliver);
+				_reading = false;
 			}
 		});
 	}
 
-	void connected_client::read()
+	void connected_client::update_congestion()
 	{
-		std::ranges::fill(_read_buffer, 0);
-		const auto read_bytes = asio::read(_socket, asio::buffer(_read_buffer));
+		const auto level = _congestion.get_level();
+
+		const auto link = sample_link(_socket);
+		_send_frame = _congestion.update(link, _writing);
+
+		if (_metrics)
+			_metrics->send_queue_bytes.set(static_cast<metrics::i64>(link.queued_bytes));
+
+		if (_congestion.get_level() != level)
+		{
+			[[maybe_unused]] const auto stats = _congestion.get_stats();
+			CNC_INFO("Client {}: queue delay {:.1f} ms, rtt {:.1f} ms, cwnd {}, switching to {} Hz", 
+				get_id(), stats.queue_delay_ms, stats.rtt_ms, stats.cwnd, stats.sample_rate);
+		}
+
+		// The format only changes between FEC groups, a group must have a single payload size
+		if (_fec_encoder.is_group_boundary(_write_sequence))
+			_egress_format = _congestion.get_format();
 	}
 
-	void connected_client::write(const buffer_t& buf)
+	void connected_client::async_write(std::span<const sample_t> samples)
 	{
-		asio::write(_socket, asio::buffer(buf));
+		if (!_send_frame)
+		{
+			if (_metrics)
+				_metrics->egress_drops.add();
+			return;
+		}
+
+		const std::size_t packet_size = sizeof(protocol::frame_header) + _egress_format.bytes_per_frame();
+		const auto payload = std::as_bytes(samples.first(_egress_format.samples_per_frame()));
+
+		const auto sequence = _write_sequence++;
+		const auto header = protocol::make_frame_header(sequence, _egress_format);
+		std::memcpy(_write_buffer.data(), &header, sizeof(header));
+		std::memcpy(_write_buffer.data() + sizeof(header), payload.data(), payload.size());
+
+		std::size_t size = packet_size;
+
+		// The parity goes out right after the frame that completes its group
+		if (_fec_encoder.add(sequence, payload))
+		{
+			const auto parity_header = protocol::make_frame_header(_fec_encoder.get_group_start(), _egress_format, protocol::packet_kind::parity);
+			std::memcpy(_write_buffer.data() + size, &parity_header, sizeof(parity_header));
+			std::memcpy(_write_buffer.data() + size + sizeof(parity_header), _fec_encoder.get_parity().data(), payload.size());
+			size += packet_size;
+		}
+
+		if (_metrics)
+		{
+			_metrics->sent_bytes.add(size);
+			_metrics->sent_frames.add();
+		}
+
+		_writing = true;
+		trace::instant("egress", sequence, get_id());
+		asio::async_write(_socket, asio::buffer(_write_buffer.data(), size), [this, sequence](const asio::error_code error, const std::size_t bytes_written) {
+			_writing = false;
+			trace::instant("egress_written", sequence, get_id());
+			if (error)
+			{
+				CNC_ERROR("Destroying client {}: {}", get_id(), error.message());
+				destroy();
+			}
+		});
 	}
 
-}
\ No newline at end of file
+}
@@ -1,10 +1,20 @@
 #pragma once
 
 #include <array>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
 #include <cinttypes>
 #include <ranges>
+#include <span>
 
 #include <common.h>
+#include <protocol.h>
+#include <fec.h>
+
+#include "client_session.h"
+#include "congestion.h"
 
 #include <asio.hpp>
 
@@ -12,50 +22,55 @@ namespace cnc
 {
 	using asio::ip::tcp;
 
-	class connected_client
+	// A client over TCP, with FEC and congestion control
+	class connected_client : public client_session
 	{
 	private:
 
-		buffer_t _read_buffer;
-		buffer_t _write_buffer;
+		protocol::frame_header _read_header{};
+		std::vector<sample_t> _read_buffer;
+		fec_decoder _fec_decoder;
 
-		u32 _id{};
-		bool _destroyed{ false };
-		tcp::socket _socket;
+		fec_encoder _fec_encoder;
+		std::vector<u8> _write_buffer;
+		u32 _write_sequence{ 0 };
 
-	public:
+		congestion_controller _congestion;
+		bool _send_frame{ true };
 
-		explicit connected_client(const u32 id, tcp::socket&& socket);
-		~connected_client();
+		bool _writing{ false };
 
-		auto& get_read_buffer() { return _read_buffer; }
-		auto& get_write_buffer() { return _write_buffer; }
+		tcp::socket _socket;
 
-		void async_read();
-		void async_write(const buffer_t& buf);
+		void read_header();
+		void read_payload();
 
-		void read();
-		void write(const buffer_t& buf);
+	public:
 
-		connected_client(const connected_client&) = delete;
-		connected_client operator=(connected_client&) = delete;
+		explicit connected_client(const u32 id, const protocol::hello& hello, tcp::socket&& socket);
+		~connected_client();
 
-		connected_client(connected_client&&) = default;
-		connected_client& operator=(connected_client&&) = default;
+		using handshake_handler = std::function<void(tcp::socket&& socket, const protocol::hello& hello)>;
 
-		tcp::socket& get_socket() { return _socket; }
+		// Reads the client hello without blocking and hands over the socket with it. Clients that
+		// don't send one in time or that can't be served are closed, the handler isn't called.
+		// Everything runs on the socket's executor, the handler too.
+		static void async_handshake(tcp::socket&& socket, handshake_handler handler);
 
-		void destroy() { _destroyed = true; }
-		bool is_destroyed() const { return _destroyed; }
+		const fec_stats& get_fec_stats() const { return _fec_decoder.get_stats(); }
 
-		u32 get_id() const { return _id; }
+		void async_read() override;
 
-		bool operator==(const connected_client& other) const { return _id == other._id; }
-		bool operator!=(const connected_client& other) const { return _id != other._id; }
+		// Skipped if congestion control decided to drop this frame
+		void async_write(std::span<const sample_t> samples) override;
 
-	};
+		void update_congestion() override;
 
-	constexpr auto not_destroyed = std::views::filter([](const connected_client& c) { return !c.is_destroyed(); });
+		congestion_stats get_congestion_stats() const { return _congestion.get_stats(); }
 
+		void destroy() override;
+		bool is_busy() const override { return _reading || _writing; }
 
-}
\ No newline at end of file
+		tcp::socket& get_socket() { return _socket; }
+	};
+}
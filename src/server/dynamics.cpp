@@ -0,0 +1,125 @@
+#include "dynamics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <dsp.h>
+
+namespace cnc
+{
+	static float db_to_gain(const float db)
+	{
+		return std::pow(10.0f, db / 20.0f);
+	}
+
+	automatic_gain_control::automatic_gain_control(const dynamics_config& config) :
+		_target(db_to_gain(config.agc_target_db)),
+		_min_gain(db_to_gain(config.agc_min_gain_db)),
+		_max_gain(db_to_gain(config.agc_max_gain_db))
+	{
+	}
+
+	void automatic_gain_control::process(std::span<float> frame, const float energy)
+	{
+		static constexpr float attack = 0.5f, release = 0.05f; // Per frame
+
+		const float rms = std::sqrt(energy);
+		_level = _level == 0.0f ? rms : _level + (rms - _level) * (rms > _level ? attack : release);
+
+		const float desired = std::clamp(_target / std::max(_level, 1e-6f), _min_gain, _max_gain);
+		const float gain = _gain + (desired - _gain) * (desired < _gain ? attack : release);
+
+		// Ramped over the frame
+		dsp::apply_gain(frame, _gain, gain);
+
+		_gain = gain;
+	}
+
+	lookahead_limiter::lookahead_limiter(const u32 sample_rate, const dynamics_config& config) :
+		_threshold(db_to_gain(config.limiter_threshold_db)),
+		_release(1.0f - std::exp(-1000.0f / (config.limiter_release_ms * sample_rate))),
+		_lookahead(std::max<std::size_t>(1, static_cast<std::size_t>(config.limiter_lookahead_ms * sample_rate / 1000.0f)))
+	{
+		const std::size_t frame_length = sample_rate * audio_frame_duration_ms / 1000;
+
+		_signal.assign(_lookahead + frame_length, 0.0f);
+		_gain.assign(frame_length, 1.0f);
+		_queue.resize(_lookahead + 1);
+		_average.assign(_lookahead, 1.0f);
+		_average_sum = static_cast<double>(_lookahead);
+		_idle = _lookahead;
+	}
+
+	void lookahead_limiter::compute_gain(std::span<const float> frame)
+	{
+		const std::size_t window = _lookahead + 1;
+		const std::size_t capacity = _queue.size();
+
+		for (std::size_t i = 0; i < frame.size(); ++i, ++_time)
+		{
+			const float magnitude = std::abs(frame[i]);
+
+			if (magnitude > _threshold)
+			{
+				const float required = _threshold / magnitude;
+				while (_queue_size > 0 && _queue[(_queue_head + _queue_size - 1) % capacity].gain >= required)
+					_queue_size--;
+				_queue[(_queue_head + _queue_size) % capacity] = { _time, required };
+				_queue_size++;
+			}
+
+			while (_queue_size > 0 && _queue[_queue_head].time + window <= _time)
+			{
+				_queue_head = (_queue_head + 1) % capacity;
+				_queue_size--;
+			}
+
+			const float minimum = _queue_size > 0 ? _queue[_queue_head].gain : 1.0f;
+			_held = std::min(minimum, _held + (1.0f - _held) * _release);
+			if (_held > 0.9999f)
+				_held = 1.0f;
+
+			_idle = _held < 1.0f ? 0 : _idle + 1;
+
+			_average_sum += _held - _average[_average_pos];
+			_average[_average_pos] = _held;
+			_average_pos = (_average_pos + 1) % _lookahead;
+
+			_gain[i] = static_cast<float>(_average_sum / _lookahead);
+		}
+	}
+
+	void lookahead_limiter::process(std::span<float> frame)
+	{
+		const std::size_t n = frame.size();
+
+		if (_gain.size() < n)
+		{
+			_gain.resize(n);
+			_signal.resize(_lookahead + n);
+		}
+
+		std::ranges::copy(frame, _signal.begin() + _lookahead);
+
+		const float peak = dsp::measure(frame).peak;
+
+		if (peak <= _threshold && _queue_size == 0 && _idle >= _lookahead)
+		{
+			// Nothing to limit, just delay. The average is all ones by now, drop the rounding errors.
+			_average_sum = static_cast<double>(_lookahead);
+			_time += n;
+			_reduction = 1.0f;
+			std::copy_n(_signal.begin(), n, frame.begin());
+		}
+		else
+		{
+			compute_gain(frame);
+			for (std::size_t i = 0; i < n; ++i)
+				frame[i] = _signal[i] * _gain[i];
+			_reduction = *std::min_element(_gain.begin(), _gain.begin() + n);
+		}
+
+		std::memmove(_signal.data(), _signal.data() + n, _lookahead * sizeof(float));
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <span>
+
+#include <common.h>
+
+namespace cnc
+{
+	struct dynamics_config
+	{
+		bool agc{ true };
+		float agc_target_db{ -20.0f };
+		float agc_min_gain_db{ -12.0f };
+		float agc_max_gain_db{ 12.0f };
+
+		bool limiter{ true };
+		float limiter_threshold_db{ -1.0f };
+		float limiter_lookahead_ms{ 3.0f }; // The latency the limiter adds
+		float limiter_release_ms{ 80.0f };
+	};
+
+	/*
+		Brings a speaker towards a common loudness, one frame at a time. Mono float in mix scale.
+		Only fed frames that passed the noise gate, so it never pumps up background noise.
+		Turning down is quicker than turning up.
+	*/
+	class automatic_gain_control
+	{
+	private:
+		float _target{ 0.1f };
+		float _min_gain{ 0.25f }, _max_gain{ 4.0f };
+		float _level{ 0.0f };
+		float _gain{ 1.0f };
+
+	public:
+		automatic_gain_control() = default;
+		explicit automatic_gain_control(const dynamics_config& config);
+
+		// energy is the mean square of the frame
+		void process(std::span<float> frame, const float energy);
+
+		float get_gain() const { return _gain; }
+	};
+
+	/*
+		Keeps the peaks of a mono float signal under a threshold without clipping them. The signal
+		is delayed by the look-ahead, so the gain can come down smoothly before a peak gets out:
+		the gain each peak needs is held for the look-ahead with a sliding minimum and then
+		averaged over the same length, which reaches it exactly in time. Frames without any peak
+		over the threshold only go through the delay line.
+	*/
+	class lookahead_limiter
+	{
+	private:
+		float _threshold{ 1.0f };
+		float _release{ 0.0f }; // Per sample
+		std::size_t _lookahead{ 0 };
+
+		// Delay line followed by the frame being processed
+		std::vector<float> _signal;
+		std::vector<float> _gain;
+
+		// Sliding minimum of the required gain over lookahead + 1 samples, as a monotonic queue.
+		// Gains of one aren't queued, an empty queue means no reduction.
+		struct required_gain
+		{
+			std::size_t time;
+			float gain;
+		};
+
+		std::vector<required_gain> _queue;
+		std::size_t _queue_head{ 0 }, _queue_size{ 0 };
+		std::size_t _time{ 0 };
+
+		float _held{ 1.0f };
+		std::vector<float> _average; // Moving average of the held gain, circular
+		std::size_t _average_pos{ 0 };
+		double _average_sum{ 0.0 };
+		std::size_t _idle{ 0 }; // Samples since the held gain was last below one
+
+		float _reduction{ 1.0f };
+
+		void compute_gain(std::span<const float> frame);
+
+	public:
+		lookahead_limiter() = default;
+		lookahead_limiter(const u32 sample_rate, const dynamics_config& config);
+
+		// In place, the output lags the input by get_latency() samples
+		void process(std::span<float> frame);
+
+		std::size_t get_latency() const { return _lookahead; }
+
+		// Lowest gain applied by the last call
+		float get_reduction() const { return _reduction; }
+	};
+}
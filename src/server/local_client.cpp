@@ -0,0 +1,281 @@
+#include "local_client.h"
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+
+#include <format>
+
+#include <unistd.h>
+
+#include "log.h"
+#include "trace.h"
+
+namespace cnc
+{
+	// Without frames for this long a client is taken as listen-only, like a recorder, and isn't waited for
+	static constexpr std::size_t s_listen_only_ticks = 1000 / audio_frame_duration_ms;
+
+	local_client::local_client(const u32 id, const protocol::hello& hello, local_socket&& control, local::shared_memory_link&& link) :
+		client_session(id, hello.get_format()),
+		_link(std::move(link)),
+		_control(std::move(control)),
+		_upstream_event(_control.get_executor(), dup(_link.get_upstream_event())),
+		_deadline(_control.get_executor()),
+		_packet(hello.get_format().bytes_per_frame()),
+		_ticks_without_frame(s_listen_only_ticks)
+	{
+	}
+
+	local_client::~local_client()
+	{
+		asio::error_code error;
+		_control.close(error);
+		_upstream_event.close(error);
+	}
+
+	protocol::hello local_client::handshake(local_socket& socket, local::shared_memory_link& link)
+	{
+		std::array<int, 3> descriptors{};
+		const auto hello = local::receive_hello(socket.native_handle(), descriptors);
+
+		// Adopted first, so the descriptors are closed whatever happens next
+		link = local::shared_memory_link::adopt(descriptors);
+		validate(hello);
+
+		return hello;
+	}
+
+	void local_client::async_handshake(local_socket&& socket, handshake_handler handler)
+	{
+		struct handshake_state
+		{
+			local_socket socket;
+			asio::steady_timer deadline;
+			bool timed_out{ false };
+
+			explicit handshake_state(local_socket&& s) : socket(std::move(s)), deadline(socket.get_executor()) {}
+		};
+
+		auto state = std::make_shared<handshake_state>(std::move(socket));
+
+		state->deadline.expires_after(s_handshake_timeout);
+		state->deadline.async_wait([state](const asio::error_code error) {
+			if (error)
+				return;
+
+			state->timed_out = true;
+			asio::error_code ignored;
+			state->socket.close(ignored);
+		});
+
+		// The descriptors come with the hello, so it's read with recvmsg() once it's there
+		state->socket.async_wait(local_socket::wait_read, [state, handler = std::move(handler)](const asio::error_code error) {
+			state->deadline.cancel();
+
+			if (error)
+			{
+				if (state->timed_out)
+					CNC_ERROR("Local client refused: no hello within {} s", s_handshake_timeout.count());
+				else
+					CNC_ERROR("Local client refused: {}", error.message());
+				return;
+			}
+
+			try
+			{
+				// The hello is sent in one message, half of one mustn't block the mixer thread
+				state->socket.non_blocking(true);
+				local::shared_memory_link link;
+				const auto hello = handshake(state->socket, link);
+				state->socket.non_blocking(false);
+
+				handler(std::move(state->socket), hello, std::move(link));
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("Local client refused: {}", ex.what());
+				asio::error_code ignored;
+				state->socket.close(ignored);
+			}
+		});
+	}
+
+	void local_client::destroy()
+	{
+		_destroyed = true;
+
+		// Cancels whatever is pending, the handlers still run
+		asio::error_code error;
+		_control.close(error);
+		_upstream_event.close(error);
+		_deadline.cancel();
+	}
+
+	bool local_client::take_frame()
+	{
+		auto& ring = _link.get_upstream();
+
+		// Same as on TCP, a client that got ahead loses its oldest frames
+		if (ring.size() > s_max_queued_frames)
+		{
+			const auto excess = ring.size() - s_max_queued_frames;
+			ring.discard(excess);
+			if (_metrics)
+				_metrics->ingress_drops.add(excess);
+		}
+
+		protocol::frame_header header;
+		if (!ring.pop(header, _packet))
+			return false;
+
+		if (header.get_format() != get_format() || header.kind != protocol::packet_kind::audio)
+			throw std::runtime_error("unexpected frame format");
+
+		trace::instant("ingest", header.sequence, get_id());
+
+		if (_metrics)
+		{
+			_metrics->received_bytes.add(sizeof(header) + _packet.size());
+			_metrics->received_frames.add();
+		}
+
+		queue_frame({ reinterpret_cast<const sample_t*>(_packet.data()), get_format().samples_per_frame() });
+		return true;
+	}
+
+	void local_client::async_read()
+	{
+		if (!_watching)
+			watch_control();
+
+		if (_ticks_without_frame >= s_listen_only_ticks)
+		{
+			try
+			{
+				_ticks_without_frame = take_frame() ? 0 : _ticks_without_frame + 1;
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("Destroying local client {}: {}", get_id(), ex.what());
+				destroy();
+			}
+			return;
+		}
+
+		_reading = true;
+		_ticks_without_frame++;
+
+		// A sender that stalls holds up the tick for one frame at most
+		_timing = true;
+		_expired = false;
+		_deadline.expires_after(std::chrono::milliseconds(audio_frame_duration_ms));
+		_deadline.async_wait([this](const asio::error_code error) {
+			_timing = false;
+			if (error)
+				return;
+
+			// Too late to cancel a read that already completed, wait_for_frame() sees _expired then
+			_expired = true;
+			if (_reading)
+			{
+				asio::error_code ignored;
+				_upstream_event.cancel(ignored);
+			}
+		});
+
+		wait_for_frame();
+	}
+
+	void local_client::wait_for_frame()
+	{
+		try
+		{
+			if (take_frame())
+			{
+				_ticks_without_frame = 0;
+				_reading = false;
+				_deadline.cancel();
+				return;
+			}
+		}
+		catch (std::exception& ex)
+		{
+			CNC_ERROR("Destroying local client {}: {}", get_id(), ex.what());
+			_reading = false;
+			destroy();
+			return;
+		}
+
+		// Past the deadline: no frame this tick, even if the wakeup came in before the cancel
+		if (_expired)
+		{
+			_reading = false;
+			return;
+		}
+
+		// The counter may have been bumped for a frame that was already taken, that only costs a spurious wakeup
+		_upstream_event.async_read_some(asio::buffer(&_event_value, sizeof(_event_value)), [this](const asio::error_code error, const std::size_t) {
+			if (error)
+			{
+				// Aborted by the deadline: no frame this tick
+				if (error != asio::error::operation_aborted && !_destroyed)
+				{
+					CNC_ERROR("Destroying local client {}: {}", get_id(), error.message());
+					destroy();
+				}
+				_reading = false;
+				return;
+			}
+
+			wait_for_frame();
+		});
+	}
+
+	void local_client::watch_control()
+	{
+		_watching = true;
+		_control.async_read_some(asio::buffer(&_control_byte, 1), [this](const asio::error_code error, const std::size_t) {
+			_watching = false;
+
+			if (error)
+			{
+				if (!_destroyed)
+				{
+					CNC_INFO("Local client {} disconnected", get_id());
+					destroy();
+				}
+				return;
+			}
+
+			// Nothing is expected on the socket, just keep listening
+			if (!_destroyed)
+				watch_control();
+		});
+	}
+
+	void local_client::async_write(std::span<const sample_t> samples)
+	{
+		const auto header = protocol::make_frame_header(_write_sequence++, _egress_format);
+		const auto payload = std::as_bytes(samples.first(_egress_format.samples_per_frame()));
+
+		trace::instant("egress", header.sequence, get_id());
+
+		// Never waits for the client: if it doesn't keep up, it misses frames
+		if (_link.get_downstream().push(header, payload))
+		{
+			local::signal(_link.get_downstream_event());
+			if (_metrics)
+			{
+				_metrics->sent_bytes.add(sizeof(header) + payload.size());
+				_metrics->sent_frames.add();
+			}
+		}
+		else
+		{
+			_dropped_frames++;
+			if (_metrics)
+				_metrics->egress_drops.add();
+		}
+	}
+}
+
+#endif
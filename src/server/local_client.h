@@ -0,0 +1,66 @@
+#pragma once
+
+#include <local_transport.h>
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+
+#include <vector>
+#include <functional>
+
+#include "client_session.h"
+
+#include <asio.hpp>
+
+namespace cnc
+{
+	using local_socket = asio::local::stream_protocol::socket;
+
+	// A client on the same host, its audio goes through shared memory (see local_transport.h)
+	class local_client : public client_session
+	{
+	private:
+		local::shared_memory_link _link;
+		local_socket _control;
+		asio::posix::stream_descriptor _upstream_event;
+		asio::steady_timer _deadline;
+
+		std::uint64_t _event_value{ 0 };
+		std::byte _control_byte{};
+		std::vector<std::byte> _packet;
+		u32 _write_sequence{ 0 };
+		std::size_t _dropped_frames{ 0 };
+		std::size_t _ticks_without_frame;
+
+		bool _watching{ false }; // For the other end closing the socket
+		bool _timing{ false };
+		bool _expired{ false }; // The deadline fired this tick, whatever is still pending
+
+		// Reads the hello and the shared memory descriptors, throws if the client can't be served
+		static protocol::hello handshake(local_socket& socket, local::shared_memory_link& link);
+
+		bool take_frame();
+		void wait_for_frame();
+		void watch_control();
+
+	public:
+		local_client(const u32 id, const protocol::hello& hello, local_socket&& control, local::shared_memory_link&& link);
+		~local_client();
+
+		using handshake_handler = std::function<void(local_socket&& socket, const protocol::hello& hello, local::shared_memory_link&& link)>;
+
+		// Waits for the hello without blocking, like connected_client::async_handshake(), and
+		// hands over the socket, the hello and the shared memory with it. Runs on the socket's executor.
+		static void async_handshake(local_socket&& socket, handshake_handler handler);
+
+		void async_read() override;
+		void async_write(std::span<const sample_t> samples) override;
+
+		void destroy() override;
+		bool is_busy() const override { return _reading || _watching || _timing; }
+
+		// Frames the client didn't collect in time
+		std::size_t get_dropped_frames() const { return _dropped_frames; }
+	};
+}
+
+#endif
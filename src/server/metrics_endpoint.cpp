@@ -0,0 +1,88 @@
+#include "metrics_endpoint.h"
+
+#include <format>
+#include <memory>
+#include <chrono>
+
+#include "log.h"
+
+namespace cnc
+{
+	using asio::ip::tcp;
+
+	// Requests are a line and a few headers, anything bigger isn't a scraper
+	static constexpr std::size_t s_max_request_size = 8192;
+
+	// For the whole exchange, so connections that never finish their request don't pile up
+	static constexpr auto s_request_timeout = std::chrono::seconds(5);
+
+	struct metrics_request
+	{
+		tcp::socket peer;
+		asio::steady_timer deadline;
+		std::string request;
+		std::string response;
+	};
+
+	metrics_endpoint::metrics_endpoint(metrics::registry& registry, const metrics_endpoint_config& config) :
+		_registry(registry),
+		_acceptor(_ctx, tcp::endpoint(asio::ip::make_address(config.address), config.port)),
+		_retry(_ctx)
+	{
+		accept();
+		_thread = std::thread([this] { _ctx.run(); });
+	}
+
+	metrics_endpoint::~metrics_endpoint()
+	{
+		_ctx.stop();
+		_thread.join();
+	}
+
+	void metrics_endpoint::accept()
+	{
+		_acceptor.async_accept([this](const asio::error_code error, tcp::socket peer) {
+			if (error)
+			{
+				// Out of file descriptors most likely, trying again right away would only spin
+				CNC_ERROR("Metrics endpoint: {}", error.message());
+				_retry.expires_after(std::chrono::milliseconds(100));
+				_retry.async_wait([this](const asio::error_code) { accept(); });
+				return;
+			}
+
+			// Lives as long as the handlers that refer to it
+			auto r = std::make_shared<metrics_request>(std::move(peer), asio::steady_timer(_ctx));
+
+			r->deadline.expires_after(s_request_timeout);
+			r->deadline.async_wait([r](const asio::error_code error) {
+				asio::error_code ignored;
+				if (!error)
+					r->peer.close(ignored);
+			});
+
+			asio::async_read_until(r->peer, asio::dynamic_buffer(r->request, s_max_request_size), "\r\n\r\n", [this, r](const asio::error_code error, const std::size_t) {
+				if (error)
+				{
+					r->deadline.cancel();
+					return;
+				}
+
+				const std::string_view line(r->request.data(), r->request.find("\r\n"));
+				const bool found = line.starts_with("GET /metrics ") || line.starts_with("GET /metrics?");
+
+				const auto body = found ? metrics::to_text(_registry) : std::string("Not found\n");
+				r->response = std::format("HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+					found ? "200 OK" : "404 Not Found", body.size(), body);
+
+				asio::async_write(r->peer, asio::buffer(r->response), [r](const asio::error_code, const std::size_t) {
+					asio::error_code ignored;
+					r->peer.shutdown(tcp::socket::shutdown_both, ignored);
+					r->deadline.cancel();
+				});
+			});
+
+			accept();
+		});
+	}
+}
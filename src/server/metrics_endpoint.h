@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <thread>
+
+#include <common.h>
+#include <metrics.h>
+
+#include <asio.hpp>
+
+namespace cnc
+{
+	struct metrics_endpoint_config
+	{
+		std::string address{ "127.0.0.1" };	// 0.0.0.0 for a scraper outside the container
+		u16 port{ 0 };							// 0 for no endpoint
+	};
+
+	/*
+		Serves the registry as Prometheus text on GET /metrics, anything else is a 404, one
+		request per connection. Runs on a thread of its own: a scrape only ever locks the
+		registry, never the clients or the mixer.
+	*/
+	class metrics_endpoint
+	{
+	private:
+		metrics::registry& _registry;
+		asio::io_context _ctx;
+		asio::ip::tcp::acceptor _acceptor;
+		asio::steady_timer _retry;
+		std::thread _thread;
+
+		void accept();
+
+	public:
+		// Throws if the address can't be bound
+		metrics_endpoint(metrics::registry& registry, const metrics_endpoint_config& config);
+		~metrics_endpoint();
+
+		metrics_endpoint(const metrics_endpoint&) = delete;
+		metrics_endpoint& operator=(const metrics_endpoint&) = delete;
+	};
+}
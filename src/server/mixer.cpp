@@ -0,0 +1,286 @@
+#include "mixer.h"
+
+#include <algorithm>
+#include <ranges>
+#include <cmath>
+
+#include <dsp.h>
+
+namespace cnc
+{
+	mixer::mixer(const std::size_t max_speakers, const float gate_db, const float duck_db, const dynamics_config& dynamics) :
+		_max_speakers(max_speakers),
+		_gate_energy(std::pow(10.0f, gate_db / 10.0f)),
+		_duck_gain(std::pow(10.0f, duck_db / 20.0f)),
+		_dynamics(dynamics),
+		_mix(mix_format.frame_length()),
+		_limited(mix_format.frame_length()),
+		_limiter(mix_format.sample_rate, dynamics)
+	{
+		const auto lookahead = static_cast<std::size_t>(std::ceil(dynamics.limiter_lookahead_ms * mix_format.sample_rate / 1000.0f));
+		_limiter_flush_ticks = static_cast<u32>((lookahead + mix_format.frame_length() - 1) / mix_format.frame_length());
+	}
+
+	mixer::channel& mixer::get_channel(const mixer_stream& stream)
+	{
+		auto& ch = _channels[stream.id];
+		if (ch.input.empty() || ch.format != stream.format)
+		{
+			ch.format = stream.format;
+			ch.ingress = resampler(stream.format.sample_rate, mix_format.sample_rate);
+			ch.input.assign(mix_format.frame_length(), 0.0f);
+			ch.converted.assign(stream.format.frame_length(), 0.0f);
+			ch.mix.assign(mix_format.frame_length(), 0.0f);
+			ch.agc = automatic_gain_control(_dynamics);
+			ch.limiter = lookahead_limiter(mix_format.sample_rate, _dynamics);
+		}
+		if (ch.output.empty() || ch.output_format != stream.output_format)
+		{
+			ch.output_format = stream.output_format;
+			ch.egress = resampler(mix_format.sample_rate, stream.output_format.sample_rate);
+			ch.resampled.assign(stream.output_format.frame_length(), 0.0f);
+			ch.output.assign(stream.output_format.samples_per_frame(), 0);
+		}
+		return ch;
+	}
+
+	mixer::variant& mixer::get_variant(const audio_format& fmt)
+	{
+		const auto it = std::ranges::find_if(_variants, [&](const variant& v) { return v.format == fmt; });
+		if (it != _variants.end())
+			return *it;
+
+		return _variants.emplace_back(variant{
+			.format = fmt,
+			.egress = resampler(mix_format.sample_rate, fmt.sample_rate),
+			.resampled = std::vector<float>(fmt.frame_length()),
+			.output = std::vector<sample_t>(fmt.samples_per_frame())
+		});
+	}
+
+	void mixer::select_speakers()
+	{
+		_speakers.clear();
+		for (auto& [id, ch] : _channels)
+		{
+			ch.active = false;
+			if (ch.present && ch.energy > _gate_energy)
+				_speakers.push_back(id);
+		}
+
+		auto by_energy = [&](const u32 a, const u32 b) { return _channels.at(a).energy > _channels.at(b).energy; };
+
+		if (_speakers.size() > _max_speakers)
+		{
+			std::ranges::partial_sort(_speakers, _speakers.begin() + _max_speakers, by_energy);
+			_speakers.resize(_max_speakers);
+		}
+
+		for (const auto id : _speakers)
+			_channels.at(id).active = true;
+	}
+
+	void mixer::mix(std::span<const mixer_stream> streams)
+	{
+		for (auto& [id, ch] : _channels)
+			ch.present = false;
+
+		// Bring everything into the mix format
+		for (const auto& s : streams)
+		{
+			auto& ch = get_channel(s);
+			ch.present = true;
+			ch.energy = 0.0f;
+
+			if (s.samples.size() != s.format.samples_per_frame())
+			{
+				std::ranges::fill(ch.input, 0.0f);
+				continue;
+			}
+
+			downmix_to_float(s.samples, s.format.channels, ch.converted);
+			ch.ingress.process(ch.converted, ch.input);
+
+			ch.energy = dsp::measure(ch.input).mean_square;
+		}
+
+		// Gains and priorities stay, a client can be set up before its first frame, see remove()
+		std::erase_if(_channels, [](const auto& p) { return !p.second.present; });
+
+		select_speakers();
+
+		if (_dynamics.agc)
+		{
+			for (const auto id : _speakers)
+			{
+				auto& ch = _channels.at(id);
+				ch.agc.process(ch.input, ch.energy);
+			}
+		}
+
+		apply_ducking();
+
+		std::ranges::fill(_mix, 0.0f);
+		for (const auto id : _speakers)
+			dsp::accumulate(_channels.at(id).input, 1.0f, 1.0f, _mix);
+
+		// One conversion per output format for everyone who doesn't need a mix of their own
+		for (auto& v : _variants)
+			v.used = false;
+
+		for (auto& [id, ch] : _channels)
+		{
+			const bool was_personal = ch.personal;
+			ch.personal = mix_personal(id, ch);
+			if (ch.personal)
+			{
+				if (_dynamics.limiter)
+				{
+					// Carry on from where the shared limiter was, its delay line holds what this listener just heard
+					if (!was_personal)
+						ch.limiter = _limiter;
+					ch.limiter.process(ch.mix);
+				}
+
+				ch.egress.process(ch.mix, ch.resampled);
+				upmix_from_float(ch.resampled, ch.output_format.channels, ch.output);
+				continue;
+			}
+
+			get_variant(ch.output_format).used = true;
+		}
+
+		std::ranges::copy(_mix, _limited.begin());
+		if (_dynamics.limiter)
+			_limiter.process(_limited);
+
+		for (auto& v : _variants)
+		{
+			if (v.used)
+			{
+				v.egress.process(_limited, v.resampled);
+				upmix_from_float(v.resampled, v.format.channels, v.output);
+			}
+		}
+
+		std::erase_if(_variants, [](const variant& v) { return !v.used; });
+	}
+
+	void mixer::apply_ducking()
+	{
+		const bool ducking = std::ranges::any_of(_speakers, [&](const u32 id) { return _priority.contains(id); });
+
+		for (auto& [id, ch] : _channels)
+		{
+			const float duck = ducking && !_priority.contains(id) ? _duck_gain : 1.0f;
+			if (ch.active && (duck != 1.0f || ch.duck != 1.0f))
+				dsp::apply_gain(ch.input, ch.duck, duck);
+			ch.duck = duck;
+		}
+	}
+
+	bool mixer::mix_personal(const u32 id, channel& ch)
+	{
+		const auto row = _personal_gains ? _gains.find(id) : _gains.end();
+
+		auto affects = [&](const gain_entry& e) {
+			const auto speaker = _channels.find(e.speaker);
+			return e.speaker != id && speaker != _channels.end() && speaker->second.active && (e.gain != 1.0f || e.applied != 1.0f);
+		};
+
+		const bool personal_gains = row != _gains.end() && std::ranges::any_of(row->second, affects);
+
+		// Back on the shared mix only once its limiter's delay line has nothing left of what this
+		// listener mustn't hear, its own voice or a speaker it turned down
+		const bool needed = ch.active || personal_gains;
+		const bool personal = needed || ch.linger > 0;
+
+		if (needed)
+			ch.linger = _dynamics.limiter ? _limiter_flush_ticks : 0;
+		else if (ch.linger > 0)
+			ch.linger--;
+
+		if (personal)
+		{
+			std::ranges::copy(_mix, ch.mix.begin());
+
+			// Speakers must not hear themselves
+			if (ch.active)
+				dsp::accumulate(ch.input, -1.0f, -1.0f, ch.mix);
+		}
+
+		if (row != _gains.end())
+		{
+			// The shared mix has every speaker at unity, only the difference is added
+			for (auto& e : row->second)
+			{
+				if (personal && affects(e))
+					dsp::accumulate(_channels.at(e.speaker).input, e.applied - 1.0f, e.gain - 1.0f, ch.mix);
+				e.applied = e.gain;
+			}
+
+			std::erase_if(row->second, [](const gain_entry& e) { return e.gain == 1.0f; });
+		}
+
+		return personal;
+	}
+
+	void mixer::set_gain(const u32 listener, const u32 speaker, const float gain)
+	{
+		auto& row = _gains[listener];
+		const auto it = std::ranges::find(row, speaker, &gain_entry::speaker);
+		if (it != row.end())
+			it->gain = gain;
+		else if (gain != 1.0f)
+			row.push_back({ speaker, gain, 1.0f });
+	}
+
+	float mixer::get_gain(const u32 listener, const u32 speaker) const
+	{
+		const auto row = _gains.find(listener);
+		if (row == _gains.end())
+			return 1.0f;
+
+		const auto it = std::ranges::find(row->second, speaker, &gain_entry::speaker);
+		return it != row->second.end() ? it->gain : 1.0f;
+	}
+
+	void mixer::clear_gains(const u32 listener)
+	{
+		if (const auto row = _gains.find(listener); row != _gains.end())
+			for (auto& e : row->second)
+				e.gain = 1.0f;
+	}
+
+	void mixer::remove(const u32 id)
+	{
+		_channels.erase(id);
+		_priority.erase(id);
+		_gains.erase(id);
+
+		for (auto& [listener, row] : _gains)
+			std::erase_if(row, [&](const gain_entry& e) { return e.speaker == id; });
+	}
+
+	void mixer::set_priority(const u32 id, const bool priority)
+	{
+		if (priority)
+			_priority.insert(id);
+		else
+			_priority.erase(id);
+	}
+
+	std::span<const sample_t> mixer::get_output(const u32 id) const
+	{
+		const auto it = _channels.find(id);
+		if (it == _channels.end())
+			return {};
+
+		const auto& ch = it->second;
+		if (ch.personal)
+			return ch.output;
+
+		const auto v = std::ranges::find_if(_variants, [&](const variant& v) { return v.format == ch.output_format; });
+		return v != _variants.end() ? std::span<const sample_t>(v->output) : std::span<const sample_t>{};
+	}
+}
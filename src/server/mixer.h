@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <common.h>
+#include <resampler.h>
+
+#include "dynamics.h"
+
+namespace cnc
+{
+	struct mixer_stream
+	{
+		u32 id;
+		audio_format format;
+		std::span<const sample_t> samples; // Empty if the client had no frame this tick
+		audio_format output_format;
+	};
+
+	/*
+		Mixes all the streams in mix_format. Only the loudest speakers above the noise gate are
+		mixed, so everybody who isn't one of them hears the same thing: that mix is converted once
+		per distinct output format and shared. Active speakers get their own mix-minus.
+
+		On top of that every listener has a sparse row of personal gains, one per speaker it
+		wants louder, quieter or muted. A listener only gets a mix of its own when one of those
+		speakers is actually talking, and that mix is the shared one plus a correction per
+		entry, so the cost follows the number of non-unity gains. While a priority speaker is
+		talking everybody else is ducked, for all listeners alike. Gain changes are ramped over
+		a frame.
+
+		Speakers go through an AGC before they're mixed and every distinct output through a
+		look-ahead limiter, so a loud room doesn't clip. Both can be turned off when time is short.
+	*/
+	class mixer
+	{
+	private:
+
+		struct gain_entry
+		{
+			u32 speaker;
+			float gain;
+			float applied; // What was used last tick, the ramp starts from here
+		};
+
+		struct channel
+		{
+			audio_format format, output_format;
+			resampler ingress, egress;
+			automatic_gain_control agc;
+			lookahead_limiter limiter;
+			std::vector<float> input, converted, mix, resampled;
+			std::vector<sample_t> output;
+			float energy{ 0.0f };
+			float duck{ 1.0f }; // Applied to the input last tick
+			bool active{ false };
+			bool present{ false };
+			bool personal{ false }; // Has its own output this tick
+			u32 linger{ 0 }; // Ticks left on its own limiter once it doesn't need a mix of its own anymore
+		};
+
+		struct variant
+		{
+			audio_format format;
+			resampler egress;
+			std::vector<float> resampled;
+			std::vector<sample_t> output;
+			bool used{ false };
+		};
+
+		std::size_t _max_speakers;
+		float _gate_energy;
+		float _duck_gain;
+		dynamics_config _dynamics;
+		bool _personal_gains{ true };
+
+		std::unordered_map<u32, channel> _channels;
+		std::unordered_map<u32, std::vector<gain_entry>> _gains; // Listener -> row
+		std::unordered_set<u32> _priority;
+		std::vector<variant> _variants;
+		std::vector<u32> _speakers;
+		std::vector<float> _mix;
+		std::vector<float> _limited;
+		lookahead_limiter _limiter;
+		u32 _limiter_flush_ticks; // Until the look-ahead of the last tick is out of a limiter
+
+		channel& get_channel(const mixer_stream& stream);
+		variant& get_variant(const audio_format& fmt);
+
+		void select_speakers();
+		void apply_ducking();
+		bool mix_personal(const u32 id, channel& ch);
+
+	public:
+		static constexpr std::size_t default_max_speakers = 8;
+		static constexpr float default_gate_db = -55.0f;
+		static constexpr float default_duck_db = -15.0f;
+
+		explicit mixer(const std::size_t max_speakers = default_max_speakers, const float gate_db = default_gate_db, const float duck_db = default_duck_db,
+			const dynamics_config& dynamics = {});
+
+		void mix(std::span<const mixer_stream> streams);
+
+		// Valid until the next call to mix()
+		std::span<const sample_t> get_output(const u32 id) const;
+
+		// What a listener with no gains of its own hears, in mix_format. Valid until the next call to mix().
+		std::span<const float> get_room_mix() const { return _limited; }
+
+		// Forgets a client that left: its channel, its priority, its row and its entries in everybody else's
+		void remove(const u32 id);
+
+		// Linear gain of one speaker as heard by one listener, 0 mutes and 1 removes the entry.
+		// Rows go away with remove().
+		void set_gain(const u32 listener, const u32 speaker, const float gain);
+		float get_gain(const u32 listener, const u32 speaker) const;
+		void clear_gains(const u32 listener);
+
+		// When off, listeners who aren't talking all share the room mix whatever their gains
+		void set_personal_gains_enabled(const bool enabled) { _personal_gains = enabled; }
+		bool is_personal_gains_enabled() const { return _personal_gains; }
+
+		void set_priority(const u32 id, const bool priority);
+		bool is_priority(const u32 id) const { return _priority.contains(id); }
+
+		std::size_t get_variant_count() const { return _variants.size(); }
+		const std::vector<u32>& get_speakers() const { return _speakers; }
+
+		void set_max_speakers(const std::size_t n) { _max_speakers = n; }
+		std::size_t get_max_speakers() const { return _max_speakers; }
+
+		const dynamics_config& get_dynamics() const { return _dynamics; }
+
+		void set_agc_enabled(const bool enabled) { _dynamics.agc = enabled; }
+		bool is_agc_enabled() const { return _dynamics.agc; }
+
+		void set_limiter_enabled(const bool enabled) { _dynamics.limiter = enabled; }
+		bool is_limiter_enabled() const { return _dynamics.limiter; }
+	};
+}
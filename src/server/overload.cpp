@@ -0,0 +1,77 @@
+#include "overload.h"
+
+#include <algorithm>
+
+namespace cnc
+{
+	const char* to_string(const overload_level level)
+	{
+		switch (level)
+		{
+		case overload_level::normal: return "normal";
+		case overload_level::fewer_speakers: return "fewer speakers";
+		case overload_level::no_dynamics: return "no dynamics";
+		case overload_level::shared_mixes: return "shared mixes";
+		case overload_level::refuse_joins: return "refusing joins";
+		default: return "unknown";
+		}
+	}
+
+	overload_controller::overload_controller(const float budget_ms) :
+		_budget_ms(budget_ms)
+	{
+		_entered[static_cast<std::size_t>(overload_level::normal)] = 1;
+	}
+
+	bool overload_controller::update(const std::chrono::steady_clock::duration work_time)
+	{
+		const float ms = std::chrono::duration<float, std::milli>(work_time).count();
+		const bool miss = ms > _budget_ms;
+
+		// Right after a change, what led to it has been in the stats for a tick
+		if (_ticks_since_change == 0)
+			_worst_ms = 0.0f;
+
+		_worst_ms = std::max(_worst_ms, ms);
+		if (miss)
+			_missed++;
+
+		_window_misses += static_cast<std::size_t>(miss) - static_cast<std::size_t>(_window[_window_pos]);
+		_window[_window_pos] = miss;
+		_window_pos = (_window_pos + 1) % _window.size();
+
+		_ticks_since_change++;
+		_ticks_calm = ms < _budget_ms * s_recover_load ? _ticks_calm + 1 : 0;
+
+		auto level = static_cast<std::size_t>(_level);
+
+		// Give each step a full window to show its effect before taking the next one
+		if (_window_misses >= s_misses_to_escalate && _ticks_since_change >= _window.size() && level + 1 < overload_level_count)
+			level++;
+		else if (_ticks_calm >= s_recover_ticks && level > 0)
+			level--;
+		else
+			return false;
+
+		_level = static_cast<overload_level>(level);
+		_entered[level]++;
+		_ticks_since_change = 0;
+		_ticks_calm = 0;
+
+		// Start the next level with a clean slate
+		_window.fill(false);
+		_window_misses = 0;
+
+		return true;
+	}
+
+	overload_stats overload_controller::get_stats() const
+	{
+		return {
+			.level = _level,
+			.worst_tick_ms = _worst_ms,
+			.missed_ticks = _missed,
+			.entered = _entered
+		};
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include <common.h>
+
+namespace cnc
+{
+	// Each level keeps what the previous ones did
+	enum class overload_level
+	{
+		normal = 0,
+		fewer_speakers,	// Smaller top-K
+		no_dynamics,	// No AGC or limiter
+		shared_mixes,	// No personal mixes besides mix-minus, even fewer speakers
+		refuse_joins,	// New clients are turned away
+	};
+
+	constexpr std::size_t overload_level_count = 5;
+
+	const char* to_string(const overload_level level);
+
+	struct overload_stats
+	{
+		overload_level level;
+		float worst_tick_ms;		// Since the level before this one was entered
+		std::size_t missed_ticks;	// All time
+		std::array<std::size_t, overload_level_count> entered; // Times each level was entered
+	};
+
+	/*
+		Watches how long the mixer thread works each tick against a budget, a share of the frame
+		duration, since the rest of the tick goes to the network. Once too many ticks in the last
+		second went over, it steps one level up; after a few seconds well within the budget, one
+		level down. Works in ticks, so it behaves the same in real time and in replays.
+	*/
+	class overload_controller
+	{
+	private:
+		static constexpr std::size_t s_window_ticks = 1000 / audio_frame_duration_ms;
+		static constexpr std::size_t s_misses_to_escalate = 4;
+		static constexpr std::size_t s_recover_ticks = 5000 / audio_frame_duration_ms;
+		static constexpr float s_recover_load = 0.6f; // Of the budget, for the worst tick
+
+		float _budget_ms;
+
+		overload_level _level{ overload_level::normal };
+
+		std::array<bool, s_window_ticks> _window{};
+		std::size_t _window_pos{ 0 };
+		std::size_t _window_misses{ 0 };
+
+		std::size_t _ticks_since_change{ 0 };
+		std::size_t _ticks_calm{ 0 };
+
+		float _worst_ms{ 0.0f };
+		std::size_t _missed{ 0 };
+		std::array<std::size_t, overload_level_count> _entered{};
+
+	public:
+		static constexpr float default_budget_ms = audio_frame_duration_ms * 0.5f;
+
+		explicit overload_controller(const float budget_ms = default_budget_ms);
+
+		// Once per tick with the time spent working. Returns true if the level changed.
+		bool update(const std::chrono::steady_clock::duration work_time);
+
+		overload_level get_level() const { return _level; }
+		bool is_at_least(const overload_level level) const { return _level >= level; }
+
+		float get_budget_ms() const { return _budget_ms; }
+
+		overload_stats get_stats() const;
+	};
+}
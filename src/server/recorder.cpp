@@ -0,0 +1,282 @@
+#include "recorder.h"
+
+#include <format>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+
+#include <log.h>
+#include <resampler.h>
+
+namespace cnc
+{
+	// Enough for a couple of seconds of a busy room
+	static constexpr std::size_t s_queue_size_in_bytes = 16 << 20;
+
+	// Files are written in chunks of about this size
+	static constexpr std::size_t s_flush_size_in_bytes = 256 << 10;
+
+	static constexpr std::size_t s_wav_header_size = 44;
+
+	// The largest payload: a frame of the mix as float, or a stereo frame at the highest rate
+	static constexpr std::size_t s_max_payload_size = std::max(mix_format.samples_per_frame() * sizeof(float),
+		audio_format{ supported_sample_rates.back(), max_audio_channels }.bytes_per_frame());
+
+	static void put_u32(std::byte* dst, const u32 value) { std::memcpy(dst, &value, sizeof(value)); }
+	static void put_u16(std::byte* dst, const u16 value) { std::memcpy(dst, &value, sizeof(value)); }
+
+	// 16-bit PCM, the sizes are patched as the file grows
+	static std::array<std::byte, s_wav_header_size> make_wav_header(const audio_format& fmt, const std::size_t data_size)
+	{
+		std::array<std::byte, s_wav_header_size> h{};
+		const u16 block_align = static_cast<u16>(fmt.channels * sizeof(sample_t));
+
+		std::memcpy(h.data(), "RIFF", 4);
+		put_u32(h.data() + 4, static_cast<u32>(data_size + s_wav_header_size - 8));
+		std::memcpy(h.data() + 8, "WAVEfmt ", 8);
+		put_u32(h.data() + 16, 16);
+		put_u16(h.data() + 20, 1);
+		put_u16(h.data() + 22, static_cast<u16>(fmt.channels));
+		put_u32(h.data() + 24, fmt.sample_rate);
+		put_u32(h.data() + 28, fmt.sample_rate * block_align);
+		put_u16(h.data() + 32, block_align);
+		put_u16(h.data() + 34, 16);
+		std::memcpy(h.data() + 36, "data", 4);
+		put_u32(h.data() + 40, static_cast<u32>(data_size));
+
+		return h;
+	}
+
+	room_recorder::room_recorder(const recording_config& config) :
+		_config(config),
+		_queue(s_queue_size_in_bytes),
+		_payload(s_max_payload_size),
+		_mix(mix_format.samples_per_frame()),
+		_converted(mix_format.samples_per_frame())
+	{
+		const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		char name[32]{};
+		std::strftime(name, sizeof(name), "%Y%m%d-%H%M%S", std::localtime(&now));
+
+		// Another session started in the same second gets a suffix, it must not write over this one's files
+		std::filesystem::create_directories(_config.directory);
+		_session = _config.directory / name;
+		for (u32 n = 1; !std::filesystem::create_directory(_session); ++n)
+			_session = _config.directory / std::format("{}-{}", name, n);
+
+		_config.segment_seconds = std::max<u32>(_config.segment_seconds, 1);
+
+		_writer = std::thread([this] { write_loop(); });
+	}
+
+	room_recorder::~room_recorder()
+	{
+		_running = false;
+		_writer.join();
+	}
+
+	void room_recorder::push(const record_header& header, std::span<const std::byte> payload)
+	{
+		// Header and payload go in with one push, so the writer never sees half a record
+		std::array<std::byte, sizeof(record_header) + s_max_payload_size> record;
+		const auto size = sizeof(record_header) + payload.size();
+
+		if (payload.size() > s_max_payload_size || _queue.free_space() < size)
+		{
+			_dropped_frames++;
+			return;
+		}
+
+		std::memcpy(record.data(), &header, sizeof(header));
+		std::ranges::copy(payload, record.begin() + sizeof(header));
+		_queue.push(std::span<const std::byte>(record).first(size));
+	}
+
+	void room_recorder::record_mix(std::span<const float> mix)
+	{
+		_tick++;
+
+		const auto payload = std::as_bytes(mix);
+		push({ _tick, s_room_track, mix_format.sample_rate, static_cast<u16>(mix_format.channels), record_kind::mix, static_cast<u32>(payload.size()) }, payload);
+	}
+
+	void room_recorder::record_stream(const u32 id, const audio_format& format, std::span<const sample_t> samples)
+	{
+		// Ticks without a frame are filled in by the writer
+		if (!_config.streams || samples.empty())
+			return;
+
+		const auto payload = std::as_bytes(samples);
+		push({ _tick, id, format.sample_rate, static_cast<u16>(format.channels), record_kind::stream, static_cast<u32>(payload.size()) }, payload);
+	}
+
+	void room_recorder::end_stream(const u32 id)
+	{
+		if (_config.streams)
+			push({ _tick, id, 0, 0, record_kind::end, 0 }, {});
+	}
+
+	void room_recorder::write_loop()
+	{
+		while (true)
+		{
+			// Read before draining, so everything pushed before the destructor ran gets written
+			const bool running = _running;
+
+			record_header header;
+			while (_queue.size() >= sizeof(header))
+			{
+				_queue.pop(std::as_writable_bytes(std::span(&header, 1)));
+				_queue.pop(std::span(_payload).first(header.size_in_bytes));
+
+				try
+				{
+					write(header, std::span(_payload).first(header.size_in_bytes));
+				}
+				catch (std::exception& ex)
+				{
+					CNC_ERROR("Recording track {}: {}", header.track, ex.what());
+				}
+			}
+
+			if (!running)
+				break;
+
+			// No hurry, the queue holds seconds
+			std::this_thread::sleep_for(std::chrono::milliseconds(audio_frame_duration_ms * 4));
+		}
+
+		for (auto& [id, t] : _tracks)
+			close(t);
+		_tracks.clear();
+
+		CNC_INFO("Recording {} finished, {} frames dropped", _session.string(), _dropped_frames.load());
+	}
+
+	void room_recorder::write(const record_header& header, std::span<const std::byte> payload)
+	{
+		if (header.kind == record_kind::end)
+		{
+			if (const auto it = _tracks.find(header.track); it != _tracks.end())
+			{
+				close(it->second);
+				_tracks.erase(it);
+			}
+			return;
+		}
+
+		const audio_format fmt{ header.sample_rate, header.channels };
+
+		auto [it, created] = _tracks.try_emplace(header.track);
+		auto& t = it->second;
+
+		if (created || t.format != fmt)
+		{
+			// Same id with a new format: start over in a new segment
+			if (!created)
+			{
+				close(t);
+				t.segment++;
+			}
+			t.format = fmt;
+			t.next_tick = header.tick;
+			t.staging.reserve(s_flush_size_in_bytes + s_max_payload_size);
+			open_segment(header.track, t);
+		}
+
+		const auto segment_frames = _config.segment_seconds * 1000 / audio_frame_duration_ms;
+		const auto frame_size = fmt.bytes_per_frame();
+
+		auto next_segment = [&] {
+			if (t.frames_in_segment < segment_frames)
+				return;
+			close(t);
+			t.segment++;
+			open_segment(header.track, t);
+		};
+
+		// Dropped frames, or ticks the client didn't send anything
+		for (; t.next_tick < header.tick; t.next_tick++)
+		{
+			next_segment();
+			t.staging.resize(t.staging.size() + frame_size);
+			std::fill(t.staging.end() - frame_size, t.staging.end(), std::byte{ 0 });
+			t.frames_in_segment++;
+			if (t.staging.size() >= s_flush_size_in_bytes)
+				flush(t);
+		}
+
+		next_segment();
+
+		if (header.kind == record_kind::mix)
+		{
+			const auto count = payload.size() / sizeof(float);
+			std::memcpy(_mix.data(), payload.data(), payload.size());
+			upmix_from_float(std::span(_mix).first(count), 1, std::span(_converted).first(count));
+			payload = std::as_bytes(std::span(_converted).first(count));
+		}
+
+		t.staging.insert(t.staging.end(), payload.begin(), payload.end());
+
+		t.next_tick = header.tick + 1;
+		t.frames_in_segment++;
+
+		if (t.staging.size() >= s_flush_size_in_bytes)
+			flush(t);
+	}
+
+	void room_recorder::open_segment(const u32 id, track& t)
+	{
+		const auto name = id == s_room_track ? std::format("room_{:04}.wav", t.segment) : std::format("client{}_{:04}.wav", id, t.segment);
+		const auto path = _session / name;
+
+		t.file.open(path, std::ios::binary | std::ios::trunc);
+		if (!t.file)
+			throw std::runtime_error(std::format("Can't open {}", path.string()));
+
+		const auto header = make_wav_header(t.format, 0);
+		t.file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+		t.frames_in_segment = 0;
+		t.data_size = 0;
+	}
+
+	void room_recorder::flush(track& t)
+	{
+		// A segment that failed is dropped until the next one
+		if (!t.file.is_open())
+		{
+			t.staging.clear();
+			return;
+		}
+
+		if (t.staging.empty())
+			return;
+
+		t.file.write(reinterpret_cast<const char*>(t.staging.data()), t.staging.size());
+		t.data_size += t.staging.size();
+		t.staging.clear();
+
+		// Keep the header in step with the data, then carry on at the end
+		const auto header = make_wav_header(t.format, t.data_size);
+		t.file.seekp(0);
+		t.file.write(reinterpret_cast<const char*>(header.data()), header.size());
+		t.file.seekp(0, std::ios::end);
+		t.file.flush();
+
+		if (!t.file)
+		{
+			t.file.close();
+			throw std::runtime_error("write failed");
+		}
+	}
+
+	void room_recorder::close(track& t)
+	{
+		if (!t.file.is_open())
+			return;
+
+		flush(t);
+		t.file.close();
+	}
+}
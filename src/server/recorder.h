@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <span>
+
+#include <common.h>
+#include <ring_buffer.h>
+
+namespace cnc
+{
+	struct recording_config
+	{
+		std::filesystem::path directory;
+		bool streams{ false };			// Every client's own audio too, not just the room mix
+		u32 segment_seconds{ 600 };		// A new file per track after this long
+	};
+
+	/*
+		Archives the room. The mixer thread only copies each tick's room mix, and optionally the
+		frame every client sent, into a queue allocated up front; a background thread drains it
+		into 16-bit WAV files, one directory per session and one set of segments per track.
+		Files are written in large sequential chunks and their headers are kept up to date, so
+		a segment is playable even if the server dies while writing it.
+
+		When the writer falls behind, frames are dropped rather than holding up the tick, and
+		the gap becomes silence in the file.
+	*/
+	class room_recorder
+	{
+	private:
+		enum class record_kind : u16 { mix, stream, end };
+
+		// In front of each payload in the queue
+		struct record_header
+		{
+			std::uint64_t tick;
+			u32 track;
+			u32 sample_rate;
+			u16 channels;
+			record_kind kind;
+			u32 size_in_bytes;
+		};
+
+		struct track
+		{
+			audio_format format;
+			std::ofstream file;
+			std::vector<std::byte> staging;
+			std::uint64_t next_tick{ 0 };
+			std::size_t segment{ 0 };
+			std::size_t frames_in_segment{ 0 };
+			std::size_t data_size{ 0 };
+		};
+
+		static constexpr u32 s_room_track = 0; // Client ids start at 1
+
+		recording_config _config;
+		std::filesystem::path _session;
+
+		spsc_ring_buffer<std::byte> _queue;
+		std::uint64_t _tick{ 0 };
+		std::atomic<std::size_t> _dropped_frames{ 0 };
+
+		std::atomic_bool _running{ true };
+		std::thread _writer;
+
+		// Writer thread only
+		std::unordered_map<u32, track> _tracks;
+		std::vector<std::byte> _payload;
+		std::vector<float> _mix;
+		std::vector<sample_t> _converted;
+
+		void push(const record_header& header, std::span<const std::byte> payload);
+
+		void write_loop();
+		void write(const record_header& header, std::span<const std::byte> payload);
+		void open_segment(const u32 id, track& t);
+		void flush(track& t);
+		void close(track& t);
+
+	public:
+		// Creates the session directory, throws if it can't
+		explicit room_recorder(const recording_config& config);
+
+		// Writes whatever is still queued and finalizes the files
+		~room_recorder();
+
+		room_recorder(const room_recorder&) = delete;
+		room_recorder& operator=(const room_recorder&) = delete;
+
+		// Mixer thread. Once per tick, with the room mix in mix_format.
+		void record_mix(std::span<const float> mix);
+
+		// Mixer thread, between record_mix() calls. Ignored unless streams are recorded.
+		void record_stream(const u32 id, const audio_format& format, std::span<const sample_t> samples);
+		void end_stream(const u32 id);
+
+		bool is_recording_streams() const { return _config.streams; }
+
+		const std::filesystem::path& get_session_directory() const { return _session; }
+
+		// Frames lost because the writer didn't keep up
+		std::size_t get_dropped_frames() const { return _dropped_frames; }
+	};
+}
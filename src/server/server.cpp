@@ -2,12 +2,27 @@
 
 #include <format>
 #include <iostream>
+#include <fstream>
+#include <filesystem>
 #include <array>
 #include <ranges>
 #include <algorithm>
+#include <list>
+#include <iterator>
+#include <functional>
 
 #include <log.h>
+#include <realtime.h>
+#include <metrics.h>
+#include <trace.h>
+#include <dsp.h>
 #include "connected_client.h"
+#include "local_client.h"
+#include "mixer.h"
+#include "overload.h"
+#include "recorder.h"
+#include "capture.h"
+#include "metrics_endpoint.h"
 
 using asio::ip::tcp;
 
@@ -15,103 +30,460 @@ using asio::ip::tcp;
 int main()
 {
 	using namespace cnc;
+	namespace fs = std::filesystem;
+
+	static constexpr std::string_view s_config_file{ "server_config" };
+
+	u32 port = 3000;
+	std::string local_socket_path;
+	realtime::thread_config mixer_thread;
+	bool lock_memory = false;
+	float tick_budget_ms = overload_controller::default_budget_ms;
+	recording_config recording;
+	std::string capture_path;
+	metrics_endpoint_config metrics_config;
+	std::string trace_path;
+	int trace_seconds = 10;
+
+	if (fs::is_regular_file(s_config_file))
+	{
+		std::ifstream is{ fs::path(s_config_file) };
+
+		std::string line;
+		while (std::getline(is, line))
+		{
+			const auto pos = line.find('=');
 
-	constexpr u32 port = 3000;
+			if (pos == std::string::npos)
+				continue;
 
-	asio::io_context ctx;
-	tcp::acceptor listener(ctx, tcp::endpoint(tcp::v4(), 3000));
+			std::string name{ line.begin(), line.begin() + pos };
+			std::string value{ line.begin() + pos + 1, line.end() };
+
+			std::ranges::transform(name, name.begin(), [](auto c) -> char { return std::tolower(c); });
 
-	CNC_INFO(std::format("Server listening on port {}", port));
+			if (name == "port")
+				port = std::atoi(value.c_str());
+			else if (name == "local_socket")
+				local_socket_path = value;
+			else if (name == "mixer_cpu")
+				mixer_thread.cpu = std::atoi(value.c_str());
+			else if (name == "mixer_priority")
+				mixer_thread.priority = std::atoi(value.c_str());
+			else if (name == "scheduling")
+			{
+				if (const auto policy = realtime::parse_scheduling(value))
+					mixer_thread.policy = *policy;
+				else
+					CNC_ERROR("Unknown scheduling policy \"{}\"", value);
+			}
+			else if (name == "lock_memory")
+				lock_memory = value == "1" || value == "true";
+			else if (name == "tick_budget_ms")
+				tick_budget_ms = static_cast<float>(std::atof(value.c_str()));
+			else if (name == "record_directory")
+				recording.directory = value;
+			else if (name == "record_streams")
+				recording.streams = value == "1" || value == "true";
+			else if (name == "record_segment_s")
+				recording.segment_seconds = std::atoi(value.c_str());
+			else if (name == "capture_file")
+				capture_path = value;
+			else if (name == "metrics_port")
+				metrics_config.port = static_cast<u16>(std::atoi(value.c_str()));
+			else if (name == "metrics_address")
+				metrics_config.address = value;
+			else if (name == "trace_file")
+				trace_path = value;
+			else if (name == "trace_seconds")
+				trace_seconds = std::atoi(value.c_str());
+		}
+	}
 
+	// Before any thread starts, so their stacks are locked too
+	if (lock_memory)
+	{
+		const auto report = realtime::lock_memory();
+		CNC_INFO("{}", report);
+	}
 
-	std::vector<connected_client> clients;
+	// The accept thread runs the listener on accept_ctx, the mixer thread everything else on ctx.
+	// Sockets never move between the two, a handle can't change its IOCP on Windows.
+	asio::io_context ctx;
+	asio::io_context accept_ctx;
+	tcp::acceptor listener(accept_ctx, tcp::endpoint(tcp::v4(), static_cast<unsigned short>(port)));
+
+	CNC_INFO("Server listening on port {}", port);
+	CNC_INFO("Sample loops: {}", dsp::to_string(dsp::get_isa()));
+
+	// Everything is registered here, the mixer thread and the sessions only record
+	metrics::registry registry;
+	auto& connected_clients = registry.add_gauge("concordia_connected_clients", "Clients being mixed");
+	auto& mix_time = registry.add_histogram("concordia_room_mix_duration_microseconds", "Time spent mixing a room, per tick", metrics::latency_bounds_us, "room=\"0\"");
+	auto& tick_time = registry.add_histogram("concordia_tick_work_duration_microseconds", "Time the mixer thread worked, per tick", metrics::latency_bounds_us);
+	auto& tick_over_budget = registry.add_counter("concordia_tick_over_budget_total", "Ticks that worked longer than the overload budget");
+	auto& ticks_late = registry.add_counter("concordia_ticks_late_total", "Ticks that started after their time in the schedule");
+	auto& ticks_skipped = registry.add_counter("concordia_ticks_skipped_total", "Ticks given up on when the mixer fell too far behind");
+	auto& overload_gauge = registry.add_gauge("concordia_overload_level", "From 0, normal, to 4, refusing joins");
+
+	std::unique_ptr<metrics_endpoint> metrics_server;
+	if (metrics_config.port != 0)
+	{
+		try
+		{
+			metrics_server = std::make_unique<metrics_endpoint>(registry, metrics_config);
+			CNC_INFO("Metrics on http://{}:{}/metrics", metrics_config.address, metrics_config.port);
+		}
+		catch (std::exception& ex)
+		{
+			CNC_ERROR("No metrics endpoint: {}", ex.what());
+		}
+	}
+
+	// The first seconds after startup, enough to connect the clients being looked at
+	std::thread trace_thread;
+	if (!trace_path.empty())
+	{
+		trace::enable("Server");
+		CNC_INFO("Tracing {} s to {}", trace_seconds, trace_path);
+
+		trace_thread = std::thread([&] {
+			std::this_thread::sleep_for(std::chrono::seconds(trace_seconds));
+			if (trace::write(trace_path))
+				CNC_INFO("Trace written to {}", trace_path);
+			else
+				CNC_ERROR("Can't write the trace to {}", trace_path);
+		});
+	}
+
+	// Pending operations may outlive a tick, clients must not move in memory
+	std::list<std::unique_ptr<client_session>> clients;
 	std::mutex clients_mutex;
+	std::atomic<u32> next_id{ 1 };
 
+	// Clients that finished their handshake. The handshakes run on ctx, so only ever the mixer
+	// thread touches this, it moves them into clients once per tick.
+	std::vector<std::unique_ptr<client_session>> joined;
 
-	auto accept_thread = std::thread([&] {
-		bool done = false;
+	// Cleared by the mixer thread when it's overloaded
+	std::atomic_bool accepting{ true };
 
-		u32 next_id = 1;
 
-		while (!done)
-		{
+	auto accept_thread = std::thread([&] {
+		// Any number of clients can be in the middle of their handshake, none of them holds up the others
+		asio::steady_timer retry(accept_ctx);
+		std::function<void()> accept_next;
+
+		// On the mixer thread
+		auto on_hello = [&](tcp::socket&& peer, const protocol::hello& hello) {
 			try
 			{
-				auto peer = listener.accept();
+				CNC_INFO("Client accepted: {} Hz, {} channels, FEC group {}", hello.sample_rate, hello.channels, hello.fec_group_size);
+
+				auto client = std::make_unique<connected_client>(next_id++, hello, std::move(peer));
+				client->attach_metrics(registry);
+				joined.push_back(std::move(client));
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("Can't add the client: {}", ex.what());
+			}
+		};
+
+		accept_next = [&] {
+			// Accepted straight onto ctx, where the handshake and then the client run
+			listener.async_accept(ctx, [&](const asio::error_code error, tcp::socket peer) {
+				if (error)
+				{
+					// Out of file descriptors most likely, give it some time before trying again
+					CNC_ERROR("Accept failed: {}", error.message());
+					retry.expires_after(std::chrono::milliseconds(100));
+					retry.async_wait([&](const asio::error_code) { accept_next(); });
+					return;
+				}
 
-				CNC_INFO("Client accepted");
+				if (!accepting)
+				{
+					CNC_INFO("Client refused: server overloaded");
+					asio::error_code ignored;
+					peer.close(ignored);
+				}
+				else
+				{
+					connected_client::async_handshake(std::move(peer), on_hello);
+				}
+
+				accept_next();
+			});
+		};
+
+		accept_next();
+		accept_ctx.run();
+
+		CNC_INFO("Accept thread exiting");
+
+	});
+
+	// Same-host clients skip the network stack, see local_transport.h
+	std::thread local_accept_thread;
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+	if (!local_socket_path.empty())
+	{
+		// Left behind by a previous run
+		std::error_code error;
+		fs::remove(local_socket_path, error);
 
+		local_accept_thread = std::thread([&] {
+			// Same as the TCP accept thread: the listener runs here, the handshakes and the clients on ctx
+			asio::io_context local_ctx;
+			asio::local::stream_protocol::acceptor local_listener(local_ctx, asio::local::stream_protocol::endpoint(local_socket_path));
+			asio::steady_timer retry(local_ctx);
+			std::function<void()> accept_next;
+
+			CNC_INFO("Server listening on {}", local_socket_path);
+
+			// On the mixer thread
+			auto on_hello = [&](local_socket&& peer, const protocol::hello& hello, local::shared_memory_link&& link) {
+				try
+				{
+					CNC_INFO("Local client accepted: {} Hz, {} channels", hello.sample_rate, hello.channels);
+
+					auto client = std::make_unique<local_client>(next_id++, hello, std::move(peer), std::move(link));
+					client->attach_metrics(registry);
+					joined.push_back(std::move(client));
+				}
+				catch (std::exception& ex)
 				{
-					std::scoped_lock lock(clients_mutex);
-					clients.push_back(connected_client(next_id++, std::move(peer)));
+					CNC_ERROR("Can't add the local client: {}", ex.what());
 				}
+			};
+
+			accept_next = [&] {
+				local_listener.async_accept(ctx, [&](const asio::error_code error, local_socket peer) {
+					if (error)
+					{
+						CNC_ERROR("Local accept failed: {}", error.message());
+						retry.expires_after(std::chrono::milliseconds(100));
+						retry.async_wait([&](const asio::error_code) { accept_next(); });
+						return;
+					}
+
+					if (!accepting)
+					{
+						CNC_INFO("Local client refused: server overloaded");
+						asio::error_code ignored;
+						peer.close(ignored);
+					}
+					else
+					{
+						local_client::async_handshake(std::move(peer), on_hello);
+					}
+
+					accept_next();
+				});
+			};
+
+			accept_next();
+			local_ctx.run();
+		});
+	}
+#else
+	if (!local_socket_path.empty())
+		CNC_ERROR("Local clients aren't supported on this platform");
+#endif
+
+	auto read_thread = std::thread([&] {
 
+		trace::set_thread_name("Mixer");
+		const auto report = realtime::configure_current_thread("Mixer", mixer_thread);
+		CNC_INFO("{}", report);
+		realtime::prefault_stack();
+
+		mixer room_mixer;
+		std::vector<mixer_stream> streams;
+		std::vector<std::chrono::steady_clock::time_point> arrivals;
+		std::vector<sample_t> silence;
+
+		// What's configured, the overload levels only ever take away from it
+		const auto max_speakers = room_mixer.get_max_speakers();
+		const auto dynamics = room_mixer.get_dynamics();
+
+		overload_controller overload(tick_budget_ms);
+
+		std::unique_ptr<room_recorder> recorder;
+		if (!recording.directory.empty())
+		{
+			try
+			{
+				recorder = std::make_unique<room_recorder>(recording);
+				CNC_INFO("Recording to {}", recorder->get_session_directory().string());
 			}
 			catch (std::exception& ex)
 			{
-				CNC_ERROR(ex.what());
+				CNC_ERROR("Can't record: {}", ex.what());
 			}
-			std::this_thread::yield();
 		}
 
-		CNC_INFO("Accept thread exiting");
-
-	});
+		// Ingress for replaying through the mixer offline, see capture.h
+		std::unique_ptr<capture_writer> capture;
+		if (!capture_path.empty())
+		{
+			try
+			{
+				capture = std::make_unique<capture_writer>(capture_path);
+				CNC_INFO("Capturing to {}", capture_path);
+			}
+			catch (std::exception& ex)
+			{
+				CNC_ERROR("Can't capture: {}", ex.what());
+			}
+		}
 
-	auto read_thread = std::thread([&] {
+		auto apply_overload = [&] {
+			const auto level = overload.get_level();
+			const auto speakers = overload.is_at_least(overload_level::shared_mixes) ? max_speakers / 4 :
+				overload.is_at_least(overload_level::fewer_speakers) ? max_speakers / 2 : max_speakers;
+
+			room_mixer.set_max_speakers(std::max<std::size_t>(speakers, 1));
+			room_mixer.set_agc_enabled(dynamics.agc && level < overload_level::no_dynamics);
+			room_mixer.set_limiter_enabled(dynamics.limiter && level < overload_level::no_dynamics);
+			room_mixer.set_personal_gains_enabled(level < overload_level::shared_mixes);
+			accepting = level < overload_level::refuse_joins;
+		};
+
+		// Only logged
+		[[maybe_unused]] auto previous_level = overload.get_level();
+		// Already added to the over budget counter
+		std::size_t missed_ticks = 0;
+		static constexpr auto frame_duration = std::chrono::milliseconds(audio_frame_duration_ms);
+		static constexpr int max_catch_up_ticks = 8;
+		auto next_tick = std::chrono::steady_clock::now();
+		std::uint64_t ticks = 0;
 
 		while (true)
 		{
 			{
+				const auto tick = ticks++;
+				const trace::scope trace_tick("tick", tick);
 				std::scoped_lock lock(clients_mutex);
 
-				// TODO: Maybe async read/write?
-				// Read in
+				// Read in. Only wait for the reads, writes still pending from the last tick can take their time.
 				ctx.restart();
 				for (auto& cli : clients | not_destroyed)
 				{
 
-					try { cli.async_read(); }
+					try { cli->async_read(); }
 					catch (std::exception& ex)
 					{
-						cli.destroy();
+						cli->destroy();
 						CNC_INFO("Client disconnected");
 					}
 				}
-				ctx.run();
+
+				while (std::ranges::any_of(clients, [](const auto& c) { return c->is_reading(); }) && ctx.run_one() > 0);
+
+				// Waiting for the clients isn't work, everything from here on is
+				const auto work_start = std::chrono::steady_clock::now();
 
 				// Mix the audio
-				
+				streams.clear();
+				arrivals.clear();
+				for (auto& c : clients | not_destroyed)
+				{
+					c->next_frame();
+					c->update_congestion();
+					streams.push_back({ c->get_id(), c->get_format(), c->get_read_buffer(), c->get_egress_format() });
+					arrivals.push_back(c->get_arrival_time());
+				}
+
+				{
+					metrics::scoped_timer timer(mix_time);
+					const trace::scope trace_mix("mix", tick);
+					room_mixer.mix(streams);
+				}
+				connected_clients.set(static_cast<metrics::i64>(streams.size()));
+
+				if (capture)
+					capture->add_tick(work_start, room_mixer, streams, arrivals);
+
+				if (recorder)
+				{
+					recorder->record_mix(room_mixer.get_room_mix());
+					for (const auto& s : streams)
+						recorder->record_stream(s.id, s.format, s.samples);
+				}
 
 				ctx.restart();
 				for (auto& c0 : clients | not_destroyed)
 				{
-					buffer_t write_buffer = { 0 };
-					auto filter_fn = [&](const connected_client& c) { return c != c0; };
-					for (auto& c1 : clients | not_destroyed | std::views::filter(filter_fn))
+					auto output = room_mixer.get_output(c0->get_id());
+					if (output.empty())
 					{
-						const auto& read_buf = c1.get_read_buffer();
-
-						for (std::size_t i = 0; i < read_buf.size(); ++i)
-							write_buffer[i] += read_buf[i];
+						silence.assign(c0->get_egress_format().samples_per_frame(), 0);
+						output = silence;
 					}
-					
 
-					try { c0.async_write(write_buffer); }
+					try { c0->async_write(output); }
 					catch (std::exception& ex)
 					{
-						c0.destroy();
+						c0->destroy();
 						CNC_INFO("Client disconnected");
 					}
 				}
 
-				ctx.run();
+				// Don't wait for congested clients
+				ctx.poll();
+
+				// Mixed from the next tick on
+				std::ranges::move(joined, std::back_inserter(clients));
+				joined.clear();
 
-				std::erase_if(clients, [](const connected_client& c) { return c.is_destroyed(); });
+				std::erase_if(clients, [&](const auto& c) {
+					const bool gone = c->is_destroyed() && !c->is_busy();
+					if (gone)
+						room_mixer.remove(c->get_id());
+					if (gone && recorder)
+						recorder->end_stream(c->get_id());
+					return gone;
+				});
+
+				const auto work_time = std::chrono::steady_clock::now() - work_start;
+				tick_time.record(static_cast<metrics::u64>(std::chrono::duration_cast<std::chrono::microseconds>(work_time).count()));
+
+				const bool changed = overload.update(work_time);
+				const auto stats = overload.get_stats();
+				tick_over_budget.add(stats.missed_ticks - missed_ticks);
+				missed_ticks = stats.missed_ticks;
+
+				if (changed)
+				{
+					apply_overload();
+
+					const auto level = overload.get_level();
+					CNC_INFO("Overload: {} -> {} (worst tick {:.1f} ms since the last change, budget {:.1f} ms, {} ticks missed in all, entered {} times)",
+						to_string(previous_level), to_string(level), stats.worst_tick_ms, overload.get_budget_ms(), stats.missed_ticks, stats.entered[static_cast<std::size_t>(level)]);
+					previous_level = level;
+					overload_gauge.set(static_cast<metrics::i64>(level));
+				}
 
 			}
 
-			std::this_thread::yield();
+			// The clients' frames normally pace the ticks, but nobody may be sending (an empty room, listen-only
+			// local clients): never run faster than real time. The schedule is absolute, after a stall the
+			// missed ticks run back to back so the clients' queues drain, unless it's too far behind to
+			// catch up, then it starts over from now.
+			next_tick += frame_duration;
+			const auto behind = std::chrono::steady_clock::now() - next_tick;
+			if (behind > frame_duration.zero())
+				ticks_late.add();
+			if (behind > max_catch_up_ticks * frame_duration)
+			{
+				CNC_INFO("Mixer fell {} ticks behind, skipping them", behind / frame_duration);
+				ticks_skipped.add(static_cast<metrics::u64>(behind / frame_duration));
+				next_tick = std::chrono::steady_clock::now();
+			}
+			std::this_thread::sleep_until(next_tick);
 		}
 
 		CNC_INFO("Read thread exiting");
@@ -120,6 +492,10 @@ int main()
 
 	accept_thread.join();
 	read_thread.join();
+	if (local_accept_thread.joinable())
+		local_accept_thread.join();
+	if (trace_thread.joinable())
+		trace_thread.join();
 
 	return 0;
 
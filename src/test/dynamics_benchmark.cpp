@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include "common.h"
+#include "dynamics.h"
+
+namespace cnc::test
+{
+	// Time per stream per tick of the AGC and the limiter, at the mix rate, on quiet and on
+	// clipping input. The limiter must also keep every output sample under its threshold.
+	void run_dynamics_benchmark()
+	{
+		static constexpr std::size_t tick_count = 20000;
+		static constexpr std::array<float, 3> lookaheads_ms = { 1.0f, 3.0f, 5.0f };
+
+		const std::size_t frame_length = mix_format.frame_length();
+		const float frame_time_us = audio_frame_duration_ms * 1000.0f;
+
+		std::mt19937 rng(42);
+		std::normal_distribution<float> noise(0.0f, 1.0f);
+
+		// Speech-like: a tone with a syllable envelope and some noise, peaking at amplitude
+		auto make_signal = [&](const float amplitude) {
+			std::vector<float> signal(frame_length * 64);
+			for (std::size_t i = 0; i < signal.size(); ++i)
+			{
+				const float t = static_cast<float>(i) / mix_format.sample_rate;
+				const float envelope = 0.5f + 0.5f * std::sin(2.0f * 3.14159265f * 4.0f * t);
+				signal[i] = amplitude * envelope * (0.8f * std::sin(2.0f * 3.14159265f * 220.0f * t) + 0.2f * noise(rng) / 3.0f);
+			}
+			return signal;
+		};
+
+		const std::array<std::pair<const char*, std::vector<float>>, 2> inputs = { {
+			{ "quiet", make_signal(0.3f) },
+			{ "loud", make_signal(3.0f) },
+		} };
+
+		std::vector<float> frame(frame_length);
+
+		std::printf("%-8s %-12s %12s %12s %14s %10s\n", "input", "stage", "us/tick", "% of tick", "max output", "overs");
+
+		for (const auto& [name, signal] : inputs)
+		{
+			const std::size_t frames_in_signal = signal.size() / frame_length;
+
+			auto run = [&](const char* stage, auto&& process) {
+				float peak = 0.0f;
+				std::size_t overs = 0;
+
+				const auto start = std::chrono::steady_clock::now();
+				for (std::size_t t = 0; t < tick_count; ++t)
+				{
+					const auto source = signal.begin() + (t % frames_in_signal) * frame_length;
+					std::copy_n(source, frame_length, frame.begin());
+					process(frame);
+
+					for (const float v : frame)
+					{
+						peak = std::max(peak, std::abs(v));
+						overs += std::abs(v) > 1.0f;
+					}
+				}
+				const auto elapsed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+				// The check loop is in the timing too, it's the same for every stage
+				std::printf("%-8s %-12s %12.2f %11.3f%% %14.3f %10zu\n", name, stage, elapsed / tick_count, 100.0f * elapsed / tick_count / frame_time_us, peak, overs);
+			};
+
+			run("none", [](std::span<float>) {});
+
+			{
+				automatic_gain_control agc(dynamics_config{});
+				run("agc", [&](std::span<float> f) {
+					float energy = 0.0f;
+					for (const float v : f)
+						energy += v * v;
+					agc.process(f, energy / f.size());
+				});
+			}
+
+			for (const auto lookahead : lookaheads_ms)
+			{
+				dynamics_config config;
+				config.limiter_lookahead_ms = lookahead;
+
+				lookahead_limiter limiter(mix_format.sample_rate, config);
+
+				char stage[32];
+				std::snprintf(stage, sizeof(stage), "limiter %.0fms", lookahead);
+				run(stage, [&](std::span<float> f) { limiter.process(f); });
+			}
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <span>
+#include <array>
+
+#include "common.h"
+#include "fec.h"
+
+namespace cnc::test
+{
+	// Gilbert-Elliott channel: losses come in bursts of average length burst_length
+	class loss_model
+	{
+	private:
+		std::mt19937 _rng{ 42 };
+		std::uniform_real_distribution<double> _uniform{ 0.0, 1.0 };
+		double _p_enter_bad, _p_leave_bad;
+		bool _bad{ false };
+	public:
+		loss_model(const double loss_rate, const double burst_length) :
+			_p_enter_bad(loss_rate / (burst_length * (1.0 - loss_rate))),
+			_p_leave_bad(1.0 / burst_length)
+		{
+		}
+
+		bool next()
+		{
+			_bad = _bad ? _uniform(_rng) >= _p_leave_bad : _uniform(_rng) < _p_enter_bad;
+			return _bad;
+		}
+	};
+
+	void run_fec_simulation()
+	{
+		static constexpr std::size_t frame_count = 200000;
+		static constexpr std::array<double, 5> loss_rates = { 0.01, 0.02, 0.05, 0.10, 0.20 };
+		static constexpr std::array<std::size_t, 4> group_sizes = { 0, 2, 4, 8 };
+		static constexpr std::array<double, 2> burst_lengths = { 1.0, 2.0 };
+
+		const auto fmt = default_audio_format;
+		std::vector<std::byte> payload(fmt.bytes_per_frame());
+
+		std::printf("%-6s %-6s %-6s %10s %10s %10s %10s %12s\n", "loss", "burst", "group", "overhead", "raw loss", "residual", "recovered", "hold frames");
+
+		for (const auto burst : burst_lengths)
+		{
+			for (const auto loss_rate : loss_rates)
+			{
+				for (const auto group : group_sizes)
+				{
+					loss_model channel(loss_rate, burst);
+					fec_encoder encoder(group, payload.size());
+					fec_decoder decoder(group, payload.size());
+
+					std::size_t sent_bytes = 0, parity_bytes = 0, lost = 0, delivered = 0, hold = 0;
+					u32 current = 0;
+
+					auto deliver = [&](const u32 sequence, std::span<const std::byte> data) {
+						// Every frame carries its own sequence number, so the rebuilt ones can be checked
+						if (static_cast<u32>(data[0]) != (sequence & 0xff))
+							std::printf("Corrupted frame %u\n", sequence);
+						hold += current - sequence;
+						delivered++;
+					};
+
+					for (u32 seq = 0; seq < frame_count; ++seq)
+					{
+						current = seq;
+						payload[0] = static_cast<std::byte>(seq & 0xff);
+
+						sent_bytes += payload.size();
+						if (channel.next())
+							lost++;
+						else
+							decoder.on_frame(seq, payload, deliver);
+
+						if (encoder.add(seq, payload))
+						{
+							parity_bytes += payload.size();
+							if (!channel.next())
+								decoder.on_parity(encoder.get_group_start(), encoder.get_parity(), deliver);
+						}
+					}
+
+					const double residual = 1.0 - static_cast<double>(delivered) / frame_count;
+					std::printf("%-6.2f %-6.1f %-6zu %9.1f%% %9.2f%% %9.2f%% %9.1f%% %12.2f\n",
+						loss_rate, burst, group,
+						100.0 * parity_bytes / sent_bytes,
+						100.0 * lost / frame_count,
+						100.0 * residual,
+						lost > 0 ? 100.0 * decoder.get_stats().recovered / lost : 0.0,
+						delivered > 0 ? static_cast<double>(hold) / delivered : 0.0);
+				}
+			}
+		}
+	}
+}
@@ -1,13 +1,68 @@
 #include <ranges>
 #include <algorithm>
 #include <vector>
+#include <string_view>
+#include <span>
 
 #include "common.h"
 
+namespace cnc::test
+{
+	void run_fec_simulation();
+	void run_dynamics_benchmark();
+	void run_realtime_check(std::span<char*> args);
+	void run_transport_benchmark();
+	void run_recording_benchmark();
+	void run_replay(std::span<char*> args);
+	bool run_playout_check();
+	bool run_mixer_check();
+}
 
-int main() {
+int main(int argc, char** argv) {
 	using namespace cnc;
 
+	if (argc > 1 && std::string_view(argv[1]) == "fec")
+	{
+		test::run_fec_simulation();
+		return 0;
+	}
+
+	if (argc > 1 && std::string_view(argv[1]) == "dynamics")
+	{
+		test::run_dynamics_benchmark();
+		return 0;
+	}
+
+	if (argc > 1 && std::string_view(argv[1]) == "transport")
+	{
+		test::run_transport_benchmark();
+		return 0;
+	}
+
+	if (argc > 1 && std::string_view(argv[1]) == "recording")
+	{
+		test::run_recording_benchmark();
+		return 0;
+	}
+
+	if (argc > 1 && std::string_view(argv[1]) == "replay")
+	{
+		test::run_replay(std::span(argv + 2, argc - 2));
+		return 0;
+	}
+
+	if (argc > 1 && std::string_view(argv[1]) == "playout")
+		return test::run_playout_check() ? 0 : 1;
+
+	if (argc > 1 && std::string_view(argv[1]) == "mixer")
+		return test::run_mixer_check() ? 0 : 1;
+
+	if (argc > 1 && std::string_view(argv[1]) == "realtime")
+	{
+		test::run_realtime_check(std::span(argv + 2, argc - 2));
+		return 0;
+	}
+
 	std::vector<sample_t> samples;
 		
 	history_buffer buffer;
@@ -18,4 +73,4 @@ int main() {
 	std::ranges::copy(samples, std::back_inserter(buffer));
 
 	getchar();
-}
\ No newline at end of file
+}
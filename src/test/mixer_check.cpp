@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include "common.h"
+#include "mixer.h"
+
+namespace cnc::test
+{
+	static std::vector<sample_t> make_tone(const audio_format& format, const float frequency, const float amplitude, const std::size_t tick)
+	{
+		std::vector<sample_t> frame(format.samples_per_frame());
+		for (std::size_t i = 0; i < format.frame_length(); ++i)
+		{
+			const float t = static_cast<float>(tick * format.frame_length() + i) / format.sample_rate;
+			const auto v = static_cast<sample_t>(amplitude * 32767.0f * std::sin(2.0f * 3.14159265f * frequency * t));
+			for (u32 ch = 0; ch < format.channels; ++ch)
+				frame[i * format.channels + ch] = v;
+		}
+		return frame;
+	}
+
+	// A listener's gain for a speaker, set before the speaker joined, must show up in the
+	// listener's output as exactly that much of what everybody else hears
+	static bool check_listener_gain()
+	{
+		static constexpr u32 speaker = 1, listener = 2, other = 3;
+		static constexpr float gain = 0.5f;
+		static constexpr std::size_t joins = 3, ticks = 20;
+
+		const audio_format format{ 48000, 1 };
+		const std::vector<sample_t> silence(format.samples_per_frame(), 0);
+
+		mixer room_mixer;
+		room_mixer.set_gain(listener, speaker, gain);
+
+		float worst = 0.0f;
+		for (std::size_t t = 0; t < ticks; ++t)
+		{
+			const auto tone = make_tone(format, 440.0f, 0.1f, t);
+			const std::array<mixer_stream, 3> streams = { {
+				{ listener, format, silence, format },
+				{ other, format, silence, format },
+				{ speaker, format, tone, format },
+			} };
+
+			room_mixer.mix(std::span(streams).first(t < joins ? 2 : 3));
+
+			// The first tick with the speaker ramps the gain in
+			if (t <= joins)
+				continue;
+
+			const auto personal = room_mixer.get_output(listener);
+			const auto shared = room_mixer.get_output(other);
+			for (std::size_t i = 0; i < shared.size(); ++i)
+				worst = std::max(worst, std::abs(personal[i] - gain * shared[i]));
+		}
+
+		room_mixer.remove(listener);
+		const bool forgotten = room_mixer.get_gain(listener, speaker) == 1.0f;
+
+		const bool passed = worst <= 1.0f && forgotten;
+		std::printf("listener gain %.2f: worst error %.1f samples, %s after remove -> %s\n", gain, worst, forgotten ? "gone" : "still set", passed ? "ok" : "FAILED");
+		return passed;
+	}
+
+	// A speaker that stops talking goes back to the shared mix, whose limiter still delays the
+	// end of what it said. None of that may reach the speaker itself.
+	static bool check_no_self_signal()
+	{
+		static constexpr u32 speaker = 1, listener = 2;
+		static constexpr std::size_t stops = 10, ticks = 20;
+
+		const audio_format format{ 48000, 1 };
+		const std::vector<sample_t> silence(format.samples_per_frame(), 0);
+
+		mixer room_mixer;
+
+		int own = 0, heard = 0;
+		for (std::size_t t = 0; t < ticks; ++t)
+		{
+			const auto tone = t < stops ? make_tone(format, 440.0f, 0.3f, t) : silence;
+			const std::array<mixer_stream, 2> streams = { {
+				{ speaker, format, tone, format },
+				{ listener, format, silence, format },
+			} };
+
+			room_mixer.mix(streams);
+
+			for (const sample_t v : room_mixer.get_output(speaker))
+				own = std::max(own, std::abs(static_cast<int>(v)));
+			for (const sample_t v : room_mixer.get_output(listener))
+				heard = std::max(heard, std::abs(static_cast<int>(v)));
+		}
+
+		const bool passed = own <= 1 && heard > 1000;
+		std::printf("talk then silence: speaker's own peak %d, listener's peak %d -> %s\n", own, heard, passed ? "ok" : "FAILED");
+		return passed;
+	}
+
+	// ConcordiaTest mixer
+	bool run_mixer_check()
+	{
+		bool passed = true;
+		passed &= check_listener_gain();
+		passed &= check_no_self_signal();
+		return passed;
+	}
+}
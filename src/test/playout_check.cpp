@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <chrono>
+
+#include "common.h"
+#include "playout_buffer.h"
+
+namespace cnc::test
+{
+	// A perfect link: one frame every frame duration, read by a device with the given period.
+	// Once settled the queue must neither run dry nor be stretched.
+	static bool replay_jitter_free(const audio_format& format, const std::size_t period, const double latency_ms)
+	{
+		static constexpr int seconds = 10;
+		static constexpr int settle_seconds = 2;
+
+		playout_buffer buffer(format);
+
+		std::vector<sample_t> frame(format.samples_per_frame());
+		std::vector<sample_t> output(period * format.channels);
+
+		const double frame_ms = audio_frame_duration_ms;
+		const double period_ms = period * 1000.0 / format.sample_rate;
+		const auto start = playout_buffer::clock_t::time_point{};
+
+		u32 sequence = 0;
+		std::size_t phase = 0;
+		double next_arrival = latency_ms, next_read = 0.0;
+		bool stretched = false;
+
+		while (next_read < seconds * 1000.0)
+		{
+			if (next_arrival <= next_read)
+			{
+				for (std::size_t i = 0; i < format.frame_length(); ++i, ++phase)
+					for (u32 ch = 0; ch < format.channels; ++ch)
+						frame[i * format.channels + ch] = static_cast<sample_t>(8000.0 * std::sin(phase * 0.05));
+
+				buffer.push(frame, sequence++, start + std::chrono::duration_cast<playout_buffer::clock_t::duration>(std::chrono::duration<double, std::milli>(next_arrival)));
+				next_arrival += frame_ms;
+				continue;
+			}
+
+			buffer.read(output);
+			if (next_read >= settle_seconds * 1000.0 && buffer.get_stats().stretch_ratio != 1.0f)
+				stretched = true;
+			next_read += period_ms;
+		}
+
+		const auto stats = buffer.get_stats();
+		const bool passed = stats.underruns == 0 && stats.concealed_frames == 0 && !stretched;
+
+		std::printf("%5u Hz %u ch, period %4zu, latency %4.1f ms: depth %6.1f ms, target %6.1f ms, underruns %u, concealed %zu, %s -> %s\n",
+			format.sample_rate, format.channels, period, latency_ms, stats.depth_ms, stats.target_ms, stats.underruns, stats.concealed_frames,
+			stretched ? "stretched" : "not stretched", passed ? "ok" : "FAILED");
+
+		return passed;
+	}
+
+	// Two frames overtaken by the next one. Each is concealed when the next arrives and must be
+	// dropped when it turns up, without the frame after it being concealed as well.
+	static bool replay_reordered(const audio_format& format)
+	{
+		static constexpr std::array<u32, 12> arrivals = { 0, 1, 3, 2, 4, 5, 6, 8, 7, 9, 10, 11 };
+
+		playout_buffer buffer(format);
+		const std::vector<sample_t> frame(format.samples_per_frame(), 1000);
+
+		// Without reads nothing is concealed for running dry
+		for (const u32 sequence : arrivals)
+			buffer.push(frame, sequence);
+
+		const auto stats = buffer.get_stats();
+		const bool passed = stats.late_frames == 2 && stats.concealed_frames == 2 * format.frame_length();
+
+		std::printf("%5u Hz %u ch, 2 frames overtaken: %zu late, %zu frames concealed -> %s\n",
+			format.sample_rate, format.channels, stats.late_frames, stats.concealed_frames / format.frame_length(), passed ? "ok" : "FAILED");
+
+		return passed;
+	}
+
+	// ConcordiaTest playout
+	bool run_playout_check()
+	{
+		static constexpr std::array<audio_format, 2> formats = { audio_format{ 48000, 2 }, audio_format{ 16000, 1 } };
+		static constexpr std::array<double, 3> latencies = { 0.0, 7.3, 25.0 };
+
+		bool passed = true;
+		for (const auto& format : formats)
+		{
+			// The period the client asks for, and the ones devices commonly pick instead
+			for (const std::size_t period : { format.frame_length(), std::size_t{ format.sample_rate / 100 }, std::size_t{ 256 } })
+				for (const double latency : latencies)
+					passed &= replay_jitter_free(format, period, latency);
+
+			passed &= replay_reordered(format);
+		}
+
+		return passed;
+	}
+}
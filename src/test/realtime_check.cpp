@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <string>
+#include <span>
+
+#include "common.h"
+#include "realtime.h"
+
+namespace cnc::test
+{
+	// ConcordiaTest realtime [cpu] [normal|fifo|rr] [priority] [lock]
+	// Applies the settings to a thread the way the server does and prints the report. Without
+	// CAP_SYS_NICE (or an RLIMIT_RTPRIO) the scheduling part is expected to fail and say why.
+	void run_realtime_check(std::span<char*> args)
+	{
+		realtime::thread_config config;
+
+		if (args.size() > 0)
+			config.cpu = std::atoi(args[0]);
+		if (args.size() > 1)
+			config.policy = realtime::parse_scheduling(args[1]).value_or(realtime::scheduling::normal);
+		if (args.size() > 2)
+			config.priority = std::atoi(args[2]);
+
+		if (args.size() > 3 && std::string(args[3]) == "lock")
+			std::printf("%s\n", realtime::lock_memory().c_str());
+
+		std::thread worker([&] {
+			std::printf("%s\n", realtime::configure_current_thread("Test", config).c_str());
+
+			realtime::prefault_stack();
+			std::printf("Prefaulted %zu KiB of stack\n", std::size_t{ 256 });
+		});
+
+		worker.join();
+	}
+}
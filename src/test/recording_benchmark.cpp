@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+
+#include "common.h"
+#include "recorder.h"
+
+namespace cnc::test
+{
+	// What recording costs the mixer thread per tick, with and without every client's stream,
+	// and whether the files add up: as many frames as ticks, split into segments.
+	void run_recording_benchmark()
+	{
+		namespace fs = std::filesystem;
+
+		static constexpr std::size_t tick_count = 5000;
+		static constexpr std::size_t client_count = 32;
+		static constexpr audio_format client_format{ 16000, 1 };
+
+		const auto directory = fs::temp_directory_path() / "concordia_recording";
+		const float frame_time_us = audio_frame_duration_ms * 1000.0f;
+
+		std::vector<float> mix(mix_format.samples_per_frame());
+		std::vector<sample_t> frame(client_format.samples_per_frame());
+
+		for (std::size_t i = 0; i < mix.size(); ++i)
+			mix[i] = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * i / mix_format.sample_rate);
+		for (std::size_t i = 0; i < frame.size(); ++i)
+			frame[i] = static_cast<sample_t>(8000.0f * std::sin(2.0f * 3.14159265f * 220.0f * i / client_format.sample_rate));
+
+		std::printf("%zu ticks (%.0f s of audio), %zu clients at %u Hz\n", tick_count, tick_count * audio_frame_duration_ms / 1000.0f, client_count, client_format.sample_rate);
+		std::printf("%-8s %10s %10s %10s %10s %10s %12s\n", "streams", "us/tick", "% of tick", "max us", "dropped", "files", "audio s");
+
+		for (const bool streams : { false, true })
+		{
+			fs::remove_all(directory);
+
+			float worst_us = 0.0f;
+			std::chrono::steady_clock::duration total{};
+			std::size_t dropped = 0;
+			fs::path session;
+
+			{
+				room_recorder recorder({ directory, streams, 60 });
+				session = recorder.get_session_directory();
+
+				for (std::size_t t = 0; t < tick_count; ++t)
+				{
+					const auto start = std::chrono::steady_clock::now();
+
+					recorder.record_mix(mix);
+					for (u32 id = 1; id <= client_count; ++id)
+					{
+						// Every client skips a frame now and then, the file must not get shorter
+						const bool sent = (t + id) % 50 != 0;
+						recorder.record_stream(id, client_format, sent ? std::span<const sample_t>(frame) : std::span<const sample_t>{});
+					}
+
+					const auto elapsed = std::chrono::steady_clock::now() - start;
+					total += elapsed;
+					worst_us = std::max(worst_us, std::chrono::duration<float, std::micro>(elapsed).count());
+
+					// About ten times real time, a disk can keep up with that
+					std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long>(frame_time_us / 10)));
+				}
+
+				for (u32 id = 1; id <= client_count; ++id)
+					recorder.end_stream(id);
+
+				dropped = recorder.get_dropped_frames();
+			}
+
+			// Every segment's header must agree with its size
+			std::size_t files = 0, room_bytes = 0, bad = 0;
+			for (const auto& entry : fs::directory_iterator(session))
+			{
+				std::ifstream is(entry.path(), std::ios::binary);
+				char header[44]{};
+				is.read(header, sizeof(header));
+
+				u32 data_size = 0;
+				std::memcpy(&data_size, header + 40, sizeof(data_size));
+
+				files++;
+				if (std::string_view(header, 4) != "RIFF" || data_size + sizeof(header) != entry.file_size())
+					bad++;
+				if (entry.path().filename().string().starts_with("room_"))
+					room_bytes += data_size;
+			}
+
+			const float us = std::chrono::duration<float, std::micro>(total).count() / tick_count;
+			const float room_seconds = static_cast<float>(room_bytes) / (mix_format.sample_rate * sizeof(sample_t));
+
+			std::printf("%-8s %10.2f %9.3f%% %10.1f %10zu %10zu %12.2f%s\n", streams ? "yes" : "no", us, us / frame_time_us * 100.0f, worst_us, dropped, files, room_seconds,
+				bad ? "  BAD HEADERS" : "");
+		}
+
+		fs::remove_all(directory);
+	}
+}
@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <format>
+#include <algorithm>
+#include <span>
+
+#include "common.h"
+#include "capture.h"
+#include "mixer.h"
+
+namespace cnc::test
+{
+	// FNV-1a, enough to tell whether two runs produced the same audio
+	static std::uint64_t checksum(std::span<const std::byte> data, std::uint64_t hash)
+	{
+		for (const auto b : data)
+			hash = (hash ^ static_cast<std::uint64_t>(b)) * 0x100000001b3ull;
+		return hash;
+	}
+
+	static constexpr std::uint64_t s_checksum_basis = 0xcbf29ce484222325ull;
+
+	// ConcordiaTest replay <capture> [max|realtime] [per-tick csv]
+	// Runs a capture taken with the server's capture_file option through the mixer and times
+	// every tick the way the server does: mix, then fetch every output. The checksum covers all
+	// the outputs in order, two builds that mix the same way print the same one.
+	void run_replay(std::span<char*> args)
+	{
+		if (args.empty())
+		{
+			std::printf("Usage: ConcordiaTest replay <capture> [max|realtime] [per-tick csv]\n");
+			return;
+		}
+
+		const bool realtime = args.size() > 1 && std::string(args[1]) == "realtime";
+
+		std::ofstream csv;
+		if (args.size() > 2)
+		{
+			csv.open(args[2]);
+			csv << "tick,streams,speakers,us,checksum\n";
+		}
+
+		try
+		{
+			capture_reader reader(args[0]);
+
+			mixer room_mixer;
+			captured_tick tick;
+			std::vector<mixer_stream> streams;
+			std::vector<float> times_us;
+
+			std::uint64_t total = s_checksum_basis;
+			std::uint64_t expected_index = 0;
+			std::size_t gaps = 0, stream_ticks = 0;
+
+			const auto start = std::chrono::steady_clock::now();
+			std::int64_t first_tick_ns = -1;
+
+			while (reader.next(tick))
+			{
+				if (tick.header.index != expected_index)
+					gaps++;
+				expected_index = tick.header.index + 1;
+
+				if (first_tick_ns < 0)
+					first_tick_ns = tick.header.time_ns;
+
+				// As the server ran it, frames arriving late included
+				if (realtime)
+					std::this_thread::sleep_until(start + std::chrono::nanoseconds(tick.header.time_ns - first_tick_ns));
+
+				tick.apply_settings(room_mixer);
+				tick.get_mixer_streams(streams);
+
+				const auto mix_start = std::chrono::steady_clock::now();
+
+				room_mixer.mix(streams);
+
+				std::uint64_t hash = s_checksum_basis;
+				for (const auto& s : streams)
+					hash = checksum(std::as_bytes(room_mixer.get_output(s.id)), hash);
+
+				times_us.push_back(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - mix_start).count());
+
+				hash = checksum(std::as_bytes(room_mixer.get_room_mix()), hash);
+				total = checksum(std::as_bytes(std::span(&hash, 1)), total);
+				stream_ticks += streams.size();
+
+				if (csv.is_open())
+					csv << std::format("{},{},{},{:.2f},{:016x}\n", tick.header.index, streams.size(), room_mixer.get_speakers().size(), times_us.back(), hash);
+			}
+
+			if (times_us.empty())
+			{
+				std::printf("The capture is empty\n");
+				return;
+			}
+
+			const float wall_s = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+			const float audio_s = times_us.size() * audio_frame_duration_ms / 1000.0f;
+
+			float mean = 0.0f;
+			for (const float t : times_us)
+				mean += t / times_us.size();
+
+			std::ranges::sort(times_us);
+			auto percentile = [&](const double p) { return times_us[static_cast<std::size_t>(p * (times_us.size() - 1))]; };
+
+			std::printf("%zu ticks (%.1f s of audio in %.1f s), %.1f streams per tick, %zu gaps\n", times_us.size(), audio_s, wall_s,
+				static_cast<float>(stream_ticks) / times_us.size(), gaps);
+			std::printf("us/tick: mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n", mean, percentile(0.5), percentile(0.99), times_us.back());
+			std::printf("checksum %016llx\n", static_cast<unsigned long long>(total));
+		}
+		catch (std::exception& ex)
+		{
+			std::printf("%s\n", ex.what());
+		}
+	}
+}
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <functional>
+
+#include "common.h"
+#include "protocol.h"
+#include "local_transport.h"
+
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+#include <cstring>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#endif
+
+namespace cnc::test
+{
+#ifdef CNC_HAS_LOCAL_TRANSPORT
+
+	static constexpr std::size_t s_round_trips = 20000;
+
+	static double cpu_time_us()
+	{
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+		return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	}
+
+	static void read_all(const int fd, std::span<std::byte> data)
+	{
+		for (std::size_t done = 0; done < data.size();)
+		{
+			const auto n = read(fd, data.data() + done, data.size() - done);
+			if (n <= 0)
+				throw std::runtime_error("read failed");
+			done += n;
+		}
+	}
+
+	static void write_all(const int fd, std::span<const std::byte> data)
+	{
+		for (std::size_t done = 0; done < data.size();)
+		{
+			const auto n = write(fd, data.data() + done, data.size() - done);
+			if (n <= 0)
+				throw std::runtime_error("write failed");
+			done += n;
+		}
+	}
+
+	// One packet out, wait for it to come back. The echo side runs in its own thread, as the server would.
+	static void measure(const char* name, std::function<void(std::span<std::byte>)> round_trip, std::span<std::byte> packet)
+	{
+		std::vector<float> rtt(s_round_trips);
+
+		// Warm up
+		for (std::size_t i = 0; i < 100; ++i)
+			round_trip(packet);
+
+		const double cpu_start = cpu_time_us();
+		const auto start = std::chrono::steady_clock::now();
+
+		for (auto& t : rtt)
+		{
+			const auto sent = std::chrono::steady_clock::now();
+			round_trip(packet);
+			t = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - sent).count();
+		}
+
+		const float wall = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+		const double cpu = cpu_time_us() - cpu_start;
+
+		std::ranges::sort(rtt);
+		auto percentile = [&](const double p) { return rtt[static_cast<std::size_t>(p * (rtt.size() - 1))]; };
+
+		std::printf("%-14s %10.1f %10.1f %10.1f %10.1f %14.1f\n", name, percentile(0.5), percentile(0.99), rtt.back(), wall / s_round_trips, cpu / s_round_trips);
+	}
+
+	static void run_stream(const char* name, const int client, const int server, std::span<std::byte> packet)
+	{
+		std::thread echo([&, size = packet.size()] {
+			std::vector<std::byte> buffer(size);
+			try
+			{
+				while (true)
+				{
+					read_all(server, buffer);
+					write_all(server, buffer);
+				}
+			}
+			catch (...) {}
+		});
+
+		measure(name, [&](std::span<std::byte> p) { write_all(client, p); read_all(client, p); }, packet);
+
+		shutdown(client, SHUT_RDWR);
+		echo.join();
+		close(client);
+		close(server);
+	}
+
+	// Round trips of one 48 kHz stereo frame over shared memory, a Unix socket and loopback TCP.
+	// CPU is for both ends together.
+	void run_transport_benchmark()
+	{
+		const audio_format fmt{ 48000, 2 };
+		const auto header = protocol::make_frame_header(0, fmt);
+
+		std::vector<std::byte> packet(sizeof(header) + fmt.bytes_per_frame());
+		std::memcpy(packet.data(), &header, sizeof(header));
+
+		std::printf("%zu byte packets, %zu round trips\n", packet.size(), s_round_trips);
+		std::printf("%-14s %10s %10s %10s %10s %14s\n", "transport", "p50 us", "p99 us", "max us", "wall us", "cpu us/trip");
+
+		{
+			auto link = local::shared_memory_link::create();
+			std::atomic_bool done{ false };
+
+			std::thread echo([&] {
+				std::vector<std::byte> payload(fmt.bytes_per_frame());
+				protocol::frame_header h;
+				while (!done)
+				{
+					if (!link.get_upstream().pop(h, payload))
+					{
+						local::wait(link.get_upstream_event(), std::chrono::milliseconds(100));
+						continue;
+					}
+					link.get_downstream().push(h, payload);
+					local::signal(link.get_downstream_event());
+				}
+			});
+
+			std::vector<std::byte> payload(fmt.bytes_per_frame());
+			measure("shared memory", [&](std::span<std::byte>) {
+				protocol::frame_header h;
+				link.get_upstream().push(header, payload);
+				local::signal(link.get_upstream_event());
+				while (!link.get_downstream().pop(h, payload))
+					local::wait(link.get_downstream_event(), std::chrono::milliseconds(100));
+			}, packet);
+
+			done = true;
+			echo.join();
+		}
+
+		{
+			int pair[2];
+			socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+			run_stream("unix socket", pair[0], pair[1], packet);
+		}
+
+		{
+			const int listener = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address{};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t length = sizeof(address);
+			bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			listen(listener, 1);
+			getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+			const int client = socket(AF_INET, SOCK_STREAM, 0);
+			connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			const int server = accept(listener, nullptr, nullptr);
+			close(listener);
+
+			const int one = 1;
+			setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+			run_stream("tcp loopback", client, server, packet);
+		}
+	}
+
+#else
+
+	void run_transport_benchmark()
+	{
+		std::printf("The local transport isn't available on this platform\n");
+	}
+
+#endif
+}